@@ -8,21 +8,47 @@ preserved.
 
 #include "conf4.h"
 
+#include <algorithm>
+#include <limits>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
 #ifndef PATH_MAX
 #ifdef Q_OS_WIN
 #define PATH_MAX 260
 #endif
 #endif
 
+// the shared probe cache needs QLockFile and QSaveFile
+#if QT_VERSION >= 0x050100
+#define QC_SHARED_CACHE
+#endif
+
+// conf4.pro defines this if QtNetwork is available, for the remote cache
+#if defined(QC_SHARED_CACHE) && defined(QC_HAVE_NETWORK)
+#include <QtNetwork>
+#else
+#undef QC_HAVE_NETWORK
+#endif
+
+// the tests include this file with QC_NO_MAIN, which leaves out main()
+// and this moc check
+#ifndef QC_NO_MAIN
 class MocTestObject : public QObject {
 
     Q_OBJECT
 public:
     MocTestObject() {}
 };
+#endif
 
 QString qc_getenv(const QString &var)
 {
@@ -91,13 +117,514 @@ QString qc_findself(const QString &argv0)
         return qc_findprogram(argv0);
 }
 
-int qc_run_program_or_command(const QString &prog, const QStringList &args, const QString &command, QByteArray *out,
-                              bool showOutput)
+//----------------------------------------------------------------------------
+// running commands
+//----------------------------------------------------------------------------
+// every command started for a check is known here, so that they can all be
+// killed at once when a required check fails while others are still running
+// (configure --jobs).  once that happened, no new command is started.  on
+// windows the running ones are left to finish.
+//
+// on unix, each command runs in a process group of its own, and killing it
+// kills the whole group, so nothing it started is left behind.
+
+// runs the command in a process group of its own
+class QcProcess : public QProcess {
+public:
+    QcProcess()
+    {
+#if QT_VERSION >= 0x060000 && defined(Q_OS_UNIX)
+        setChildProcessModifier([] { ::setpgid(0, 0); });
+#endif
+    }
+
+protected:
+#if QT_VERSION < 0x060000 && defined(Q_OS_UNIX)
+    void setupChildProcess() { ::setpgid(0, 0); }
+#endif
+};
+
+static QMutex       qc_procs_mutex;
+static QSet<qint64> qc_procs;
+static bool         qc_cancelled = false;
+
+static qint64 qc_process_id(QProcess *process)
+{
+#if QT_VERSION >= 0x050300
+    return process->processId();
+#elif defined(Q_OS_UNIX)
+    return process->pid();
+#else
+    Q_UNUSED(process);
+    return 0;
+#endif
+}
+
+static bool qc_is_cancelled()
+{
+    QMutexLocker locker(&qc_procs_mutex);
+    return qc_cancelled;
+}
+
+// returns the id to pass to qc_untrack_process, which has to be taken
+//   while the process is running, or -1 if the commands were cancelled and
+//   the process must not be waited for
+static qint64 qc_track_process(QProcess *process)
+{
+    QMutexLocker locker(&qc_procs_mutex);
+    if (qc_cancelled)
+        return -1;
+    qint64 pid = qc_process_id(process);
+    if (pid > 0)
+        qc_procs.insert(pid);
+    return pid;
+}
+
+static void qc_untrack_process(qint64 pid)
+{
+    QMutexLocker locker(&qc_procs_mutex);
+    qc_procs.remove(pid);
+}
+
+#ifdef Q_OS_UNIX
+static bool qc_kill_group(qint64 pid)
+{
+    return ::kill(-pid_t(pid), SIGKILL) == 0 || ::kill(pid_t(pid), SIGKILL) == 0;
+}
+#endif
+
+// kills the process and everything it started
+static void qc_kill_process(QProcess *process, qint64 pid)
+{
+#ifdef Q_OS_UNIX
+    if (pid > 0 && qc_kill_group(pid))
+        return;
+#else
+    Q_UNUSED(pid);
+#endif
+    process->kill();
+}
+
+static void qc_cancel_commands()
+{
+    QMutexLocker locker(&qc_procs_mutex);
+    qc_cancelled = true;
+#ifdef Q_OS_UNIX
+    foreach (qint64 pid, qc_procs)
+        qc_kill_group(pid);
+#endif
+}
+
+//----------------------------------------------------------------------------
+// timeouts
+//----------------------------------------------------------------------------
+// QC_TIMEOUT (configure --timeout) is how many seconds a single command may
+// run, and QC_DEADLINE_AT (configure --deadline) the time, in seconds since
+// the epoch, by which configure must be done.  a command that runs into
+// either is killed, and reported along with the result of its check.
+
+static qint64 qc_timeout_ms  = -1;
+static qint64 qc_deadline_ms = -1; // since the epoch
+
+static void qc_init_timeouts()
+{
+    bool   ok;
+    qint64 secs = qc_getenv("QC_TIMEOUT").toLongLong(&ok);
+    if (ok && secs > 0)
+        qc_timeout_ms = secs * 1000;
+    secs = qc_getenv("QC_DEADLINE_AT").toLongLong(&ok);
+    if (ok && secs > 0)
+        qc_deadline_ms = secs * 1000;
+}
+
+static bool qc_deadline_passed()
+{
+    return qc_deadline_ms != -1 && QDateTime::currentMSecsSinceEpoch() >= qc_deadline_ms;
+}
+
+// how long a command started now may run, or -1 for no limit
+static int qc_command_timeout()
+{
+    qint64 ms = qc_timeout_ms;
+    if (qc_deadline_ms != -1) {
+        qint64 left = qMax(qc_deadline_ms - QDateTime::currentMSecsSinceEpoch(), qint64(0));
+        if (ms == -1 || left < ms)
+            ms = left;
+    }
+    return ms == -1 ? -1 : int(qMin(ms, qint64(INT_MAX)));
+}
+
+// what is left of timeout since timer was started, for the waitFor
+//   functions of QProcess
+static int qc_time_left(const QElapsedTimer &timer, int timeout)
+{
+    if (timeout == -1)
+        return -1;
+    return int(qMax(qint64(timeout) - timer.elapsed(), qint64(0)));
+}
+
+static QString qc_command_string(const QString &prog, const QStringList &args)
+{
+    QString fullcmd = prog;
+    QString argstr  = args.join(QLatin1String(" "));
+    if (!argstr.isEmpty())
+        fullcmd += QString(" ") + argstr;
+    return fullcmd;
+}
+
+static void qc_note_timeout(const QString &command, qint64 ms);
+
+//----------------------------------------------------------------------------
+// record and replay
+//----------------------------------------------------------------------------
+// with QC_RECORD=file (configure --record=FILE), every command conf runs is
+// written to file with its exit code, output and how long it took, after
+// the environment it ran in.  with QC_REPLAY=file (configure --replay=FILE)
+// nothing is run, and each command is answered from such a file instead,
+// so a configure can be reproduced on a host without the toolchain it was
+// recorded with.  both turn off the probe cache and the conf service, which
+// would leave commands out.
+//
+// a command is matched by its arguments and working dir, with the build dir
+// and the atest dirs replaced by names that are the same on every run: the
+// build dir by $BUILDDIR, an atest dir by a hash of what is in it.  the
+// same command is answered in the order it was recorded, and the last
+// answer is repeated if it is run more often.  QC_REPLAY_DELAY=Y makes each
+// answer take as long as the command did.
+//
+// the file is text, one line each, with fields separated by tabs and
+// percent-encoded:
+//
+//   qconf-record 1
+//   env     <NAME=value lines>
+//   run     <command> <working dir> <exit code> <ms> <stdout> <stderr>
+
+class QcRecordedRun {
+public:
+    int        ret;
+    qint64     ms;
+    QByteArray out;
+    QByteArray err;
+
+    QcRecordedRun() : ret(-1), ms(0) { }
+};
+
+static QMutex                               qc_replay_mutex;
+static QFile *                              qc_record_file = 0;
+static bool                                 qc_replay_on   = false;
+static bool                                 qc_replay_delay;
+static QString                              qc_replay_builddir;
+static QMap<QString, QString>               qc_replay_dirs; // absolute path to name
+static QMap<QString, QList<QcRecordedRun> > qc_replay_runs; // by key
+static int                                  qc_replay_misses = 0;
+
+static bool qc_recording() { return qc_record_file != 0; }
+
+static bool qc_replaying() { return qc_replay_on; }
+
+static QByteArray qc_replay_escape(const QByteArray &in) { return in.toPercentEncoding(" /=:,+@$"); }
+
+static QString qc_replay_key(const QString &command, const QString &dir) { return command + '\n' + dir; }
+
+// opens the files given by QC_RECORD and QC_REPLAY
+static bool qc_init_replay()
+{
+    qc_replay_builddir = QDir::currentPath();
+    qc_replay_delay    = qc_getenv("QC_REPLAY_DELAY") == "Y";
+
+    QString fname = qc_getenv("QC_REPLAY");
+    if (!fname.isEmpty()) {
+        QFile f(fname);
+        if (!f.open(QFile::ReadOnly) || f.readLine().trimmed() != "qconf-record 1") {
+            printf("Error: %s is not a conf record\n", qPrintable(fname));
+            return false;
+        }
+        while (!f.atEnd()) {
+            QByteArray line = f.readLine();
+            if (line.endsWith('\n'))
+                line.chop(1);
+            QList<QByteArray> fields = line.split('\t');
+            if (fields.count() != 7 || fields[0] != "run")
+                continue;
+            QcRecordedRun run;
+            run.ret = fields[3].toInt();
+            run.ms  = fields[4].toLongLong();
+            run.out = QByteArray::fromPercentEncoding(fields[5]);
+            run.err = QByteArray::fromPercentEncoding(fields[6]);
+            QString key = qc_replay_key(QString::fromUtf8(QByteArray::fromPercentEncoding(fields[1])),
+                                        QString::fromUtf8(QByteArray::fromPercentEncoding(fields[2])));
+            qc_replay_runs[key] += run;
+        }
+        qc_replay_on = true;
+        return true;
+    }
+
+    fname = qc_getenv("QC_RECORD");
+    if (!fname.isEmpty()) {
+        qc_record_file = new QFile(fname);
+        if (!qc_record_file->open(QFile::WriteOnly | QFile::Truncate)) {
+            printf("Error: cannot write %s\n", qPrintable(fname));
+            return false;
+        }
+        QByteArray  env;
+        const char *vars[] = { "PATH",         "CC",              "CXX",               "CFLAGS",    "CXXFLAGS",
+                               "CPPFLAGS",     "LDFLAGS",         "CPATH",             "QMAKESPEC", "QMAKEPATH",
+                               "LIBRARY_PATH", "PKG_CONFIG_PATH", "PKG_CONFIG_LIBDIR", 0 };
+        for (int n = 0; vars[n]; ++n)
+            env += QByteArray(vars[n]) + '=' + qc_getenv(vars[n]).toUtf8() + '\n';
+        foreach (const QString &var, QProcess::systemEnvironment()) {
+            if (var.startsWith("QC_"))
+                env += var.toUtf8() + '\n';
+        }
+        qc_record_file->write("qconf-record 1\n");
+        qc_record_file->write("env\t" + qc_replay_escape(env) + '\n');
+        qc_record_file->flush();
+    }
+    return true;
+}
+
+// gives the atest dir at path a name for the keys
+static void qc_replay_name_dir(const QString &path, const QByteArray &contents)
+{
+    if (!qc_recording() && !qc_replaying())
+        return;
+    QByteArray   hash = QCryptographicHash::hash(contents, QCryptographicHash::Sha1).toHex();
+    QMutexLocker locker(&qc_replay_mutex);
+    qc_replay_dirs.insert(path, "atest-" + QString::fromLatin1(hash.left(16)));
+}
+
+// the key of a command run in workdir, or in the current dir if empty
+static QString qc_replay_command_key(const QString &command, const QString &workdir)
+{
+    QString      dir = QDir(workdir.isEmpty() ? QDir::currentPath() : workdir).absolutePath();
+    QString      cmd = command;
+    QMutexLocker locker(&qc_replay_mutex);
+    if (qc_replay_dirs.contains(dir)) {
+        cmd.replace(dir, qc_replay_dirs.value(dir));
+        dir = qc_replay_dirs.value(dir);
+    } else {
+        cmd.replace(qc_replay_builddir, "$BUILDDIR");
+        dir.replace(qc_replay_builddir, "$BUILDDIR");
+    }
+    return qc_replay_key(cmd, dir);
+}
+
+static void qc_record(const QString &key, const QcRecordedRun &run)
+{
+    // the working dir is after the last newline
+    int        n    = key.lastIndexOf('\n');
+    QByteArray line = "run\t" + qc_replay_escape(key.left(n).toUtf8());
+    line += '\t' + qc_replay_escape(key.mid(n + 1).toUtf8());
+    line += '\t' + QByteArray::number(run.ret) + '\t' + QByteArray::number(run.ms);
+    line += '\t' + qc_replay_escape(run.out) + '\t' + qc_replay_escape(run.err) + '\n';
+
+    QMutexLocker locker(&qc_replay_mutex);
+    qc_record_file->write(line);
+    qc_record_file->flush();
+}
+
+// false if the command isn't in the record, in which case it fails
+static bool qc_replay(const QString &key, QcRecordedRun *run)
+{
+    QMutexLocker locker(&qc_replay_mutex);
+    QMap<QString, QList<QcRecordedRun> >::Iterator it = qc_replay_runs.find(key);
+    if (it == qc_replay_runs.end()) {
+        ++qc_replay_misses;
+        *run = QcRecordedRun();
+        return false;
+    }
+    *run = it.value().count() > 1 ? it.value().takeFirst() : it.value().first();
+    return true;
+}
+
+// with QC_REPLAY_DELAY, waits for what is left of run.ms since timer was
+//   started
+static void qc_replay_wait(const QcRecordedRun &run, const QElapsedTimer &timer)
+{
+    qint64 left = run.ms - timer.elapsed();
+    if (!qc_replay_delay || left <= 0)
+        return;
+    QMutex         mutex;
+    QWaitCondition cond;
+    mutex.lock();
+    cond.wait(&mutex, (unsigned long)left);
+    mutex.unlock();
+}
+
+//----------------------------------------------------------------------------
+// job slots
+//----------------------------------------------------------------------------
+// the tokens that let more than one command run at a time.  they come from
+// the GNU make jobserver if configure was started from the recipe of a
+// parallel make (MAKEFLAGS has --jobserver-auth, with a pipe or a fifo),
+// otherwise from a pool of --jobs - 1.  with neither, there is no limit.
+// like every make job, the process also has an implicit token of its own,
+// which is what the first check runs on.
+
+class QcJobServer {
+public:
+    QcJobServer() : rfd(-1), wfd(-1), ownRfd(false), pool(0), implicitFree(true) { }
+
+    ~QcJobServer()
+    {
+#ifdef Q_OS_UNIX
+        if (ownRfd)
+            ::close(rfd);
+#endif
+        delete pool;
+    }
+
+    // returns what the tokens come from, for the debug output
+    QString init(int jobs)
+    {
+#ifdef Q_OS_UNIX
+        // the last one counts.  make before 4.2 calls it --jobserver-fds
+        QString auth;
+        foreach (const QString &arg, qc_getenv("MAKEFLAGS").split(' ')) {
+            if (arg.startsWith(QLatin1String("--jobserver-auth=")))
+                auth = arg.mid(17);
+            else if (arg.startsWith(QLatin1String("--jobserver-fds=")))
+                auth = arg.mid(16);
+        }
+
+        if (auth.startsWith(QLatin1String("fifo:"))) {
+            rfd = ::open(QFile::encodeName(auth.mid(5)).data(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            if (rfd != -1) {
+                wfd    = rfd;
+                ownRfd = true;
+                return QString("make jobserver %1").arg(auth);
+            }
+        } else if (!auth.isEmpty()) {
+            QStringList fds = auth.split(',');
+            bool        rok = false, wok = false;
+            int         r   = fds[0].toInt(&rok);
+            int         w   = fds.value(1).toInt(&wok);
+            // make only passes the pipe on to recipes it knows to be
+            //   recursive, so it may well be closed
+            if (rok && wok && ::fcntl(r, F_GETFD) != -1 && ::fcntl(w, F_GETFD) != -1) {
+                // a reader of our own that doesn't block, since the pipe
+                //   itself is shared with make.  without /proc, a read
+                //   after poll may block if another job was faster.
+                rfd = ::open(QString("/proc/self/fd/%1").arg(r).toLatin1().data(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+                if (rfd != -1)
+                    ownRfd = true;
+                else
+                    rfd = r;
+                wfd = w;
+                return QString("make jobserver %1").arg(auth);
+            }
+        }
+#endif
+        if (jobs > 1) {
+            pool = new QSemaphore(jobs - 1);
+            return QString("%1 jobs").arg(jobs);
+        }
+        return QString();
+    }
+
+    bool limited() const { return rfd != -1 || pool; }
+    bool fromMake() const { return rfd != -1; }
+
+    bool takeImplicit()
+    {
+        QMutexLocker locker(&mutex);
+        if (!implicitFree)
+            return false;
+        implicitFree = false;
+        return true;
+    }
+
+    void giveImplicit()
+    {
+        QMutexLocker locker(&mutex);
+        implicitFree = true;
+    }
+
+    bool tryTake(char *token) { return take(token, 0); }
+
+    // waits for a token, in steps so that a cancel is noticed.  returns
+    //   false if cancelled.  if make went away, there is no limit anymore,
+    //   which is what a zero token means.
+    bool take(char *token)
+    {
+        while (!qc_is_cancelled()) {
+            if (take(token, 100))
+                return true;
+        }
+        return false;
+    }
+
+    void give(char token)
+    {
+        if (pool) {
+            pool->release();
+            return;
+        }
+#ifdef Q_OS_UNIX
+        if (wfd != -1 && token) {
+            while (::write(wfd, &token, 1) == -1 && errno == EINTR) { }
+        }
+#else
+        Q_UNUSED(token);
+#endif
+    }
+
+private:
+    int         rfd, wfd;
+    bool        ownRfd;
+    QSemaphore *pool;
+    QMutex      mutex;
+    bool        implicitFree;
+
+    bool take(char *token, int msecs)
+    {
+        if (pool) {
+            *token = '+';
+            return pool->tryAcquire(1, msecs);
+        }
+#ifdef Q_OS_UNIX
+        if (rfd == -1) {
+            *token = 0;
+            return true;
+        }
+        struct pollfd p;
+        p.fd      = rfd;
+        p.events  = POLLIN;
+        p.revents = 0;
+        if (::poll(&p, 1, msecs) <= 0)
+            return false;
+        ssize_t n = ::read(rfd, token, 1);
+        if (n == 0)
+            *token = 0;
+        return n != -1;
+#else
+        *token = 0;
+        return true;
+#endif
+    }
+};
+
+static QcJobServer *qc_jobserver()
+{
+    static QcJobServer js;
+    return &js;
+}
+
+// err gets the error output, if given
+static int qc_run_process(const QString &prog, const QStringList &args, const QString &command, QByteArray *out,
+                          QByteArray *err, bool showOutput)
 {
     if (out)
         out->clear();
 
-    QProcess process;
+    if (qc_is_cancelled())
+        return -1;
+
+    QElapsedTimer timer;
+    timer.start();
+    int timeout = qc_command_timeout();
+
+    QcProcess process;
     process.setReadChannel(QProcess::StandardOutput);
 
     if (!prog.isEmpty())
@@ -107,12 +634,27 @@ int qc_run_program_or_command(const QString &prog, const QStringList &args, cons
     else
         return -1;
 
-    if (!process.waitForStarted(-1))
+    // starting counts against the time of the command as well, as a hung
+    //   network filesystem can keep exec from returning
+    if (!process.waitForStarted(qc_time_left(timer, timeout))) {
+        if (process.state() == QProcess::Starting) {
+            qc_kill_process(&process, qc_process_id(&process));
+            process.waitForFinished(-1);
+            qc_note_timeout(prog.isEmpty() ? command : qc_command_string(prog, args), timer.elapsed());
+        }
+        return -1;
+    }
+
+    qint64 pid = qc_track_process(&process);
+    if (pid == -1) {
+        process.kill();
+        process.waitForFinished(-1);
         return -1;
+    }
 
     QByteArray buf;
 
-    while (process.waitForReadyRead(-1)) {
+    while (process.waitForReadyRead(qc_time_left(timer, timeout))) {
         buf = process.readAllStandardOutput();
         if (out)
             out->append(buf);
@@ -120,11 +662,15 @@ int qc_run_program_or_command(const QString &prog, const QStringList &args, cons
             fprintf(stdout, "%s", buf.data());
 
         buf = process.readAllStandardError();
+        if (err)
+            err->append(buf);
         if (showOutput)
             fprintf(stderr, "%s", buf.data());
     }
 
     buf = process.readAllStandardError();
+    if (err)
+        err->append(buf);
     if (showOutput)
         fprintf(stderr, "%s", buf.data());
 
@@ -133,7 +679,16 @@ int qc_run_program_or_command(const QString &prog, const QStringList &args, cons
     //   waitForFinished. however, we will do it anyway just to be safe.
     //   we won't check the return value since false could still mean
     //   success (if the process had already been marked as finished).
-    process.waitForFinished(-1);
+    //   if it is still running after that, it ran out of time.
+    process.waitForFinished(qc_time_left(timer, timeout));
+    if (process.state() != QProcess::NotRunning) {
+        qc_kill_process(&process, pid);
+        process.waitForFinished(-1);
+        qc_untrack_process(pid);
+        qc_note_timeout(prog.isEmpty() ? command : qc_command_string(prog, args), timer.elapsed());
+        return -1;
+    }
+    qc_untrack_process(pid);
 
     if (process.exitStatus() != QProcess::NormalExit)
         return -1;
@@ -141,6 +696,35 @@ int qc_run_program_or_command(const QString &prog, const QStringList &args, cons
     return process.exitCode();
 }
 
+int qc_run_program_or_command(const QString &prog, const QStringList &args, const QString &command, QByteArray *out,
+                              bool showOutput)
+{
+    if (!qc_recording() && !qc_replaying())
+        return qc_run_process(prog, args, command, out, 0, showOutput);
+
+    QString       key = qc_replay_command_key(prog.isEmpty() ? command : qc_command_string(prog, args), QString());
+    QcRecordedRun run;
+    QElapsedTimer timer;
+    timer.start();
+    if (qc_replaying()) {
+        qc_replay(key, &run);
+        qc_replay_wait(run, timer);
+        if (showOutput) {
+            fprintf(stdout, "%s", run.out.data());
+            fprintf(stderr, "%s", run.err.data());
+        }
+    } else {
+        run.ret = qc_run_process(prog, args, command, &run.out, &run.err, showOutput);
+        run.ms  = timer.elapsed();
+        // what was cancelled says nothing about the command
+        if (!qc_is_cancelled())
+            qc_record(key, run);
+    }
+    if (out)
+        *out = run.out;
+    return run.ret;
+}
+
 int qc_runcommand(const QString &command, QByteArray *out, bool showOutput)
 {
     return qc_run_program_or_command(QString(), QStringList(), command, out, showOutput);
@@ -179,6 +763,15 @@ bool qc_removedir(const QString &dirPath)
 
 // simple command line arguemnts splitter able to understand quoted args.
 // the splitter removes quotes and unescapes symbols as well.
+//
+// this is what every pkg-config and *-config output goes through, so any
+// change must keep these results:
+//   -I/a  -DX            -> "-I/a", "-DX"      (runs of whitespace separate)
+//   "-I/a b" '-DY="1 2"' -> "-I/a b", "-DY=\"1 2\""
+//   "a\"b\\c"           -> "a\"b\\c"  (only \" and \\ are escapes in "")
+//   'a\b'                -> "a\\b"        (no escapes in '')
+//   a\ b                 -> "a b"         (not on windows, where \ is kept)
+//   "a b                 -> "a b"         (unterminated quotes run to the end)
 QStringList qc_splitflags(const QString &flags)
 {
     QStringList ret;
@@ -211,6 +804,10 @@ QStringList qc_splitflags(const QString &flags)
                     continue;
                 }
             } else { // we are in double quoetes
+                if (flags[i] == quote) {
+                    inQuotes = false;
+                    continue;
+                }
                 if (i < flags.length() - 1 && flags[i] == backslash
                     && (flags[i + 1] == QLatin1Char('"') || flags[i + 1] == backslash)) {
                     // if next symbol is one of in parentheses ("\)
@@ -243,6 +840,9 @@ QStringList qc_splitflags(const QString &flags)
     return ret;
 }
 
+// splits cflags like qc_splitflags, putting the -I paths (without the -I)
+// into incs and everything else into otherflags, both in their order.
+// "-I" followed by a separate argument is not understood.
 void qc_splitcflags(const QString &cflags, QStringList *incs, QStringList *otherflags)
 {
     incs->clear();
@@ -250,10 +850,10 @@ void qc_splitcflags(const QString &cflags, QStringList *incs, QStringList *other
 
     QStringList cflagsList = qc_splitflags(cflags);
     for (int n = 0; n < cflagsList.count(); ++n) {
-        QString str = cflagsList[n];
-        if (str.startsWith("-I")) {
+        const QString &str = cflagsList[n];
+        if (str.startsWith(QLatin1String("-I"))) {
             // we want everything except the leading "-I"
-            incs->append(str.remove(0, 2));
+            incs->append(str.mid(2));
         } else {
             // we want whatever is left
             otherflags->append(str);
@@ -263,16 +863,12 @@ void qc_splitcflags(const QString &cflags, QStringList *incs, QStringList *other
 
 QString qc_escapeArg(const QString &str)
 {
-    QString out;
-    for (int n = 0; n < (int)str.length(); ++n) {
-        if (str[n] == '-')
-            out += '_';
-        else
-            out += str[n];
-    }
+    QString out = str;
+    out.replace(QLatin1Char('-'), QLatin1Char('_'));
     return out;
 }
 
+// removes one ch from both ends, but only if it is at both ends
 QString qc_trim_char(const QString &s, const QChar &ch)
 {
     if (s.startsWith(ch) && s.endsWith(ch)) {
@@ -282,7 +878,8 @@ QString qc_trim_char(const QString &s, const QChar &ch)
 }
 
 // removes surrounding quotes, removes trailing slashes, converts to native separators.
-// accepts unescaped but possible quoted path
+// accepts unescaped but possible quoted path.  whitespace around the path is
+// trimmed, "/" becomes "" and a quoted path keeps the whitespace inside the quotes.
 QString qc_normalize_path(const QString &str)
 {
     QString path = str.trimmed();
@@ -304,6 +901,7 @@ QString qc_normalize_path(const QString &str)
 }
 
 // escape filesystem path to be added to qmake pro/pri file.
+// \ and " are backslash-escaped, and the result is quoted if it has spaces.
 QString qc_escape_string_var(const QString &str)
 {
     QString path = str;
@@ -329,6 +927,8 @@ QString qc_prepare_includepath(const QStringList &incs)
 
 // escapes each path in libs and to make it suiable for LIBS var
 // notice, entries of libs are every single arg for linker.
+// the -L paths are deduplicated and moved to the front, keeping their order.
+// -l args are kept as they are, and everything else is escaped in place.
 QString qc_prepare_libs(const QStringList &libs)
 {
     if (libs.isEmpty()) {
@@ -357,49 +957,304 @@ QString qc_prepare_libs(const QStringList &libs)
     return ret + ordered.join(QLatin1String(" "));
 }
 
+// appends "name milliseconds" to the file in QC_TIMINGS_FILE, which is set
+// by configure --timings
+static void qc_report_timing(const QString &name, const QElapsedTimer &timer)
+{
+    QString fname = qc_getenv("QC_TIMINGS_FILE");
+    if (fname.isEmpty())
+        return;
+    QFile f(fname);
+    if (!f.open(QFile::WriteOnly | QFile::Append))
+        return;
+    f.write(QString("%1 %2\n").arg(name).arg(timer.elapsed()).toLatin1());
+}
+
 //----------------------------------------------------------------------------
-// ConfObj
+// check outputs
 //----------------------------------------------------------------------------
-ConfObj::ConfObj(Conf *c)
+// what one check adds to the configuration.  when checks run one at a
+// time, in declaration order, it goes into Conf right away as well, so a
+// check sees what those before it added.  when they run in parallel, it is
+// kept apart until all the checks are done and then merged in declaration
+// order, so conf.pri doesn't depend on the order the checks ran in.  the
+// debug output of checks on worker threads is collected here as well, and
+// printed along with the result.
+class QcCheckOutput {
+public:
+    QString     DEFINES;
+    QStringList INCLUDEPATH;
+    QStringList LIBS;
+    QString     extra;
+
+    bool    passthrough; // true if what is added also goes into Conf
+    bool    buffered;    // true if the debug output goes to log
+    bool    first_debug;
+    QString log;
+
+    QStringList timeouts;  // the commands that timed out
+    QStringList inputs;    // what the result depends on, for the conf service
+    bool        untracked; // true if it depends on more than inputs
+
+    QcCheckOutput() : passthrough(false), buffered(false), first_debug(true), untracked(false) { }
+};
+
+// the output of the check running on the current thread, if any, and the
+//   job slot of the thread with the commands holding a slot
+class QcThreadState {
+public:
+    QcCheckOutput *      output;
+    bool                 slotFree;
+    QList<ConfCommand *> running;
+
+    QcThreadState() : output(0), slotFree(true) { }
+};
+
+static QThreadStorage<QcThreadState *> qc_thread_states;
+
+static QcThreadState *qc_thread_state()
 {
-    conf = c;
-    conf->added(this);
-    required = false;
-    disabled = false;
-    success  = false;
+    if (!qc_thread_states.hasLocalData())
+        qc_thread_states.setLocalData(new QcThreadState);
+    return qc_thread_states.localData();
 }
 
-ConfObj::~ConfObj() {}
+static QcCheckOutput *qc_check_output() { return qc_thread_state()->output; }
 
-QString ConfObj::checkString() const { return QString("Checking for %1 ...").arg(name()); }
+static void qc_set_check_output(QcCheckOutput *output) { qc_thread_state()->output = output; }
 
-QString ConfObj::resultString() const
+// with configure --service, the files and dirs the result of each check
+//   depends on are noted in its output
+static bool qc_service_enabled()
 {
-    if (success)
-        return "yes";
-    else
-        return "no";
+#ifdef QC_HAVE_NETWORK
+    return qc_getenv("QC_SERVICE") == "Y" && !qc_recording() && !qc_replaying();
+#else
+    return false;
+#endif
 }
 
-//----------------------------------------------------------------------------
-// qc_internal_pkgconfig
-//----------------------------------------------------------------------------
-class qc_internal_pkgconfig : public ConfObj {
-public:
-    QString     pkgname, desc;
-    VersionMode mode;
-    QString     req_ver;
+static void qc_add_input(const QString &path)
+{
+    QcCheckOutput *output = qc_check_output();
+    if (output && !path.isEmpty() && qc_service_enabled() && !output->inputs.contains(path))
+        output->inputs += path;
+}
 
-    qc_internal_pkgconfig(Conf *c, const QString &_name, const QString &_desc, VersionMode _mode,
-                          const QString &_req_ver) :
-        ConfObj(c),
-        pkgname(_name), desc(_desc), mode(_mode), req_ver(_req_ver)
+// the result of the check on this thread depends on something that can't
+//   be given as an input, such as a file that wasn't found in a search
+//   path of the compiler, so the conf service must not keep it
+static void qc_add_untracked_input()
+{
+    QcCheckOutput *output = qc_check_output();
+    if (output)
+        output->untracked = true;
+}
+
+// a program given by name is found through PATH, as QProcess does
+static void qc_add_program_input(const QString &prog)
+{
+    if (!qc_service_enabled() || prog.isEmpty())
+        return;
+    qc_add_input(prog.contains('/') || QDir::isAbsolutePath(prog) ? prog : qc_findprogram(prog));
+}
+
+// remembers a command of the check on this thread that timed out, to be
+//   reported after its result
+static void qc_note_timeout(const QString &command, qint64 ms)
+{
+    QString        str    = QString("[%1] timed out after %2 seconds").arg(command).arg(ms / 1000.0, 0, 'f', 1);
+    QcCheckOutput *output = qc_check_output();
+    if (output)
+        output->timeouts += str;
+    else
+        printf("%s\n", qPrintable(str));
+}
+
+static void qc_print_timeouts(const QcCheckOutput &output)
+{
+    foreach (const QString &str, output.timeouts)
+        printf("  %s\n", qPrintable(str));
+}
+
+// the outputs of the checks that don't depend on the variant, from the
+//   first variant
+static QMap<ConfObj *, QcCheckOutput> qc_shared_outputs;
+
+// adds output to a Conf, or to another QcCheckOutput
+template <typename T> static void qc_merge_check_output(T *to, const QcCheckOutput &output)
+{
+    if (!output.DEFINES.isEmpty()) {
+        if (!to->DEFINES.isEmpty())
+            to->DEFINES += ' ';
+        to->DEFINES += output.DEFINES;
+    }
+    to->INCLUDEPATH += output.INCLUDEPATH;
+    to->LIBS += output.LIBS;
+    to->extra += output.extra;
+}
+
+// what Conf::addDefine and friends add goes to the output of the check on
+//   this thread, and to conf unless that output is merged later
+static void qc_add_to_output(Conf *conf, const QcCheckOutput &added)
+{
+    QcCheckOutput *output = qc_check_output();
+    if (output)
+        qc_merge_check_output(output, added);
+    if (!output || output->passthrough)
+        qc_merge_check_output(conf, added);
+}
+
+//----------------------------------------------------------------------------
+// check durations
+//----------------------------------------------------------------------------
+// how long each check took the last time it ran on this host, in
+// milliseconds by shortname, kept next to the probe cache.  this only
+// decides the order of the checks.
+
+#ifdef QC_SHARED_CACHE
+static QString qc_durations_path()
+{
+    if (qc_getenv("QC_NO_SHARED_CACHE") == "Y")
+        return QString();
+    QString base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    if (base.isEmpty())
+        return QString();
+    return base + "/qconf/durations";
+}
+#endif
+
+static QMap<QString, qint64> qc_load_durations()
+{
+    QMap<QString, qint64> durations;
+#ifdef QC_SHARED_CACHE
+    QString path = qc_durations_path();
+    QFile   f(path);
+    if (path.isEmpty() || !f.open(QFile::ReadOnly))
+        return durations;
+    while (!f.atEnd()) {
+        QString line = QString::fromUtf8(f.readLine()).trimmed();
+        int     at   = line.lastIndexOf(' ');
+        bool    ok;
+        qint64  ms = line.mid(at + 1).toLongLong(&ok);
+        if (at > 0 && ok)
+            durations.insert(line.left(at), ms);
+    }
+#endif
+    return durations;
+}
+
+// adds the durations of this run to the file, keeping those of other
+//   projects that were written in the meantime
+static void qc_save_durations(const QMap<QString, qint64> &ran)
+{
+#ifdef QC_SHARED_CACHE
+    // a replay says nothing about how long the checks take on this host
+    QString path = qc_durations_path();
+    if (ran.isEmpty() || qc_replaying() || path.isEmpty() || !QDir().mkpath(QFileInfo(path).absolutePath()))
+        return;
+    QMap<QString, qint64> durations = qc_load_durations();
+    for (QMap<QString, qint64>::ConstIterator it = ran.begin(); it != ran.end(); ++it)
+        durations.insert(it.key(), it.value());
+
+    QSaveFile f(path);
+    if (!f.open(QFile::WriteOnly))
+        return;
+    for (QMap<QString, qint64>::ConstIterator it = durations.begin(); it != durations.end(); ++it)
+        f.write((it.key() + ' ' + QString::number(it.value()) + '\n').toUtf8());
+    f.commit();
+#else
+    Q_UNUSED(ran);
+#endif
+}
+
+// orders checks by their last duration, treating those that never ran as
+//   the most expensive
+class QcCheckCost {
+public:
+    QcCheckCost(const QMap<QString, qint64> &_durations, bool _ascending) :
+        durations(_durations), ascending(_ascending)
+    {
+    }
+
+    qint64 cost(ConfObj *o) const { return durations.value(o->shortname(), std::numeric_limits<qint64>::max()); }
+
+    bool operator()(ConfObj *a, ConfObj *b) const
+    {
+        return ascending ? cost(a) < cost(b) : cost(a) > cost(b);
+    }
+
+private:
+    const QMap<QString, qint64> &durations;
+    bool                         ascending;
+};
+
+// the order to start the checks in when they run in parallel.  required
+//   checks go first, cheapest first, so that a missing dependency is
+//   reported right away.  the others follow, the most expensive first, so
+//   that they don't end up on the critical path.
+static QList<ConfObj *> qc_schedule_checks(const QList<ConfObj *> &checks, const QMap<QString, qint64> &durations)
+{
+    QList<ConfObj *> required, others;
+    foreach (ConfObj *o, checks) {
+        if (o->required)
+            required += o;
+        else
+            others += o;
+    }
+    std::stable_sort(required.begin(), required.end(), QcCheckCost(durations, true));
+    std::stable_sort(others.begin(), others.end(), QcCheckCost(durations, false));
+    return required + others;
+}
+
+//----------------------------------------------------------------------------
+// ConfObj
+//----------------------------------------------------------------------------
+ConfObj::ConfObj(Conf *c)
+{
+    conf = c;
+    conf->added(this);
+    required = false;
+    disabled = false;
+    success  = false;
+}
+
+ConfObj::~ConfObj() {}
+
+QString ConfObj::checkString() const { return QString("Checking for %1 ...").arg(name()); }
+
+QString ConfObj::resultString() const
+{
+    if (success)
+        return "yes";
+    else
+        return "no";
+}
+
+bool ConfObj::variantSpecific() const { return false; }
+
+//----------------------------------------------------------------------------
+// qc_internal_pkgconfig
+//----------------------------------------------------------------------------
+class qc_internal_pkgconfig : public ConfObj {
+public:
+    QString     pkgname, desc;
+    VersionMode mode;
+    QString     req_ver;
+
+    qc_internal_pkgconfig(Conf *c, const QString &_name, const QString &_desc, VersionMode _mode,
+                          const QString &_req_ver) :
+        ConfObj(c),
+        pkgname(_name), desc(_desc), mode(_mode), req_ver(_req_ver)
     {
     }
 
     QString name() const { return desc; }
     QString shortname() const { return pkgname; }
 
+    // only the libs differ, see findPkgConfig
+    bool variantSpecific() const { return conf->variant == "static"; }
+
     bool exec()
     {
         QStringList incs;
@@ -421,6 +1276,57 @@ public:
     }
 };
 
+//----------------------------------------------------------------------------
+// qc_internal_qtmodule
+//----------------------------------------------------------------------------
+// compares dotted version numbers, as in 5.9 < 5.10
+static int qc_compare_versions(const QString &a, const QString &b)
+{
+    QStringList as = a.split('.'), bs = b.split('.');
+    for (int n = 0; n < qMax(as.count(), bs.count()); ++n) {
+        int x = as.value(n).toInt(), y = bs.value(n).toInt();
+        if (x != y)
+            return x < y ? -1 : 1;
+    }
+    return 0;
+}
+
+class qc_internal_qtmodule : public ConfObj {
+public:
+    QString     module, desc;
+    VersionMode mode;
+    QString     req_ver;
+
+    qc_internal_qtmodule(Conf *c, const QString &_module, const QString &_desc, VersionMode _mode,
+                         const QString &_req_ver) :
+        ConfObj(c),
+        module(_module), desc(_desc), mode(_mode), req_ver(_req_ver)
+    {
+    }
+
+    QString name() const { return desc; }
+    QString shortname() const { return "qt_" + module; }
+
+    bool exec()
+    {
+        QString version;
+        if (!conf->findQtModule(module, &version))
+            return false;
+
+        int cmp = qc_compare_versions(version, req_ver);
+        if ((mode == VersionMin && cmp < 0) || (mode == VersionMax && cmp > 0) || (mode == VersionExact && cmp != 0)) {
+            conf->debug(QString("version %1 doesn't match").arg(version));
+            return false;
+        }
+
+        conf->addExtra("QT += " + module);
+        if (!required)
+            conf->addDefine("HAVE_QT_" + qc_escapeArg(module).toUpper());
+
+        return true;
+    }
+};
+
 //----------------------------------------------------------------------------
 // Conf
 //----------------------------------------------------------------------------
@@ -445,6 +1351,14 @@ QString Conf::getenv(const QString &var) { return qc_getenv(var); }
 void Conf::debug(const QString &s)
 {
     if (debug_enabled) {
+        QcCheckOutput *output = qc_check_output();
+        if (output && output->buffered) {
+            if (output->first_debug)
+                output->log += '\n';
+            output->first_debug = false;
+            output->log += QString(" * %1\n").arg(s);
+            return;
+        }
         if (first_debug)
             printf("\n");
         first_debug = false;
@@ -452,8 +1366,275 @@ void Conf::debug(const QString &s)
     }
 }
 
+// runs one check on a worker thread of qc_exec_parallel
+class QcCheckRunner : public QRunnable {
+public:
+    ConfObj *     o;
+    QcCheckOutput output;
+    bool          ran;
+    bool          ok;
+    qint64        duration;
+
+    QcCheckRunner(ConfObj *_o, QMutex *_mutex, QWaitCondition *_cond, QList<QcCheckRunner *> *_done) :
+        o(_o), ran(false), ok(false), duration(0), mutex(_mutex), cond(_cond), done(_done)
+    {
+        setAutoDelete(false);
+        output.buffered = true;
+    }
+
+    void run()
+    {
+        // the check runs on the implicit token of the process, or on one
+        //   of the job server, and its commands start from there
+        QcJobServer *js       = qc_jobserver();
+        bool         implicit = js->takeImplicit();
+        bool         taken    = false;
+        char         token    = 0;
+        if (!implicit && js->limited())
+            taken = js->take(&token);
+
+        if (!qc_is_cancelled() && (implicit || taken || !js->limited())) {
+            qc_thread_state()->slotFree = true;
+            qc_set_check_output(&output);
+            QElapsedTimer timer;
+            timer.start();
+            ok = o->exec();
+            qc_set_check_output(0);
+            duration = timer.elapsed();
+            qc_report_timing(QString("check.") + o->shortname(), timer);
+            ran = true;
+        }
+
+        if (implicit)
+            js->giveImplicit();
+        if (taken)
+            js->give(token);
+
+        QMutexLocker locker(mutex);
+        done->append(this);
+        cond->wakeAll();
+    }
+
+private:
+    QMutex *                mutex;
+    QWaitCondition *        cond;
+    QList<QcCheckRunner *> *done;
+};
+
+// runs up to jobs checks at the same time, printing each result as it
+//   comes in.  if a required check fails, the commands of the others are
+//   killed and their results are ignored.  the outputs of those that ran
+//   are added to outputs.
+static bool qc_exec_parallel(const QList<ConfObj *> &order, int jobs, QMap<ConfObj *, QcCheckOutput> *outputs,
+                             QMap<QString, qint64> *durations)
+{
+    QMutex                           mutex;
+    QWaitCondition                   cond;
+    QList<QcCheckRunner *>           done;
+    QMap<ConfObj *, QcCheckRunner *> runners;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs);
+    foreach (ConfObj *o, order) {
+        QcCheckRunner *r = new QcCheckRunner(o, &mutex, &cond, &done);
+        runners.insert(o, r);
+        pool.start(r);
+    }
+
+    ConfObj *failed   = 0;
+    bool     deadline = false;
+    for (int finished = 0; finished < order.count();) {
+        mutex.lock();
+        while (done.isEmpty())
+            cond.wait(&mutex);
+        QcCheckRunner *r = done.takeFirst();
+        mutex.unlock();
+        ++finished;
+
+        if (!r->ran || failed)
+            continue;
+        r->o->success = r->ok;
+        durations->insert(r->o->shortname(), r->duration);
+
+        QString check = r->o->checkString();
+        if (!check.isEmpty()) {
+            QString result = r->o->resultString();
+            if (!r->output.first_debug)
+                printf("%s%s -> %s\n", check.toLatin1().data(), r->output.log.toLocal8Bit().data(),
+                       result.toLatin1().data());
+            else
+                printf("%s %s\n", check.toLatin1().data(), result.toLatin1().data());
+        } else {
+            printf("%s", r->output.log.toLocal8Bit().data());
+        }
+        qc_print_timeouts(r->output);
+        fflush(stdout);
+
+        if (qc_deadline_passed()) {
+            failed   = r->o;
+            deadline = true;
+            qc_cancel_commands();
+        } else if (!r->ok && r->o->required) {
+            failed = r->o;
+            qc_cancel_commands();
+        }
+    }
+    pool.waitForDone();
+
+    foreach (QcCheckRunner *r, runners) {
+        if (r->ran)
+            outputs->insert(r->o, r->output);
+    }
+    qDeleteAll(runners);
+
+    if (deadline) {
+        printf("\nError: reached the configure deadline while checking for %s!\n", failed->name().toLatin1().data());
+        return false;
+    }
+    if (failed) {
+        printf("\nError: need %s!\n", failed->name().toLatin1().data());
+        return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// site file
+//----------------------------------------------------------------------------
+// configure --site preseeds the results of checks, by their shortname:
+//
+//   check.<shortname> = yes|no
+//   check.<shortname>.result = <printed instead of yes or no>
+//   check.<shortname>.defines = <like Conf::addDefine>
+//   check.<shortname>.includepath = <like Conf::addIncludePath>
+//   check.<shortname>.libs = <like Conf::addLib>
+//   check.<shortname>.extra = <like Conf::addExtra>
+//
+// all but the first may be given several times.  the file also has the
+//   qmake, qmakespec and make keys, which configure reads itself.
+
+class QcSiteCheck {
+public:
+    bool        answered; // false if only flags were given
+    bool        success;
+    QString     result;
+    QStringList fields; // of the flags, in file order
+    QStringList values;
+
+    QcSiteCheck() : answered(false), success(false) { }
+};
+
+static QMap<QString, QcSiteCheck> qc_load_site()
+{
+    QMap<QString, QcSiteCheck> checks;
+    QFile                      f(qc_getenv("QC_SITE"));
+    if (f.fileName().isEmpty() || !f.open(QFile::ReadOnly))
+        return checks;
+
+    QStringList flags;
+    flags << "defines"
+          << "includepath"
+          << "libs"
+          << "extra";
+    while (!f.atEnd()) {
+        QString line = QString::fromUtf8(f.readLine()).trimmed();
+        int     at   = line.indexOf('=');
+        if (line.startsWith('#') || at < 1)
+            continue;
+        QString key   = line.left(at).trimmed();
+        QString value = line.mid(at + 1).trimmed();
+        if (!key.startsWith("check."))
+            continue;
+        key = key.mid(6);
+
+        // shortnames may have dots of their own, as in gstreamer-1.0
+        QString field;
+        int     dot = key.lastIndexOf('.');
+        if (dot > 0 && (flags.contains(key.mid(dot + 1)) || key.mid(dot + 1) == "result")) {
+            field = key.mid(dot + 1);
+            key   = key.left(dot);
+        }
+
+        QcSiteCheck &c = checks[key];
+        if (field.isEmpty()) {
+            if (value != "yes" && value != "no") {
+                printf("Warning: ignoring check.%s = %s in the site file\n", qPrintable(key), qPrintable(value));
+                continue;
+            }
+            c.answered = true;
+            c.success  = value == "yes";
+        } else if (field == "result") {
+            c.result = value;
+        } else {
+            c.fields += field;
+            c.values += value;
+        }
+    }
+    return checks;
+}
+
+// takes the checks that the site file answers out of checks, printing
+//   their results as if they had run.  a required check that the site
+//   file says is missing still runs, so that it fails for a real reason.
+static QList<ConfObj *> qc_site_lookup(Conf *conf, const QList<ConfObj *> &checks,
+                                       QMap<ConfObj *, QcCheckOutput> *outputs)
+{
+    static bool                       loaded = false;
+    static QMap<QString, QcSiteCheck> site;
+    if (!loaded) {
+        site   = qc_load_site();
+        loaded = true;
+    }
+
+    QList<ConfObj *> rest;
+    foreach (ConfObj *o, checks) {
+        const QcSiteCheck c = site.value(o->shortname());
+        if (!c.answered || (!c.success && o->required)) {
+            rest += o;
+            continue;
+        }
+
+        // the flags go through Conf, as if the check had added them
+        QcCheckOutput &output = (*outputs)[o];
+        output.buffered       = true;
+        qc_set_check_output(&output);
+        conf->debug("preseeded by the site file");
+        for (int n = 0; n < c.fields.count(); ++n) {
+            if (c.fields[n] == "defines")
+                conf->addDefine(c.values[n]);
+            else if (c.fields[n] == "includepath")
+                conf->addIncludePath(c.values[n]);
+            else if (c.fields[n] == "libs")
+                conf->addLib(c.values[n]);
+            else
+                conf->addExtra(c.values[n]);
+        }
+        qc_set_check_output(0);
+        o->success = c.success;
+
+        QString check  = o->checkString();
+        QString result = c.result.isEmpty() ? o->resultString() : c.result;
+        if (check.isEmpty())
+            printf("%s", output.log.toLocal8Bit().data());
+        else if (!output.first_debug)
+            printf("%s%s -> %s\n", check.toLatin1().data(), output.log.toLocal8Bit().data(), result.toLatin1().data());
+        else
+            printf("%s %s\n", check.toLatin1().data(), result.toLatin1().data());
+    }
+    fflush(stdout);
+    return rest;
+}
+
+#ifdef QC_HAVE_NETWORK
+// the conf service, see below
+static QList<ConfObj *> qc_service_lookup(Conf *conf, const QList<ConfObj *> &checks,
+                                          QMap<ConfObj *, QcCheckOutput> *outputs);
+static void qc_service_store(Conf *conf, const QList<ConfObj *> &checks, const QMap<ConfObj *, QcCheckOutput> &outputs);
+#endif
+
 bool Conf::exec()
 {
+    QList<ConfObj *> checks;
     for (int n = 0; n < list.count(); ++n) {
         ConfObj *o = list[n];
 
@@ -470,6 +1651,69 @@ bool Conf::exec()
                 continue;
         }
 
+        checks += o;
+    }
+
+    // with --variants, what doesn't depend on the variant is only checked
+    //   for the first one
+    QMap<ConfObj *, QcCheckOutput> outputs;
+    QList<ConfObj *>               torun;
+    foreach (ConfObj *o, checks) {
+        if (!o->variantSpecific() && qc_shared_outputs.contains(o))
+            outputs.insert(o, qc_shared_outputs.value(o));
+        else
+            torun += o;
+    }
+    // what the site file answers isn't checked at all
+    torun = qc_site_lookup(this, torun, &outputs);
+#ifdef QC_HAVE_NETWORK
+    // and neither is what the conf service still knows
+    if (qc_service_enabled())
+        torun = qc_service_lookup(this, torun, &outputs);
+#endif
+
+    // with no --jobs, the checks run in parallel only under a make
+    //   jobserver, which then decides how many really run at once
+    int jobs = getenv("QC_JOBS").toInt();
+    if (jobs < 1)
+        jobs = qc_jobserver()->fromMake() ? QThread::idealThreadCount() : 1;
+    // durations holds those of this run.  one at a time, the checks run in
+    //   declaration order, and what is already known is added in between.
+    QMap<QString, qint64> durations;
+    bool                  ok;
+    if (jobs > 1)
+        ok = qc_exec_parallel(qc_schedule_checks(torun, qc_load_durations()), jobs, &outputs, &durations);
+    else
+        ok = execSerial(checks, &outputs, &durations);
+    qc_save_durations(durations);
+    if (!ok)
+        return false;
+#ifdef QC_HAVE_NETWORK
+    if (qc_service_enabled())
+        qc_service_store(this, torun, outputs);
+#endif
+
+    foreach (ConfObj *o, torun) {
+        if (!o->variantSpecific())
+            qc_shared_outputs.insert(o, outputs.value(o));
+    }
+    if (jobs > 1) {
+        foreach (ConfObj *o, checks)
+            qc_merge_check_output(this, outputs[o]);
+    }
+    return true;
+}
+
+bool Conf::execSerial(const QList<ConfObj *> &order, QMap<ConfObj *, QcCheckOutput> *outputs,
+                      QMap<QString, qint64> *durations)
+{
+    for (int n = 0; n < order.count(); ++n) {
+        ConfObj *o = order[n];
+        if (outputs->contains(o)) {
+            qc_merge_check_output(this, outputs->value(o));
+            continue;
+        }
+
         bool    output = true;
         QString check  = o->checkString();
         if (check.isEmpty())
@@ -480,9 +1724,16 @@ bool Conf::exec()
             fflush(stdout);
         }
 
-        first_debug = true;
-        bool ok     = o->exec();
-        o->success  = ok;
+        first_debug               = true;
+        (*outputs)[o].passthrough = true;
+        qc_set_check_output(&(*outputs)[o]);
+        QElapsedTimer timer;
+        timer.start();
+        bool ok    = o->exec();
+        o->success = ok;
+        qc_set_check_output(0);
+        durations->insert(o->shortname(), timer.elapsed());
+        qc_report_timing(QString("check.") + o->shortname(), timer);
 
         if (output) {
             QString result = o->resultString();
@@ -491,151 +1742,1768 @@ bool Conf::exec()
             else
                 printf(" %s\n", result.toLatin1().data());
         }
+        qc_print_timeouts((*outputs)[o]);
+
+        if (qc_deadline_passed()) {
+            printf("\nError: reached the configure deadline while checking for %s!\n", o->name().toLatin1().data());
+            return false;
+        }
+        if (!ok && o->required) {
+            printf("\nError: need %s!\n", o->name().toLatin1().data());
+            return false;
+        }
+    }
+    return true;
+}
+
+QString Conf::qvar(const QString &s) { return vars.value(s); }
+
+QString Conf::normalizePath(const QString &s) const { return qc_normalize_path(s); }
+
+QString Conf::escapeQmakeVar(const QString &s) const { return qc_escape_string_var(s); }
+
+QString Conf::escapedIncludes() const { return qc_prepare_includepath(INCLUDEPATH); }
+
+QString Conf::escapedLibs() const { return qc_prepare_libs(LIBS); }
+
+QString Conf::expandIncludes(const QString &inc) { return QLatin1String("-I") + inc; }
+
+QString Conf::expandLibs(const QString &lib) { return QLatin1String("-L") + lib; }
+
+// what lets a command of a check run: the slot of the thread, a token of
+//   the job server, or nothing if there is no limit
+enum QcSlot { QcSlotNone, QcSlotThread, QcSlotToken, QcSlotUnlimited };
+
+class ConfCommand {
+public:
+    QString       command; // for the debug output
+    QString       prog;
+    QStringList   args;
+    QcProcess     process;
+    qint64        pid;     // -1 if it didn't start, or was cancelled
+    bool          pending; // true until it has a slot
+    int           slot;
+    char          token;
+    QElapsedTimer timer;
+    int           timeout;
+    QString       key;      // for record and replay
+    bool          replayed; // true if it is answered from the record
+    QcRecordedRun recorded;
+
+    ConfCommand() : pid(-1), pending(false), slot(QcSlotNone), token(0), timeout(-1), replayed(false) { }
+};
+
+// waits for c to finish, killing it if it runs out of time
+static void qc_wait_finished(ConfCommand *c)
+{
+    if (c->pid == -1)
+        return;
+
+    // the return value doesn't matter, since false could still mean
+    //   success if the process had already finished
+    c->process.waitForFinished(qc_time_left(c->timer, c->timeout));
+    if (c->process.state() != QProcess::NotRunning) {
+        qc_kill_process(&c->process, c->pid);
+        c->process.waitForFinished(-1);
+        qc_note_timeout(c->command, c->timer.elapsed());
+    }
+}
+
+// gets a slot for a command of the check on this thread: the thread's own
+//   if it is free, otherwise a token if there is one.  with wait, if there
+//   is neither, another command of the thread is waited for and its slot
+//   taken over.  its output stays in its QProcess until it is waited for.
+static bool qc_take_slot(int *slot, char *token, bool wait)
+{
+    QcThreadState *state = qc_thread_state();
+    if (!state->output || !qc_jobserver()->limited()) {
+        *slot = QcSlotUnlimited;
+        return true;
+    }
+    if (state->slotFree) {
+        state->slotFree = false;
+        *slot           = QcSlotThread;
+        return true;
+    }
+    if (qc_jobserver()->tryTake(token)) {
+        *slot = QcSlotToken;
+        return true;
+    }
+    if (!wait || state->running.isEmpty())
+        return false;
+
+    ConfCommand *c = state->running.takeFirst();
+    qc_wait_finished(c);
+    *slot   = c->slot;
+    *token  = c->token;
+    c->slot = QcSlotNone;
+    return true;
+}
+
+static void qc_give_slot(int slot, char token)
+{
+    if (slot == QcSlotThread)
+        qc_thread_state()->slotFree = true;
+    else if (slot == QcSlotToken)
+        qc_jobserver()->give(token);
+}
+
+// runs a command for a check, with its output going where the debug
+//   output of the check goes
+static int qc_run_for_check(Conf *conf, const QString &prog, const QStringList &args, const QString &command,
+                            QByteArray *out)
+{
+    int  slot;
+    char token;
+    qc_take_slot(&slot, &token, true);
+
+    QcCheckOutput *output = qc_check_output();
+    QByteArray     buf;
+    int            r;
+    if (!output || !output->buffered) {
+        r = qc_run_program_or_command(prog, args, command, out, conf->debug_enabled);
+    } else {
+        r = qc_run_program_or_command(prog, args, command, &buf, false);
+        if (conf->debug_enabled)
+            output->log += QString::fromLocal8Bit(buf);
+        if (out)
+            *out = buf;
+    }
+
+    qc_give_slot(slot, token);
+    return r;
+}
+
+int Conf::doCommand(const QString &s, QByteArray *out)
+{
+    qc_add_program_input(qc_splitflags(s).value(0));
+    debug(QString("[%1]").arg(s));
+    int r = qc_run_for_check(this, QString(), QStringList(), s, out);
+    debug(QString("returned: %1").arg(r));
+    return r;
+}
+
+int Conf::doCommand(const QString &prog, const QStringList &args, QByteArray *out)
+{
+    qc_add_program_input(prog);
+    debug(QString("[%1]").arg(qc_command_string(prog, args)));
+    int r = qc_run_for_check(this, prog, args, QString(), out);
+    debug(QString("returned: %1").arg(r));
+    return r;
+}
+
+// starts c if it is still pending and can get a slot
+static void qc_start_pending(Conf *conf, ConfCommand *c, bool wait)
+{
+    if (!c->pending)
+        return;
+    if (qc_is_cancelled()) {
+        c->pending = false;
+        conf->debug(QString("[%1] cancelled").arg(c->command));
+        return;
+    }
+    if (!qc_take_slot(&c->slot, &c->token, wait))
+        return;
+    c->pending = false;
+
+    conf->debug(QString("[%1] started").arg(c->command));
+    c->timeout = qc_command_timeout();
+    c->timer.start();
+    c->process.start(c->prog, c->args);
+    if (c->slot == QcSlotThread || c->slot == QcSlotToken)
+        qc_thread_state()->running += c;
+
+    // the process id is needed to be able to cancel it.  starting counts
+    //   against the time of the command, see qc_run_process.
+    if (c->process.waitForStarted(qc_time_left(c->timer, c->timeout))) {
+        c->pid = qc_track_process(&c->process);
+        if (c->pid == -1) {
+            c->process.kill();
+            c->process.waitForFinished(-1);
+        }
+    } else if (c->process.state() == QProcess::Starting) {
+        qc_kill_process(&c->process, qc_process_id(&c->process));
+        c->process.waitForFinished(-1);
+        qc_note_timeout(c->command, c->timer.elapsed());
+    }
+}
+
+ConfCommand *Conf::startCommand(const QString &prog, const QStringList &args, const QString &workdir)
+{
+    qc_add_program_input(prog);
+    ConfCommand *c = new ConfCommand;
+    c->command     = qc_command_string(prog, args);
+    c->prog        = prog;
+    c->args        = args;
+    c->pending     = true;
+    if (!workdir.isEmpty())
+        c->process.setWorkingDirectory(workdir);
+    if (qc_recording() || qc_replaying())
+        c->key = qc_replay_command_key(c->command, workdir);
+    if (qc_replaying()) {
+        // nothing to start or to wait for
+        debug(QString("[%1] replayed").arg(c->command));
+        qc_replay(c->key, &c->recorded);
+        c->replayed = true;
+        c->pending  = false;
+        c->timer.start();
+        return c;
+    }
+    qc_start_pending(this, c, false);
+    if (c->pending)
+        debug(QString("[%1] waiting for a job slot").arg(c->command));
+    return c;
+}
+
+// Conf::waitCommand, also giving the error output in errOut
+static int qc_wait_command(Conf *conf, ConfCommand *c, QByteArray *out, QByteArray *errOut)
+{
+    QByteArray buf, err;
+    int        r = -1;
+    if (c->replayed) {
+        qc_replay_wait(c->recorded, c->timer);
+        buf = c->recorded.out;
+        err = c->recorded.err;
+        r   = c->recorded.ret;
+    } else {
+        qc_start_pending(conf, c, true);
+        qc_wait_finished(c);
+        if (c->pid != -1)
+            qc_untrack_process(c->pid);
+        qc_thread_state()->running.removeAll(c);
+        qc_give_slot(c->slot, c->token);
+
+        buf = c->process.readAllStandardOutput();
+        err = c->process.readAllStandardError();
+        if (c->pid != -1 && c->process.exitStatus() == QProcess::NormalExit)
+            r = c->process.exitCode();
+
+        // what was cancelled says nothing about the command
+        if (qc_recording() && !qc_is_cancelled()) {
+            QcRecordedRun run;
+            run.ret = r;
+            run.ms  = c->timer.elapsed();
+            run.out = buf;
+            run.err = err;
+            qc_record(c->key, run);
+        }
+    }
+
+    if (conf->debug_enabled) {
+        QcCheckOutput *output = qc_check_output();
+        if (output && output->buffered) {
+            output->log += QString::fromLocal8Bit(buf);
+        } else {
+            fprintf(stdout, "%s", buf.data());
+            fprintf(stderr, "%s", err.data());
+        }
+    }
+    if (out)
+        *out = buf;
+    if (errOut)
+        *errOut = err;
+
+    conf->debug(QString("[%1] returned: %2").arg(c->command).arg(r));
+    delete c;
+    return r;
+}
+
+int Conf::waitCommand(ConfCommand *c, QByteArray *out) { return qc_wait_command(this, c, out, 0); }
+
+void Conf::waitCommands(const QList<ConfCommand *> &list, QList<int> *rets, QList<QByteArray> *outs)
+{
+    rets->clear();
+    if (outs)
+        outs->clear();
+    // the order doesn't matter for those that are running already.  as
+    //   each one is done, its slot goes to those still waiting for one.
+    for (int n = 0; n < list.count(); ++n) {
+        QByteArray out;
+        *rets += waitCommand(list[n], &out);
+        if (outs)
+            *outs += out;
+        for (int k = n + 1; k < list.count(); ++k)
+            qc_start_pending(this, list[k], false);
+    }
+}
+
+// the scratch dir configure made for this run
+static QDir qc_scratch_dir()
+{
+    QString path = qc_getenv("QC_TMPDIR");
+    if (path.isEmpty()) {
+#ifdef Q_OS_WIN
+        path = "qconftemp";
+#else
+        path = ".qconftemp";
+#endif
+    }
+    return QDir(path);
+}
+
+// writes atest.cpp and atest.pro into a new dir name in tmp, and returns
+//   the path of the dir, or an empty string on error.  with trackDeps, the
+//   build leaves what qc_probe_deps needs to find the files it used.
+static QString qc_write_atest(Conf *conf, const QDir &tmp, const QString &name, const QString &filedata,
+                              const QStringList &incs, const QString &libs, const QString &proextra,
+                              bool trackDeps = false)
+{
+    QStringList normalizedLibs;
+    foreach (const QString &l, qc_splitflags(libs)) {
+        normalizedLibs.append(qc_normalize_path(l));
+    }
+
+    if (!tmp.mkdir(name)) {
+        conf->debug(QString("unable to create atest dir: %1").arg(tmp.absoluteFilePath(name)));
+        return QString();
+    }
+    QDir dir(tmp.filePath(name));
+    if (!dir.exists()) {
+        conf->debug("atest dir does not exist");
+        return QString();
+    }
+
+    QString fname = dir.filePath("atest.cpp");
+    QFile   f(fname);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+        conf->debug("unable to open atest.cpp for writing");
+        return QString();
+    }
+    if (f.write(filedata.toLatin1()) == -1) {
+        conf->debug("error writing to atest.cpp");
+        return QString();
+    }
+    f.close();
+
+    conf->debug(QString("Wrote atest.cpp:\n%1").arg(filedata));
+
+    QString pro = QString("CONFIG  += console\n"
+                          "CONFIG  -= qt app_bundle\n"
+                          "DESTDIR  = $$PWD\n"
+                          "SOURCES += atest.cpp\n");
+    QString inc = qc_prepare_includepath(incs);
+    if (!inc.isEmpty())
+        pro += "INCLUDEPATH += " + inc + '\n';
+    QString escaped_libs = qc_prepare_libs(normalizedLibs);
+    if (!escaped_libs.isEmpty())
+        pro += "LIBS += " + escaped_libs + '\n';
+    pro += proextra;
+    if (trackDeps) {
+        // atest.d with the headers, and a line for each file the linker
+        //   loads in the output of make
+        pro += "contains(QMAKE_COMPILER, gcc)|contains(QMAKE_COMPILER, clang) {\n"
+               "    QMAKE_CXXFLAGS += -MD\n"
+               "    QMAKE_LFLAGS += -Wl,-t\n"
+               "}\n";
+    }
+
+    fname = dir.filePath("atest.pro");
+    f.setFileName(fname);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+        conf->debug("unable to open atest.pro for writing");
+        return QString();
+    }
+    if (f.write(pro.toLatin1()) == -1) {
+        conf->debug("error writing to atest.pro");
+        return QString();
+    }
+    f.close();
+
+    conf->debug(QString("Wrote atest.pro:\n%1").arg(pro));
+    qc_replay_name_dir(dir.absolutePath(), filedata.toLatin1() + '\0' + pro.toLatin1());
+    return dir.absolutePath();
+}
+
+// runs prog in each of dirs whose ok[n] is set, all at the same time.  if
+//   ret is given, ret[n] gets each exit code, otherwise ok[n] is cleared
+//   for those that fail.  if outs is given, outs[n] gets each output.
+//   empty dirs are skipped.
+static void qc_run_in_dirs(Conf *conf, const QString &prog, const QStringList &args, const QStringList &dirs,
+                           QList<bool> *ok, QList<int> *ret = 0, QList<QByteArray> *outs = 0)
+{
+    QList<ConfCommand *> cmds;
+    QList<int>           which;
+    for (int n = 0; n < dirs.count(); ++n) {
+        if ((*ok)[n] && !dirs[n].isEmpty()) {
+            cmds += conf->startCommand(prog, args, dirs[n]);
+            which += n;
+        }
+    }
+    QList<int>        rets;
+    QList<QByteArray> out;
+    conf->waitCommands(cmds, &rets, outs ? &out : 0);
+    if (outs) {
+        outs->clear();
+        for (int n = 0; n < dirs.count(); ++n)
+            outs->append(QByteArray());
+        for (int n = 0; n < which.count(); ++n)
+            (*outs)[which[n]] = out[n];
+    }
+    for (int n = 0; n < which.count(); ++n) {
+        if (ret)
+            (*ret)[which[n]] = rets[n];
+        else if (rets[n] != 0)
+            (*ok)[which[n]] = false;
+    }
+}
+
+//----------------------------------------------------------------------------
+// shared probe cache
+//----------------------------------------------------------------------------
+// results of doCompileAndLink, shared by every configure run of the user on
+// this host, in $XDG_CACHE_HOME/qconf/probes.  the key of an entry is a hash
+// of everything that goes into the probe: the source, the flags, the qmake,
+// make and compilers used (including their mtimes), the relevant
+// environment, and the mtimes of the include and library dirs involved.
+//
+// that doesn't catch a header or library changing in a subdir
+// (/usr/include/foo) or in a dir of the compiler's own search path
+// (/usr/lib/<triple>).  so the probe is built with -MD and the linker told
+// to name what it loads (-Wl,-t), and the entry also has the time and size
+// of each header and library that was used.  an entry is only used while
+// all of those are the same.  a compiler that can't do this, like cl,
+// gets nothing cached.
+//
+// only probes that built are kept.  a failed one usually means something
+// is missing, and which file would have to appear can't be known.  so
+// failed probes always run again.  entries are written with an atomic
+// rename, the eviction is done under a lock file, and QC_NO_SHARED_CACHE=Y
+// (configure --no-shared-cache) turns the whole thing off.
+//
+// a build farm can also share the results between hosts with the same
+// toolchain through an http server, given by QC_REMOTE_CACHE (configure
+// --remote-cache=URL).  it is only used for what isn't in the local cache,
+// and has keys of its own without anything local to the host, see
+// QcProbeKey.  what is installed can't be part of those keys, so they are
+// in a namespace given by QC_REMOTE_CACHE_ID (configure
+// --remote-cache-id=ID), which is required: the hosts using the same one
+// promise to have the same headers and libraries.  on top of that, a
+// remote entry is only used if the files it depended on exist here.
+
+#define QC_CACHE_MAX_ENTRIES 4096
+#define QC_CACHE_MAX_AGE (7 * 24 * 60 * 60)
+
+#ifdef QC_SHARED_CACHE
+// checks running at the same time share the backends and the toolchain id.
+// the lock is only held to get at those, never while a backend is used, so
+// the backends must be safe to use from several checks at once.
+static QMutex qc_cache_mutex;
+
+static QString qc_cache_dir()
+{
+    QString base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    if (base.isEmpty())
+        return QString();
+    QString path = base + "/qconf/probes";
+    if (!QDir().mkpath(path))
+        return QString();
+    return path;
+}
+
+// the time and size of path, or "-" if it doesn't exist
+static QString qc_file_stamp(const QString &path)
+{
+    QFileInfo fi(path);
+    if (!fi.exists())
+        return "-";
+    return QString::number(fi.lastModified().toMSecsSinceEpoch()) + ' ' + QString::number(fi.size());
+}
+
+static void qc_add_file_id(QStringList *parts, const QString &path)
+{
+    QFileInfo fi(path);
+    if (fi.exists())
+        parts->append(path + ' ' + QString::number(fi.lastModified().toMSecsSinceEpoch()) + ' '
+                      + QString::number(fi.size()));
+}
+
+// the part of the local key that is the same for every probe of this run
+static QStringList qc_toolchain_id(Conf *conf)
+{
+    static QStringList id;
+    if (!id.isEmpty())
+        return id;
+
+    id += "qconf-probe-3";
+    id += conf->qmakespec;
+    qc_add_file_id(&id, conf->qmake_path);
+    qc_add_file_id(&id, qc_findprogram(conf->maketool));
+    const char *compilers[] = { "c++", "g++", "clang++", "cc", "gcc", "clang", 0 };
+    for (int n = 0; compilers[n]; ++n)
+        qc_add_file_id(&id, qc_findprogram(compilers[n]));
+    const char *env[] = { "PATH", "CC", "CXX", "CFLAGS", "CXXFLAGS", "CPPFLAGS", "LDFLAGS", "CPATH", "LIBRARY_PATH",
+                          "QMAKESPEC", "QMAKEPATH", "QMAKEFEATURES", 0 };
+    for (int n = 0; env[n]; ++n)
+        id += QString(env[n]) + '=' + qc_getenv(env[n]);
+    const char *dirs[]
+        = { "/usr/include", "/usr/local/include", "/lib", "/lib64", "/usr/lib", "/usr/lib64", "/usr/local/lib", 0 };
+    for (int n = 0; dirs[n]; ++n)
+        qc_add_file_id(&id, dirs[n]);
+    return id;
+}
+
+// QcCacheBackend
+//
+// Somewhere to keep shared probe results.  A backend only stores values by
+// key; each value starts with a hash of itself, which is checked by
+// qc_cache_get, so a backend needs no integrity checks of its own.  get
+// and put are called from several checks at once.
+class QcCacheBackend {
+public:
+    virtual ~QcCacheBackend() { }
+    virtual QString name() const                                     = 0;
+    virtual bool    remote() const { return false; } // uses QcProbeKey::remote
+    virtual bool    get(const QString &key, QByteArray *value)       = 0;
+    virtual void    put(const QString &key, const QByteArray &value) = 0;
+};
+
+// the per-user cache directory
+class QcDirCache : public QcCacheBackend {
+public:
+    QcDirCache(const QString &_dir) : dir(_dir), checked(0) { }
+
+    QString name() const { return dir; }
+
+    bool get(const QString &key, QByteArray *value)
+    {
+        QFile     f(dir + '/' + key);
+        QFileInfo fi(f);
+        if (!fi.exists() || fi.lastModified().secsTo(QDateTime::currentDateTime()) > QC_CACHE_MAX_AGE)
+            return false;
+        if (!f.open(QFile::ReadOnly))
+            return false;
+        *value = f.readAll();
+        return true;
+    }
+
+    void put(const QString &key, const QByteArray &value)
+    {
+        // other configures may read the entry at any time, so it must
+        //   appear at once
+        QSaveFile f(dir + '/' + key);
+        if (!f.open(QFile::WriteOnly))
+            return;
+        f.write(value);
+        f.commit();
+
+        // counting the entries once per run is enough
+        if (checked.testAndSetRelaxed(0, 1)) {
+            if (QDir(dir).entryList(QDir::Files).count() > QC_CACHE_MAX_ENTRIES)
+                evict();
+        }
+    }
+
+private:
+    QString    dir;
+    QAtomicInt checked;
+
+    // keeps the newest 3/4 of the entries
+    void evict()
+    {
+        QLockFile lock(dir + "/.lock");
+        if (!lock.tryLock(1000))
+            return;
+        QDir          d(dir);
+        QFileInfoList list = d.entryInfoList(QDir::Files, QDir::Time);
+        for (int n = QC_CACHE_MAX_ENTRIES * 3 / 4; n < list.count(); ++n)
+            d.remove(list[n].fileName());
+    }
+};
+
+#ifdef QC_HAVE_NETWORK
+#define QC_REMOTE_CACHE_TIMEOUT 5000
+
+// a plain HTTP server: GET and PUT of <url>/<key>.  the first error or
+//   timeout turns it off for the rest of the run, so a server that is down
+//   costs at most one timeout.
+class QcHttpCache : public QcCacheBackend {
+public:
+    QcHttpCache(Conf *_conf, const QString &_url) : conf(_conf), url(_url), broken(0)
+    {
+        if (!url.endsWith('/'))
+            url += '/';
+    }
+
+    QString name() const { return url; }
+    bool    remote() const { return true; }
+
+    bool get(const QString &key, QByteArray *value)
+    {
+        if (broken.loadAcquire())
+            return false;
+        QNetworkAccessManager nam;
+        QNetworkReply *       reply = nam.get(QNetworkRequest(QUrl(url + key)));
+        bool                  ok    = wait(reply);
+        if (ok)
+            *value = reply->readAll();
+        delete reply;
+        return ok;
+    }
+
+    void put(const QString &key, const QByteArray &value)
+    {
+        if (broken.loadAcquire())
+            return;
+        QNetworkAccessManager nam;
+        QNetworkRequest       req(QUrl(url + key));
+        req.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+        QNetworkReply *reply = nam.put(req, value);
+        wait(reply);
+        delete reply;
+    }
+
+private:
+    Conf *     conf;
+    QString    url;
+    QAtomicInt broken;
+
+    // true if the request succeeded.  a missing entry is not an error.
+    //   each call has a QNetworkAccessManager and an event loop of its own,
+    //   so checks in different threads can wait at the same time.
+    bool wait(QNetworkReply *reply)
+    {
+        QEventLoop loop;
+        QObject::connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
+        QTimer::singleShot(QC_REMOTE_CACHE_TIMEOUT, &loop, SLOT(quit()));
+        if (!reply->isFinished())
+            loop.exec();
+        if (!reply->isFinished()) {
+            reply->abort();
+            broken.storeRelease(1);
+            conf->debug(QString("remote probe cache %1 timed out, not using it anymore").arg(url));
+            return false;
+        }
+        if (reply->error() == QNetworkReply::ContentNotFoundError)
+            return false;
+        if (reply->error() != QNetworkReply::NoError) {
+            broken.storeRelease(1);
+            conf->debug(QString("remote probe cache %1: %2, not using it anymore").arg(url, reply->errorString()));
+            return false;
+        }
+        return true;
+    }
+};
+#endif
+
+// the backends to use, fastest first.  they are set up by the first call,
+//   and never change or go away after that.
+static QList<QcCacheBackend *> qc_cache_backends(Conf *conf)
+{
+    QMutexLocker                   locker(&qc_cache_mutex);
+    static bool                    done = false;
+    static QList<QcCacheBackend *> list;
+    if (done)
+        return list;
+    done = true;
+
+    if (qc_getenv("QC_NO_SHARED_CACHE") == "Y" || qc_recording() || qc_replaying())
+        return list;
+    QString dir = qc_cache_dir();
+    if (!dir.isEmpty())
+        list += new QcDirCache(dir);
+    QString url = qc_getenv("QC_REMOTE_CACHE");
+    if (!url.isEmpty()) {
+#ifdef QC_HAVE_NETWORK
+        if (qc_getenv("QC_REMOTE_CACHE_ID").isEmpty())
+            conf->debug("QC_REMOTE_CACHE_ID isn't set, ignoring the remote probe cache");
+        else
+            list += new QcHttpCache(conf, url);
+#else
+        conf->debug("conf was built without QtNetwork, ignoring the remote probe cache");
+#endif
+    }
+    return list;
+}
+
+static QString qc_compiler(Conf *conf);
+static QMap<QString, QString> qc_query_qt(Conf *conf);
+
+// a probe has a key for each kind of backend.  the local one has the paths
+//   and mtimes of the toolchain and of the dirs involved.  those differ
+//   between the hosts that share a remote cache, so the remote one only
+//   has what stays the same for the same toolchain anywhere.
+struct QcProbeKey {
+    QString local, remote;
+};
+
+static QString qc_hash_key(const QStringList &parts)
+{
+    QByteArray data = parts.join(QString(QChar(0))).toUtf8();
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+}
+
+static QMutex      qc_remote_id_mutex;
+static QStringList qc_remote_id;
+
+// the part of the remote key that is the same for every probe of this run:
+//   the namespace, what the compiler and qmake say about themselves, and
+//   the environment that changes what they do.  found once, and only if
+//   there is a remote backend.
+static QStringList qc_remote_toolchain_id(Conf *conf)
+{
+    QMutexLocker locker(&qc_remote_id_mutex);
+    if (!qc_remote_id.isEmpty())
+        return qc_remote_id;
+
+    QStringList id;
+    id += "qconf-probe-3";
+    id += qc_getenv("QC_REMOTE_CACHE_ID");
+    id += conf->qmakespec;
+    QMap<QString, QString> props = qc_query_qt(conf);
+    id += props.value("QT_VERSION");
+    id += props.value("QMAKE_XSPEC");
+
+    QStringList compiler = qc_splitflags(qc_compiler(conf));
+    if (!compiler.isEmpty()) {
+        QList<ConfCommand *> cmds;
+        cmds += conf->startCommand(compiler[0], compiler.mid(1) << "--version");
+        cmds += conf->startCommand(compiler[0], compiler.mid(1) << "-dumpmachine");
+        QList<int>        rets;
+        QList<QByteArray> outs;
+        conf->waitCommands(cmds, &rets, &outs);
+        for (int n = 0; n < rets.count(); ++n)
+            id += QString::number(rets[n]) + ' ' + QString::fromLocal8Bit(outs[n].trimmed());
+    }
+
+    // not PATH: the compiler and qmake have been asked instead
+    const char *env[] = { "CC",    "CXX",          "CFLAGS",    "CXXFLAGS",  "CPPFLAGS",      "LDFLAGS",
+                          "CPATH", "LIBRARY_PATH", "QMAKESPEC", "QMAKEPATH", "QMAKEFEATURES", 0 };
+    for (int n = 0; env[n]; ++n)
+        id += QString(env[n]) + '=' + qc_getenv(env[n]);
+    qc_remote_id = id;
+    return id;
+}
+
+static QcProbeKey qc_probe_key(Conf *conf, const QString &filedata, const QStringList &incs, const QString &libs,
+                               const QString &proextra)
+{
+    QStringList probe;
+    probe += filedata;
+    probe += incs.join(QLatin1String("\n"));
+    probe += libs;
+    probe += proextra;
+
+    bool remote = false;
+    foreach (QcCacheBackend *backend, qc_cache_backends(conf))
+        remote = remote || backend->remote();
+
+    QcProbeKey key;
+    qc_cache_mutex.lock();
+    QStringList parts = qc_toolchain_id(conf);
+    qc_cache_mutex.unlock();
+    parts += probe;
+    foreach (const QString &inc, incs)
+        qc_add_file_id(&parts, inc);
+    foreach (const QString &flag, qc_splitflags(libs)) {
+        if (flag.startsWith(QLatin1String("-L")))
+            qc_add_file_id(&parts, qc_normalize_path(flag.mid(2)));
+    }
+    key.local = qc_hash_key(parts);
+    if (remote)
+        key.remote = qc_hash_key(qc_remote_toolchain_id(conf) + probe);
+    return key;
+}
+
+// the files a probe built in dir with trackDeps used: the headers listed in
+//   the atest.d that -MD wrote, and the libraries and objects the linker
+//   named in the output of make.  files of the probe itself are left out.
+//   false if there is no atest.d, as with a compiler that doesn't know -MD.
+static bool qc_probe_deps(const QString &dir, const QByteArray &makeOutput, QStringList *deps)
+{
+    deps->clear();
+    QFile f(QDir(dir).filePath("atest.d"));
+    if (!f.open(QFile::ReadOnly))
+        return false;
+    QString rule = QString::fromLocal8Bit(f.readAll());
+    rule.replace("\\\r\n", " ").replace("\\\n", " ");
+    int at = rule.indexOf(": ");
+    if (at == -1)
+        return false;
+    QStringList paths = qc_splitflags(rule.mid(at + 2));
+
+    // the linker has a path on each line, maybe with an archive member as
+    //   in /usr/lib/libfoo.a(foo.o), or (/usr/lib/libfoo.a)foo.o.  the
+    //   commands make echoed have paths as well, which are either dirs or
+    //   given to the linker anyway.
+    static const QRegularExpression path("(?:[A-Za-z]:)?/[^\\s()]+");
+    QRegularExpressionMatchIterator it = path.globalMatch(QString::fromLocal8Bit(makeOutput));
+    while (it.hasNext())
+        paths += it.next().captured();
+
+    QString       own = QDir(dir).absolutePath() + '/';
+    QSet<QString> seen;
+    foreach (const QString &p, paths) {
+        QString file = QDir::cleanPath(QDir(dir).absoluteFilePath(p));
+        if (file.startsWith(own) || seen.contains(file) || !QFileInfo(file).isFile())
+            continue;
+        seen += file;
+        deps->append(file);
+    }
+    return true;
+}
+
+// a cached value is the hex sha256 of the payload, a newline, and the
+//   payload
+static QByteArray qc_cache_wrap(const QByteArray &payload)
+{
+    return QCryptographicHash::hash(payload, QCryptographicHash::Sha256).toHex() + '\n' + payload;
+}
+
+static bool qc_cache_unwrap(const QByteArray &value, QByteArray *payload)
+{
+    int n = value.indexOf('\n');
+    if (n == -1)
+        return false;
+    *payload = value.mid(n + 1);
+    return QCryptographicHash::hash(*payload, QCryptographicHash::Sha256).toHex() == value.left(n);
+}
+
+// the payload of the first backend that has a good entry for key, for
+//   which accept returns true.  remote says where it came from.  an entry
+//   from a later backend is put into the ones before it, after localize,
+//   if given, has turned it into what this host would have stored.
+static bool qc_cache_get(Conf *conf, const QcProbeKey &key, bool (*accept)(const QByteArray &, bool remote),
+                         QByteArray (*localize)(const QByteArray &), QByteArray *payload)
+{
+    QList<QcCacheBackend *> backends = qc_cache_backends(conf);
+    for (int n = 0; n < backends.count(); ++n) {
+        const QString &k = backends[n]->remote() ? key.remote : key.local;
+        QByteArray     value;
+        if (!backends[n]->get(k, &value))
+            continue;
+        if (!qc_cache_unwrap(value, payload)) {
+            conf->debug(QString("corrupt probe cache entry %1 in %2").arg(k, backends[n]->name()));
+            continue;
+        }
+        if (!accept(*payload, backends[n]->remote()))
+            continue;
+        conf->debug(QString("probe cache hit: %1 in %2").arg(k, backends[n]->name()));
+
+        // keep it closer for the next time
+        if (n > 0 && localize)
+            value = qc_cache_wrap(localize(*payload));
+        for (int i = 0; i < n; ++i)
+            backends[i]->put(backends[i]->remote() ? key.remote : key.local, value);
+        return true;
+    }
+    return false;
+}
+
+static void qc_cache_put(Conf *conf, const QcProbeKey &key, const QByteArray &payload)
+{
+    QByteArray value = qc_cache_wrap(payload);
+    foreach (QcCacheBackend *backend, qc_cache_backends(conf))
+        backend->put(backend->remote() ? key.remote : key.local, value);
+}
+
+// for a probe, the payload is "ok", followed by the exit code of the
+//   program if it was run, and a line for each file the probe used, with
+//   its path and stamp separated by a tab
+static QByteArray qc_probe_payload(bool haveRetcode, int retcode, const QStringList &deps)
+{
+    QByteArray payload = "ok";
+    if (haveRetcode)
+        payload += ' ' + QByteArray::number(retcode);
+    payload += '\n';
+    foreach (const QString &dep, deps)
+        payload += (dep + '\t' + qc_file_stamp(dep)).toUtf8() + '\n';
+    return payload;
+}
+
+static bool qc_probe_parse(const QByteArray &payload, QList<QByteArray> *head, QStringList *deps,
+                           QStringList *stamps)
+{
+    QList<QByteArray> lines = payload.split('\n');
+    *head                   = lines[0].split(' ');
+    if ((*head)[0] != "ok" || head->count() > 2 || lines.count() < 2 || !lines.last().isEmpty())
+        return false;
+    for (int n = 1; n < lines.count() - 1; ++n) {
+        int tab = lines[n].indexOf('\t');
+        if (tab == -1)
+            return false;
+        deps->append(QString::fromUtf8(lines[n].left(tab)));
+        stamps->append(QString::fromUtf8(lines[n].mid(tab + 1)));
+    }
+    return true;
+}
+
+// whether the files the probe used are still the same.  the stamps of
+//   another host mean nothing here, so for a remote entry they only have
+//   to exist.
+static bool qc_probe_current(const QStringList &deps, const QStringList &stamps, bool remote)
+{
+    for (int n = 0; n < deps.count(); ++n) {
+        if (remote ? !QFileInfo(deps[n]).isFile() : qc_file_stamp(deps[n]) != stamps[n])
+            return false;
+    }
+    return true;
+}
+
+static bool qc_cache_is_probe(const QByteArray &payload, bool remote)
+{
+    QList<QByteArray> head;
+    QStringList       deps, stamps;
+    return qc_probe_parse(payload, &head, &deps, &stamps) && qc_probe_current(deps, stamps, remote);
+}
+
+// a probe that ran its program
+static bool qc_cache_is_run_probe(const QByteArray &payload, bool remote)
+{
+    return qc_cache_is_probe(payload, remote) && payload.left(payload.indexOf('\n')).split(' ').count() == 2;
+}
+
+// a remote entry with the stamps of this host
+static QByteArray qc_probe_localize(const QByteArray &payload)
+{
+    QList<QByteArray> head;
+    QStringList       deps, stamps;
+    qc_probe_parse(payload, &head, &deps, &stamps);
+    return qc_probe_payload(head.count() == 2, head.value(1).toInt(), deps);
+}
+
+// true if the probe is known to build.  deps gets the files it used.
+static bool qc_cache_lookup(Conf *conf, const QcProbeKey &key, bool wantRetcode, int *retcode, QStringList *deps)
+{
+    QByteArray payload;
+    if (!qc_cache_get(conf, key, wantRetcode ? qc_cache_is_run_probe : qc_cache_is_probe, qc_probe_localize,
+                      &payload))
+        return false;
+    QList<QByteArray> head;
+    QStringList       stamps;
+    qc_probe_parse(payload, &head, deps, &stamps);
+    if (wantRetcode)
+        *retcode = head[1].toInt();
+    return true;
+}
+
+// only for probes that built, with the files they used, see above
+static void qc_cache_store(Conf *conf, const QcProbeKey &key, bool haveRetcode, int retcode,
+                           const QStringList &deps)
+{
+    qc_cache_put(conf, key, qc_probe_payload(haveRetcode, retcode, deps));
+}
+#endif
+
+//----------------------------------------------------------------------------
+// conf service
+//----------------------------------------------------------------------------
+// with configure --service, the results of the checks are also handed to a
+// conf process that stays around (conf --serve), so that the next configure
+// asking the same questions gets the answers without running anything.
+// each result comes with the files and dirs it depended on: the programs
+// that were run, the .pc file and the dirs pkg-config searches, the headers
+// and libraries the compile probes used (see qc_probe_deps), every place in
+// the search path a header checked for could be, and qmake.  the service
+// watches them and forgets the results depending on those that change.  as
+// a watcher can miss a change, a result is also checked against the times
+// and sizes of its inputs before it is handed out.
+//
+// what a failed compile probe depends on can't be told, as any file that
+// would make it build could appear anywhere in the search paths of the
+// compiler.  so a result that depends on one isn't kept, and neither is one
+// from a compiler that can't list what a probe used.
+//
+// results are keyed by the project, the toolchain and the configure options,
+// so a run with others doesn't get them.  the service exits after an hour
+// without requests.
+
+#ifdef QC_HAVE_NETWORK
+#define QC_SERVICE_TIMEOUT 2000
+#define QC_SERVICE_IDLE_TIMEOUT (60 * 60 * 1000)
+
+// a check result as the service keeps it
+class QcServiceEntry {
+public:
+    bool                   success;
+    QString                result; // what is printed after the check string
+    QcCheckOutput          output;
+    QMap<QString, QString> inputs; // the stamp of each, see qc_file_stamp
+
+    QcServiceEntry() : success(false) { }
+};
+
+static QDataStream &operator<<(QDataStream &out, const QcServiceEntry &e)
+{
+    out << e.success << e.result << e.output.DEFINES << e.output.INCLUDEPATH << e.output.LIBS << e.output.extra
+        << e.inputs;
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, QcServiceEntry &e)
+{
+    in >> e.success >> e.result >> e.output.DEFINES >> e.output.INCLUDEPATH >> e.output.LIBS >> e.output.extra
+        >> e.inputs;
+    return in;
+}
+
+// there is one service for each user.  the services of different versions
+//   of conf can't talk to each other.  QC_SERVICE_NAME is for the tests.
+static QString qc_service_name()
+{
+    QString name = qc_getenv("QC_SERVICE_NAME");
+    if (!name.isEmpty())
+        return name;
+#ifdef Q_OS_UNIX
+    return QString("qconf-service-1-%1").arg(getuid());
+#else
+    return QString("qconf-service-1-%1").arg(qc_getenv("USERNAME"));
+#endif
+}
+
+// a message is a QByteArray in a QDataStream, that is its size as a
+//   big-endian quint32, followed by its bytes
+static bool qc_service_send(QLocalSocket *sock, const QByteArray &msg)
+{
+    QDataStream out(sock);
+    out << msg;
+    while (sock->bytesToWrite() > 0) {
+        if (!sock->waitForBytesWritten(QC_SERVICE_TIMEOUT))
+            return false;
+    }
+    return true;
+}
+
+static bool qc_service_receive(QLocalSocket *sock, QByteArray *msg)
+{
+    while (sock->bytesAvailable() < 4) {
+        if (!sock->waitForReadyRead(QC_SERVICE_TIMEOUT))
+            return false;
+    }
+    QByteArray head = sock->peek(4);
+    quint32    size = ((quint32)(uchar)head[0] << 24) | ((quint32)(uchar)head[1] << 16)
+        | ((quint32)(uchar)head[2] << 8) | (quint32)(uchar)head[3];
+    if (size > 64 * 1024 * 1024)
+        return false;
+    while (sock->bytesAvailable() < 4 + (qint64)size) {
+        if (!sock->waitForReadyRead(QC_SERVICE_TIMEOUT))
+            return false;
+    }
+    sock->read(4);
+    *msg = sock->read(size);
+    return true;
+}
+
+// with start, a service that isn't running is started, and given a moment
+//   to start listening
+static bool qc_service_connect(QLocalSocket *sock, bool start)
+{
+    QString name = qc_service_name();
+    sock->connectToServer(name);
+    if (sock->waitForConnected(QC_SERVICE_TIMEOUT))
+        return true;
+    if (!start
+        || !QProcess::startDetached(QCoreApplication::applicationFilePath(), QStringList() << "--serve" << name,
+                                    QDir::rootPath()))
+        return false;
+    for (int n = 0; n < 40; ++n) {
+        QThread::msleep(50);
+        sock->connectToServer(name);
+        if (sock->waitForConnected(QC_SERVICE_TIMEOUT))
+            return true;
+    }
+    return false;
+}
+
+// what the results of this run depend on besides the inputs of each check:
+//   the project, the toolchain and the options.  the caller makes sure no
+//   check is running, for qc_toolchain_id.
+static QString qc_service_key(Conf *conf)
+{
+    // options that don't change any result
+    const char *ignored[] = { "QC_TMPDIR",   "QC_DEADLINE", "QC_DEADLINE_AT",     "QC_JOBS",
+                              "QC_TIMEOUT",  "QC_VERBOSE",  "QC_TIMINGS",         "QC_TIMINGS_FILE",
+                              "QC_SERVICE",  "QC_VARIANTS", "QC_NO_SHARED_CACHE", "QC_REMOTE_CACHE",
+                              "QC_REMOTE_CACHE_ID", "QC_SERVICE_NAME", 0 };
+
+    QStringList parts = qc_toolchain_id(conf);
+    parts += QDir::currentPath();
+    parts += conf->variant;
+    const char *env[] = { "PREFIX", "BINDIR", "INCDIR", "LIBDIR", "DATADIR", "PKG_CONFIG_PATH", "PKG_CONFIG_LIBDIR",
+                          "PKG_CONFIG_SYSROOT_DIR", 0 };
+    for (int n = 0; env[n]; ++n)
+        parts += QString(env[n]) + '=' + qc_getenv(env[n]);
+    QStringList vars = QProcess::systemEnvironment();
+    vars.sort();
+    foreach (const QString &var, vars) {
+        if (!var.startsWith("QC_"))
+            continue;
+        QString name = var.section('=', 0, 0);
+        bool    skip = false;
+        for (int n = 0; ignored[n] && !skip; ++n)
+            skip = name == ignored[n];
+        if (!skip)
+            parts += var;
+    }
+    QByteArray data = parts.join(QString(QChar(0))).toUtf8();
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+}
+
+static QString qc_service_id(const QString &key, ConfObj *o) { return key + '\n' + o->name() + '\n' + o->shortname(); }
+
+// puts the results the service has for checks into outputs, printing them
+//   as if they had just been checked, and returns the checks it has none
+//   for.  a required check is never taken to have failed.
+static QList<ConfObj *> qc_service_lookup(Conf *conf, const QList<ConfObj *> &checks,
+                                          QMap<ConfObj *, QcCheckOutput> *outputs)
+{
+    QLocalSocket sock;
+    if (checks.isEmpty() || !qc_service_connect(&sock, false))
+        return checks;
+
+    QString     key = qc_service_key(conf);
+    QStringList ids;
+    foreach (ConfObj *o, checks)
+        ids += qc_service_id(key, o);
+
+    QByteArray  req;
+    QDataStream out(&req, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint8('g') << ids;
+
+    QMap<QString, QcServiceEntry> known;
+    QByteArray                    reply;
+    if (qc_service_send(&sock, req) && qc_service_receive(&sock, &reply)) {
+        QDataStream in(reply);
+        in.setVersion(QDataStream::Qt_5_0);
+        in >> known;
+    }
+    conf->debug(QString("the conf service knows %1 of %2 checks").arg(known.count()).arg(checks.count()));
+
+    QList<ConfObj *> rest;
+    for (int n = 0; n < checks.count(); ++n) {
+        ConfObj *o = checks[n];
+        if (!known.contains(ids[n]) || (!known[ids[n]].success && o->required)) {
+            rest += o;
+            continue;
+        }
+
+        const QcServiceEntry &e = known[ids[n]];
+        outputs->insert(o, e.output);
+        o->success = e.success;
+
+        QString check = o->checkString();
+        if (!check.isEmpty())
+            printf("%s %s\n", check.toLatin1().data(), e.result.toLatin1().data());
+    }
+    fflush(stdout);
+    return rest;
+}
+
+// hands the results of checks that just ran to the service, starting it if
+//   needed.  a check that had a command time out is left out, as its result
+//   may well be different the next time, and so is one whose inputs aren't
+//   all known.
+static void qc_service_store(Conf *conf, const QList<ConfObj *> &checks, const QMap<ConfObj *, QcCheckOutput> &outputs)
+{
+    QString                       key = qc_service_key(conf);
+    QMap<QString, QcServiceEntry> entries;
+    foreach (ConfObj *o, checks) {
+        QcServiceEntry e;
+        e.output = outputs.value(o);
+        if (!e.output.timeouts.isEmpty() || e.output.untracked || (!o->success && o->required))
+            continue;
+        e.success = o->success;
+        e.result  = o->resultString();
+        foreach (const QString &path, e.output.inputs + QStringList(conf->qmake_path))
+            e.inputs.insert(path, qc_file_stamp(path));
+        entries.insert(qc_service_id(key, o), e);
+    }
+    if (entries.isEmpty())
+        return;
+
+    QLocalSocket sock;
+    if (!qc_service_connect(&sock, true)) {
+        conf->debug("couldn't start the conf service");
+        return;
+    }
+    QByteArray  req;
+    QDataStream out(&req, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint8('p') << entries;
+    qc_service_send(&sock, req);
+}
+
+// the service itself.  requests are small and come from conf, so each one
+//   is read and answered right away.
+class QcService : public QObject {
+public:
+    QcService()
+    {
+        idle.setSingleShot(true);
+        connect(&server, &QLocalServer::newConnection, this, &QcService::serve);
+        connect(&watcher, &QFileSystemWatcher::fileChanged, this, &QcService::changed);
+        connect(&watcher, &QFileSystemWatcher::directoryChanged, this, &QcService::changed);
+        connect(&idle, &QTimer::timeout, &QCoreApplication::quit);
+    }
+
+    bool listen(const QString &name)
+    {
+        server.setSocketOptions(QLocalServer::UserAccessOption);
+        if (!server.listen(name)) {
+            // a service that is gone may have left its socket behind
+            QLocalSocket sock;
+            sock.connectToServer(name);
+            if (sock.waitForConnected(QC_SERVICE_TIMEOUT))
+                return false;
+            QLocalServer::removeServer(name);
+            if (!server.listen(name))
+                return false;
+        }
+        idle.start(QC_SERVICE_IDLE_TIMEOUT);
+        return true;
+    }
+
+private:
+    QLocalServer                  server;
+    QFileSystemWatcher            watcher;
+    QTimer                        idle;
+    QMap<QString, QcServiceEntry> entries;    // by id
+    QMap<QString, QSet<QString> > dependents; // the ids of the entries by input
+
+    void serve()
+    {
+        QLocalSocket *sock;
+        while ((sock = server.nextPendingConnection())) {
+            QByteArray req;
+            if (qc_service_receive(sock, &req))
+                handle(sock, req);
+            sock->disconnectFromServer();
+            sock->deleteLater();
+        }
+        idle.start(QC_SERVICE_IDLE_TIMEOUT);
+    }
+
+    void handle(QLocalSocket *sock, const QByteArray &req)
+    {
+        QDataStream in(req);
+        in.setVersion(QDataStream::Qt_5_0);
+        quint8 op;
+        in >> op;
+        if (op == 'g') {
+            QStringList ids;
+            in >> ids;
+            QMap<QString, QcServiceEntry> known;
+            foreach (const QString &id, ids) {
+                QMap<QString, QcServiceEntry>::ConstIterator it = entries.find(id);
+                if (it == entries.end())
+                    continue;
+                if (current(it.value()))
+                    known.insert(id, it.value());
+                else
+                    drop(id);
+            }
+            QByteArray  reply;
+            QDataStream out(&reply, QIODevice::WriteOnly);
+            out.setVersion(QDataStream::Qt_5_0);
+            out << known;
+            qc_service_send(sock, reply);
+        } else if (op == 'p') {
+            QMap<QString, QcServiceEntry> added;
+            in >> added;
+            for (QMap<QString, QcServiceEntry>::ConstIterator it = added.begin(); it != added.end(); ++it)
+                add(it.key(), it.value());
+        }
+    }
+
+    static bool current(const QcServiceEntry &e)
+    {
+        for (QMap<QString, QString>::ConstIterator it = e.inputs.begin(); it != e.inputs.end(); ++it) {
+            if (qc_file_stamp(it.key()) != it.value())
+                return false;
+        }
+        return true;
+    }
+
+    void add(const QString &id, const QcServiceEntry &e)
+    {
+        drop(id);
+        entries.insert(id, e);
+        for (QMap<QString, QString>::ConstIterator it = e.inputs.begin(); it != e.inputs.end(); ++it) {
+            QSet<QString> &ids = dependents[it.key()];
+            if (ids.isEmpty() && it.value() != "-")
+                watcher.addPath(it.key());
+            ids.insert(id);
+        }
+    }
+
+    void drop(const QString &id)
+    {
+        QMap<QString, QcServiceEntry>::Iterator it = entries.find(id);
+        if (it == entries.end())
+            return;
+        foreach (const QString &path, it.value().inputs.keys()) {
+            QSet<QString> &ids = dependents[path];
+            ids.remove(id);
+            if (ids.isEmpty()) {
+                dependents.remove(path);
+                watcher.removePath(path);
+            }
+        }
+        entries.erase(it);
+    }
+
+    // only the results depending on path are affected
+    void changed(const QString &path)
+    {
+        foreach (const QString &id, dependents.value(path))
+            drop(id);
+    }
+};
+
+static int qc_serve(const QString &name)
+{
+#ifdef Q_OS_UNIX
+    // stay around on our own, without holding on to the terminal or the
+    //   output of configure
+    setsid();
+    signal(SIGPIPE, SIG_IGN);
+    int fd = ::open("/dev/null", O_RDWR);
+    if (fd != -1) {
+        dup2(fd, 0);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        if (fd > 2)
+            close(fd);
+    }
+#endif
+    QcService service;
+    if (!service.listen(name))
+        return 1;
+    return QCoreApplication::exec();
+}
+#endif
+
+static QAtomicInt qc_atest_serial;
+
+// builds each entry of sources with the same entry of libsList, each in
+//   its own atest dir, with the qmake, make and run steps of all of them
+//   running at the same time.  returns whether each one compiled and
+//   linked, and puts the exit codes of the programs into retcodes, if
+//   given.
+static QList<bool> qc_compile_and_link_all(Conf *conf, const QStringList &sources, const QStringList &incs,
+                                           const QStringList &libsList, const QString &proextra,
+                                           QList<int> *retcodes)
+{
+    QDir tmp = qc_scratch_dir();
+
+    foreach (const QString &inc, incs)
+        qc_add_input(inc);
+    foreach (const QString &libs, libsList) {
+        foreach (const QString &flag, qc_splitflags(libs)) {
+            if (flag.startsWith(QLatin1String("-L")))
+                qc_add_input(qc_normalize_path(flag.mid(2)));
+        }
+    }
+
+    QStringList dirs;
+    QList<bool> ok;
+    QList<int>  cachedRetcodes;
+    bool        trackDeps = qc_service_enabled();
+#ifdef QC_SHARED_CACHE
+    QList<QcProbeKey>  keys;
+    QList<bool>        cached;
+    QList<QStringList> deps; // the files each probe used
+    trackDeps = trackDeps || !qc_cache_backends(conf).isEmpty();
+#endif
+    for (int n = 0; n < libsList.count(); ++n) {
+        cachedRetcodes += -1;
+#ifdef QC_SHARED_CACHE
+        keys += qc_probe_key(conf, sources[n], incs, libsList[n], proextra);
+        deps += QStringList();
+        bool hit = qc_cache_lookup(conf, keys[n], retcodes != 0, &cachedRetcodes[n], &deps[n]);
+        cached += hit;
+        if (hit) {
+            // nothing to build for this one
+            foreach (const QString &dep, deps[n])
+                qc_add_input(dep);
+            dirs += QString();
+            ok += true;
+            continue;
+        }
+#endif
+        // checks may run at the same time, each needing its own dirs
+        int     serial = qc_atest_serial.fetchAndAddRelaxed(1);
+        QString name   = serial == 0 ? QString("atest") : QString("atest%1").arg(serial);
+        dirs += qc_write_atest(conf, tmp, name, sources[n], incs, libsList[n], proextra, trackDeps);
+        ok += !dirs.last().isEmpty();
+    }
+
+    qc_run_in_dirs(conf, conf->qmake_path, QStringList() << "atest.pro", dirs, &ok);
+    QList<bool>       configured = ok;
+    QList<QByteArray> makeOutputs;
+    qc_run_in_dirs(conf, conf->maketool, QStringList(), dirs, &ok, 0, &makeOutputs);
+#ifdef QC_SHARED_CACHE
+    // before distclean removes atest.d
+    QList<bool> haveDeps;
+    for (int n = 0; n < dirs.count(); ++n) {
+        haveDeps += trackDeps && ok[n] && !dirs[n].isEmpty() && qc_probe_deps(dirs[n], makeOutputs[n], &deps[n]);
+        if (haveDeps[n]) {
+            foreach (const QString &dep, deps[n])
+                qc_add_input(dep);
+        } else if (ok[n] && !dirs[n].isEmpty()) {
+            qc_add_untracked_input();
+        }
+    }
+#endif
+    if (retcodes) {
+        QList<ConfCommand *> cmds;
+        QList<int>           which, rets;
+        *retcodes = cachedRetcodes;
+        for (int n = 0; n < dirs.count(); ++n) {
+            if (ok[n] && !dirs[n].isEmpty()) {
+                cmds += conf->startCommand(QDir(dirs[n]).absoluteFilePath("atest"), QStringList(), dirs[n]);
+                which += n;
+            }
+        }
+        conf->waitCommands(cmds, &rets);
+        for (int n = 0; n < which.count(); ++n)
+            (*retcodes)[which[n]] = rets[n];
+    }
+    QList<int> distclean;
+    for (int n = 0; n < dirs.count(); ++n)
+        distclean += 0;
+    qc_run_in_dirs(conf, conf->maketool, QStringList() << "distclean", dirs, &configured, &distclean);
+    for (int n = 0; n < dirs.count(); ++n) {
+        if (configured[n] && distclean[n] != 0)
+            conf->debug("error during atest distclean");
+
+        // remove whole dir since distclean doesn't always work
+        if (!dirs[n].isEmpty())
+            qc_removedir(dirs[n]);
+
+#ifdef QC_SHARED_CACHE
+        if (!cached[n] && haveDeps[n])
+            qc_cache_store(conf, keys[n], retcodes != 0, retcodes ? (*retcodes)[n] : 0, deps[n]);
+#endif
+    }
+    return ok;
+}
+
+// builds filedata once for each entry of libsList, see above
+static QList<bool> qc_compile_and_link_each(Conf *conf, const QString &filedata, const QStringList &incs,
+                                            const QStringList &libsList, const QString &proextra,
+                                            QList<int> *retcodes)
+{
+    QStringList sources;
+    for (int n = 0; n < libsList.count(); ++n)
+        sources += filedata;
+    return qc_compile_and_link_all(conf, sources, incs, libsList, proextra, retcodes);
+}
+
+bool Conf::doCompileAndLink(const QString &filedata, const QStringList &incs, const QString &libs,
+                            const QString &proextra, int *retcode)
+{
+    QList<int>  retcodes;
+    QList<bool> ok = qc_compile_and_link_each(this, filedata, incs, QStringList() << libs, proextra,
+                                              retcode ? &retcodes : 0);
+    if (!ok[0]) {
+        // what would have to appear for it to build can't be told
+        qc_add_untracked_input();
+        return false;
+    }
+    if (retcode)
+        *retcode = retcodes[0];
+    return true;
+}
+
+// what checkLibrary and findLibrary link against the library
+static const char *qc_library_check_source = "int main()\n"
+                                             "{\n"
+                                             "    return 0;\n"
+                                             "}\n";
+
+static QMutex      qc_compiler_mutex;
+static bool        qc_compiler_known = false;
+static QString     qc_compiler_command;
+static QStringList qc_compiler_cxxflags;
+
+// the variables of a Makefile qmake wrote, as far as they are plain
+//   assignments.  a line ending in a backslash goes on on the next one.
+static QMap<QString, QString> qc_makefile_vars(const QByteArray &data)
+{
+    QMap<QString, QString> vars;
+    QString                line;
+    bool                   recipe = false;
+    foreach (const QByteArray &part, data.split('\n')) {
+        if (line.isEmpty())
+            recipe = part.startsWith('\t');
+        line += QString::fromLocal8Bit(part).trimmed();
+        if (line.endsWith('\\')) {
+            line.chop(1);
+            line += ' ';
+            continue;
+        }
+        int at = line.indexOf('=');
+        if (!recipe && at > 0 && !line.startsWith('#')) {
+            // not :=, += or ?=, nor a rule
+            QString name = line.left(at).trimmed();
+            bool    ok   = !name.isEmpty();
+            foreach (const QChar &ch, name)
+                ok = ok && !ch.isSpace() && ch != ':' && ch != '+' && ch != '?' && ch != '$';
+            if (ok)
+                vars.insert(name, line.mid(at + 1).trimmed());
+        }
+        line.clear();
+    }
+    return vars;
+}
+
+// value with its $(VAR)s expanded from vars, as make would.  unknown
+//   variables, and the functions of make, are empty.
+static QString qc_makefile_expand(const QString &value, const QMap<QString, QString> &vars, int depth = 0)
+{
+    QString out;
+    int     n = 0;
+    while (n < value.length()) {
+        if (value[n] != '$' || n + 1 >= value.length()) {
+            out += value[n++];
+            continue;
+        }
+        if (value[n + 1] != '(') {
+            out += value[n + 1] == '$' ? QString('$') : value.mid(n, 2);
+            n += 2;
+            continue;
+        }
 
-        if (!ok && o->required) {
-            printf("\nError: need %s!\n", o->name().toLatin1().data());
-            return false;
+        // to the matching paren, as functions nest
+        int end = n + 2, open = 1;
+        for (; end < value.length() && open; ++end) {
+            if (value[end] == '(')
+                ++open;
+            else if (value[end] == ')')
+                --open;
         }
+        QString name = value.mid(n + 2, end - n - 3);
+        if (!open && depth < 16 && !name.contains(' ') && !name.contains(','))
+            out += qc_makefile_expand(vars.value(name), vars, depth + 1);
+        n = end;
     }
-    return true;
+    return out;
 }
 
-QString Conf::qvar(const QString &s) { return vars.value(s); }
-
-QString Conf::normalizePath(const QString &s) const { return qc_normalize_path(s); }
-
-QString Conf::escapeQmakeVar(const QString &s) const { return qc_escape_string_var(s); }
-
-QString Conf::escapedIncludes() const { return qc_prepare_includepath(INCLUDEPATH); }
+// the flags a Makefile qmake wrote compiles C++ with: CXXFLAGS, DEFINES
+//   if CXXFLAGS doesn't have them, and INCPATH.  the include dirs are
+//   made absolute against dir, the one of the Makefile, and those inside
+//   it are left out, as it is about to go away.
+static QStringList qc_makefile_cxxflags(const QMap<QString, QString> &vars, const QString &dir)
+{
+    QString str = "$(CXXFLAGS) $(INCPATH)";
+    if (!vars.value("CXXFLAGS").contains("$(DEFINES)"))
+        str = "$(DEFINES) " + str;
+    QStringList flags = qc_splitflags(qc_makefile_expand(str, vars));
 
-QString Conf::escapedLibs() const { return qc_prepare_libs(LIBS); }
+    QDir        base(dir);
+    QString     own = QDir::cleanPath(base.absolutePath());
+    QStringList ret;
+    for (int n = 0; n < flags.count(); ++n) {
+        QString opt = flags[n], path;
+        if ((opt == "-I" || opt == "-isystem") && n + 1 < flags.count()) {
+            path = flags[++n];
+        } else if (opt.startsWith("-I") && opt.length() > 2) {
+            path = opt.mid(2);
+            opt  = "-I";
+        } else {
+            ret += opt;
+            continue;
+        }
+        path = QDir::cleanPath(base.absoluteFilePath(path));
+        if (path == own || path.startsWith(own + '/'))
+            continue;
+        if (opt == "-I")
+            ret += opt + path;
+        else
+            ret << opt << path;
+    }
+    return ret;
+}
 
-QString Conf::expandIncludes(const QString &inc) { return QLatin1String("-I") + inc; }
+// the command qmake compiles with, as the CXX of the Makefile it writes for
+//   an empty project, or QC_CXX if set.  empty if neither works.  the flags
+//   of the same Makefile go with it, but not with QC_CXX, which has its
+//   own.  this is found once, and only when some check needs it.
+static void qc_find_compiler(Conf *conf)
+{
+    qc_compiler_known   = true;
+    qc_compiler_command = qc_getenv("QC_CXX");
+    if (!qc_compiler_command.isEmpty())
+        return;
+
+    int     serial = qc_atest_serial.fetchAndAddRelaxed(1);
+    QString dir    = qc_write_atest(conf, qc_scratch_dir(), QString("atest%1").arg(serial), qc_library_check_source,
+                                 QStringList(), QString(), QString());
+    if (dir.isEmpty())
+        return;
+    ConfCommand *c = conf->startCommand(conf->qmake_path, QStringList() << "atest.pro", dir);
+    if (conf->waitCommand(c) == 0) {
+        // with debug_and_release, the variables are in the Makefile of each
+        QStringList makefiles;
+        makefiles << "Makefile"
+                  << "Makefile.Release";
+        foreach (const QString &name, makefiles) {
+            QFile f(QDir(dir).filePath(name));
+            if (!f.open(QFile::ReadOnly))
+                continue;
+            QMap<QString, QString> vars = qc_makefile_vars(f.readAll());
+            qc_compiler_command         = vars.value("CXX");
+            if (!qc_compiler_command.isEmpty()) {
+                qc_compiler_cxxflags = qc_makefile_cxxflags(vars, QDir(dir).absolutePath());
+                break;
+            }
+        }
+    }
+    qc_removedir(dir);
 
-QString Conf::expandLibs(const QString &lib) { return QLatin1String("-L") + lib; }
+    // make variables of its own aren't ours to expand
+    if (qc_compiler_command.contains("$(")) {
+        qc_compiler_command.clear();
+        qc_compiler_cxxflags.clear();
+    }
+    conf->debug(QString("compiler: [%1] [%2]").arg(qc_compiler_command, qc_compiler_cxxflags.join(" ")));
+}
 
-int Conf::doCommand(const QString &s, QByteArray *out)
+static QString qc_compiler(Conf *conf)
 {
-    debug(QString("[%1]").arg(s));
-    int r = qc_runcommand(s, out, debug_enabled);
-    debug(QString("returned: %1").arg(r));
-    return r;
+    QMutexLocker locker(&qc_compiler_mutex);
+    if (!qc_compiler_known)
+        qc_find_compiler(conf);
+    return qc_compiler_command;
 }
 
-int Conf::doCommand(const QString &prog, const QStringList &args, QByteArray *out)
+// what the compiler is given along with the command, for a preprocessor
+//   run to see what a compile would
+static QStringList qc_compiler_flags(Conf *conf)
 {
-    QString fullcmd = prog;
-    QString argstr  = args.join(QLatin1String(" "));
-    if (!argstr.isEmpty())
-        fullcmd += QString(" ") + argstr;
-    debug(QString("[%1]").arg(fullcmd));
-    int r = qc_runprogram(prog, args, out, debug_enabled);
-    debug(QString("returned: %1").arg(r));
-    return r;
+    QMutexLocker locker(&qc_compiler_mutex);
+    if (!qc_compiler_known)
+        qc_find_compiler(conf);
+    return qc_compiler_cxxflags;
 }
 
-bool Conf::doCompileAndLink(const QString &filedata, const QStringList &incs, const QString &libs,
-                            const QString &proextra, int *retcode)
+// the dirs the compiler looks for <headers> in, from the error output of
+//   -v as gcc and clang give it, or nothing
+static QStringList qc_include_search_path(const QByteArray &err)
 {
-#ifdef Q_OS_WIN
-    QDir tmp("qconftemp");
-#else
-    QDir tmp(".qconftemp");
-#endif
-    QStringList normalizedLibs;
-    foreach (const QString &l, qc_splitflags(libs)) {
-        normalizedLibs.append(qc_normalize_path(l));
+    QStringList dirs;
+    bool        in = false;
+    foreach (const QByteArray &line, err.split('\n')) {
+        QString str = QString::fromLocal8Bit(line).trimmed();
+        if (str.startsWith("#include <...> search starts here:"))
+            in = true;
+        else if (str == "End of search list.")
+            return dirs;
+        else if (in && !str.endsWith(" (framework directory)")) // clang on macOS
+            dirs += QDir::cleanPath(str);
     }
+    return QStringList();
+}
 
-    if (!tmp.mkdir("atest")) {
-        debug(QString("unable to create atest dir: %1").arg(tmp.absoluteFilePath("atest")));
-        return false;
-    }
-    QDir dir(tmp.filePath("atest"));
-    if (!dir.exists()) {
-        debug("atest dir does not exist");
-        return false;
+// a header that isn't there may be installed into a subdir whose mtime
+//   isn't an input, so each place a header may be found is one
+static void qc_add_header_inputs(const QStringList &headers, const QStringList &dirs)
+{
+    foreach (const QString &dir, dirs) {
+        foreach (const QString &h, headers)
+            qc_add_input(QDir(dir).filePath(h));
     }
+}
 
-    QString fname = dir.filePath("atest.cpp");
-    QString out   = "atest";
-    QFile   f(fname);
-    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
-        debug("unable to open atest.cpp for writing");
-        return false;
-    }
-    if (f.write(filedata.toLatin1()) == -1) {
-        debug("error writing to atest.cpp");
-        return false;
+// marks in found the headers that the preprocessed output of
+//   checkHeaders' source says whether they are there, returning how many
+//   it does.  the markers may or may not keep their quotes.
+static int qc_parse_header_markers(const QByteArray &out, QList<bool> *found)
+{
+    int answered = 0;
+    foreach (const QByteArray &line, out.split('\n')) {
+        QStringList parts = QString::fromLatin1(line.trimmed()).remove('"').split(' ');
+        bool        ok;
+        int         at = parts.value(1).toInt(&ok);
+        if (parts.count() == 3 && parts[0] == "qconf-header" && ok && at >= 0 && at < found->count()) {
+            (*found)[at] = parts[2] == "1";
+            ++answered;
+        }
     }
-    f.close();
-
-    debug(QString("Wrote atest.cpp:\n%1").arg(filedata));
-
-    QString pro = QString("CONFIG  += console\n"
-                          "CONFIG  -= qt app_bundle\n"
-                          "DESTDIR  = $$PWD\n"
-                          "SOURCES += atest.cpp\n");
-    QString inc = qc_prepare_includepath(incs);
-    if (!inc.isEmpty())
-        pro += "INCLUDEPATH += " + inc + '\n';
-    QString escaped_libs = qc_prepare_libs(normalizedLibs);
-    if (!escaped_libs.isEmpty())
-        pro += "LIBS += " + escaped_libs + '\n';
-    pro += proextra;
+    return answered;
+}
 
-    fname = dir.filePath("atest.pro");
-    f.setFileName(fname);
-    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
-        debug("unable to open atest.pro for writing");
-        return false;
+QList<bool> Conf::checkHeaders(const QStringList &headers, const QStringList &incs)
+{
+    // each header gets a line saying whether it is there, which the
+    //   preprocessor passes through as is
+    QString src;
+    for (int n = 0; n < headers.count(); ++n) {
+        src += QString("#if __has_include(<%1>)\n"
+                       "\"qconf-header %2 1\"\n"
+                       "#else\n"
+                       "\"qconf-header %2 0\"\n"
+                       "#endif\n")
+                   .arg(headers[n], QString::number(n));
     }
-    if (f.write(pro.toLatin1()) == -1) {
-        debug("error writing to atest.pro");
-        return false;
+    src = "#if defined(__has_include)\n" + src + "#endif\n";
+
+    QList<bool> found;
+    for (int n = 0; n < headers.count(); ++n)
+        found += false;
+
+    QStringList compiler = qc_splitflags(qc_compiler(this));
+    QDir        tmp      = qc_scratch_dir();
+    QString     name     = QString("headers%1").arg(qc_atest_serial.fetchAndAddRelaxed(1));
+    QFile       f(tmp.filePath(name + "/headers.cpp"));
+    if (!headers.isEmpty() && !compiler.isEmpty() && tmp.mkdir(name) && f.open(QFile::WriteOnly)
+        && f.write(src.toLatin1()) != -1) {
+        f.close();
+        QString dir = QDir(tmp.filePath(name)).absolutePath();
+        qc_replay_name_dir(dir, src.toLatin1());
+
+        // cl takes the same options, and ignores -v, which gives the
+        //   search path on the error output.  the flags of the Makefile
+        //   go along, for what a compile would see, after the dirs asked
+        //   about.
+        QStringList args = compiler.mid(1);
+        args += "-E";
+        args += "-v";
+        foreach (const QString &inc, incs)
+            args += QLatin1String("-I") + inc;
+        args += qc_compiler_flags(this);
+        args += "headers.cpp";
+
+        QByteArray out, err;
+        int        answered = 0;
+        if (qc_wait_command(this, startCommand(compiler[0], args, dir), &out, &err) == 0)
+            answered = qc_parse_header_markers(out, &found);
+        qc_removedir(dir);
+        if (answered == headers.count()) {
+            QStringList search = qc_include_search_path(err);
+            if (search.isEmpty())
+                qc_add_untracked_input();
+            qc_add_header_inputs(headers, incs + search);
+            return found;
+        }
     }
-    f.close();
-
-    debug(QString("Wrote atest.pro:\n%1").arg(pro));
-
-    QString oldpath = QDir::currentPath();
-    QDir::setCurrent(dir.path());
 
-    bool ok = false;
-    int  r  = doCommand(qmake_path, QStringList() << "atest.pro");
-    if (r == 0) {
-        r = doCommand(maketool, QStringList());
-        if (r == 0) {
-            ok = true;
-            if (retcode) {
-                QString runatest = out;
-#ifdef Q_OS_UNIX
-                runatest.prepend("./");
+    // without __has_include, look for them where findHeader would
+    QStringList dirs = incs;
+#ifndef Q_OS_WIN
+    dirs << "/usr/include"
+         << "/usr/local/include";
 #endif
-                *retcode = doCommand(runatest, QStringList());
+    qc_add_header_inputs(headers, dirs);
+    for (int n = 0; n < headers.count(); ++n) {
+        foreach (const QString &dir, dirs) {
+            if (QDir(dir).exists(headers[n])) {
+                found[n] = true;
+                break;
             }
         }
-        r = doCommand(maketool, QStringList() << "distclean");
-        if (r != 0)
-            debug("error during atest distclean");
     }
-
-    QDir::setCurrent(oldpath);
-
-    // cleanup
-    // dir.remove("atest.pro");
-    // dir.remove("atest.cpp");
-    // tmp.rmdir("atest");
-
-    // remove whole dir since distclean doesn't always work
-    qc_removedir(tmp.filePath("atest"));
-
-    if (!ok)
-        return false;
-    return true;
+    return found;
 }
 
-bool Conf::checkHeader(const QString &path, const QString &h) { return QDir(path).exists(h); }
+bool Conf::checkHeader(const QString &path, const QString &h)
+{
+    qc_add_input(path);
+    qc_add_input(QDir(path).filePath(h));
+    return QDir(path).exists(h);
+}
 
 bool Conf::findHeader(const QString &h, const QStringList &ext, QString *inc)
 {
@@ -666,13 +3534,7 @@ bool Conf::findHeader(const QString &h, const QStringList &ext, QString *inc)
 
 bool Conf::checkLibrary(const QString &path, const QString &name)
 {
-    QString str =
-        //"#include <stdio.h>\n"
-        "int main()\n"
-        "{\n"
-        //"    printf(\"library checker running\\\\n\");\n"
-        "    return 0;\n"
-        "}\n";
+    QString str = qc_library_check_source;
 
     QString libs;
     if (!path.isEmpty())
@@ -685,28 +3547,256 @@ bool Conf::checkLibrary(const QString &path, const QString &name)
 
 bool Conf::findLibrary(const QString &name, QString *lib)
 {
-    if (checkLibrary("", name)) {
-        *lib = "";
-        return true;
-    }
-    if (checkLibrary("/usr/local/lib", name)) {
-        *lib = "/usr/local/lib";
-        return true;
-    }
+    QStringList paths;
+    paths += "";
+    paths += "/usr/local/lib";
 
     QString prefix = qc_getenv("PREFIX");
     if (!prefix.isEmpty()) {
         prefix += "/lib";
         prefix = qc_normalize_path(prefix);
-        if (checkLibrary(prefix, name)) {
-            *lib = prefix;
+        paths += prefix;
+    }
+
+    // try all of them at once, but prefer them in the above order
+    QStringList libsList;
+    foreach (const QString &path, paths) {
+        QString libs;
+        if (!path.isEmpty())
+            libs += QString("-L") + path + ' ';
+        libs += QString("-l") + name;
+        libsList += libs;
+    }
+    QList<bool> ok = qc_compile_and_link_each(this, qc_library_check_source, QStringList(), libsList,
+                                              QString(), 0);
+    for (int n = 0; n < paths.count(); ++n) {
+        if (ok[n]) {
+            *lib = paths[n];
             return true;
         }
+        // the library appearing there would change the result, see
+        //   doCompileAndLink
+        qc_add_untracked_input();
     }
-
     return false;
 }
 
+// a program that takes the address of each of functions, declared the way
+//   autoconf does, so that no header is needed and only the link can fail
+static QString qc_functions_check_source(const QStringList &functions)
+{
+    QString str;
+    foreach (const QString &f, functions)
+        str += QString("extern \"C\" char %1();\n").arg(f);
+    str += "int main()\n"
+           "{\n"
+           "    char (*volatile p)() = 0;\n";
+    foreach (const QString &f, functions)
+        str += QString("    p = &%1;\n").arg(f);
+    str += "    return p == 0;\n"
+           "}\n";
+    return str;
+}
+
+QList<bool> Conf::checkFunctions(const QStringList &functions, const QStringList &incs, const QString &libs)
+{
+    QMap<QString, bool> found;
+
+    // all of them are linked at once.  a set that fails is split in two,
+    //   and the halves of every set that failed are linked at the same
+    //   time, until only single missing functions are left.
+    QList<QStringList> sets;
+    if (!functions.isEmpty())
+        sets += functions;
+    while (!sets.isEmpty()) {
+        QStringList sources, libsList;
+        foreach (const QStringList &set, sets) {
+            sources += qc_functions_check_source(set);
+            libsList += libs;
+        }
+        QList<bool> ok = qc_compile_and_link_all(this, sources, incs, libsList, QString(), 0);
+
+        QList<QStringList> next;
+        for (int n = 0; n < sets.count(); ++n) {
+            if (ok[n] || sets[n].count() == 1) {
+                foreach (const QString &f, sets[n])
+                    found.insert(f, ok[n]);
+            } else {
+                int half = sets[n].count() / 2;
+                next += sets[n].mid(0, half);
+                next += sets[n].mid(half);
+            }
+        }
+        sets = next;
+    }
+
+    QList<bool> out;
+    foreach (const QString &f, functions) {
+        out += found.value(f);
+        debug(QString("%1: %2").arg(f, found.value(f) ? "yes" : "no"));
+        if (found.value(f))
+            addDefine("HAVE_" + f.toUpper());
+        else
+            qc_add_untracked_input(); // see doCompileAndLink
+    }
+    return out;
+}
+
+// what the compiler predefines and the target it builds for, taken once
+//   per run with -dM -E and -dumpmachine, and kept in the probe cache.
+//   <version> is included, if there is one, for the __cpp_lib macros.
+class QcCompilerSnapshot {
+public:
+    bool                   taken;
+    QMap<QString, QString> macros;
+    QString                target;
+
+    QcCompilerSnapshot() : taken(false) { }
+};
+
+static QMutex             qc_snapshot_mutex;
+static QcCompilerSnapshot qc_snapshot;
+
+static const char *qc_snapshot_source = "#if defined(__has_include)\n"
+                                        "#if __has_include(<version>)\n"
+                                        "#include <version>\n"
+                                        "#endif\n"
+                                        "#endif\n";
+
+// the snapshot as it is cached: "snapshot", the target, and the output of
+//   -dM -E, one line each
+static void qc_parse_snapshot(const QByteArray &data, QcCompilerSnapshot *snapshot)
+{
+    QList<QByteArray> lines = data.split('\n');
+    snapshot->target        = QString::fromLatin1(lines.value(1));
+    for (int n = 2; n < lines.count(); ++n) {
+        QString line = QString::fromLatin1(lines[n]);
+        if (!line.startsWith("#define "))
+            continue;
+        line = line.mid(8);
+
+        // function-like macros are known by their name only
+        int at = 0;
+        while (at < line.length() && line[at] != ' ' && line[at] != '(')
+            ++at;
+        snapshot->macros.insert(line.left(at), at < line.length() && line[at] == ' ' ? line.mid(at + 1) : QString());
+    }
+}
+
+static bool qc_snapshot_is_good(const QByteArray &payload, bool) { return payload.startsWith("snapshot\n"); }
+
+static const QcCompilerSnapshot &qc_compiler_snapshot(Conf *conf)
+{
+    QMutexLocker locker(&qc_snapshot_mutex);
+    if (qc_snapshot.taken)
+        return qc_snapshot;
+    qc_snapshot.taken = true;
+
+    QStringList compiler = qc_splitflags(qc_compiler(conf));
+    QStringList flags    = qc_compiler_flags(conf);
+    if (compiler.isEmpty())
+        return qc_snapshot;
+
+    QByteArray data;
+#ifdef QC_SHARED_CACHE
+    QcProbeKey key = qc_probe_key(conf, (compiler + flags).join(" ") + '\n' + qc_snapshot_source, QStringList(),
+                                  QString(), QString());
+    if (qc_cache_get(conf, key, qc_snapshot_is_good, 0, &data)) {
+        qc_parse_snapshot(data, &qc_snapshot);
+        return qc_snapshot;
+    }
+#endif
+
+    QDir    tmp  = qc_scratch_dir();
+    QString name = QString("snapshot%1").arg(qc_atest_serial.fetchAndAddRelaxed(1));
+    QFile   f(tmp.filePath(name + "/snapshot.cpp"));
+    if (!tmp.mkdir(name) || !f.open(QFile::WriteOnly) || f.write(qc_snapshot_source) == -1) {
+        conf->debug("unable to write snapshot.cpp");
+        return qc_snapshot;
+    }
+    f.close();
+    QString dir = QDir(tmp.filePath(name)).absolutePath();
+    qc_replay_name_dir(dir, qc_snapshot_source);
+
+    // both at once.  the flags of the Makefile, such as -std, change
+    //   the macros.
+    QStringList macroArgs = compiler.mid(1) + flags;
+    macroArgs << "-dM"
+              << "-E"
+              << "snapshot.cpp";
+    QList<ConfCommand *> cmds;
+    cmds += conf->startCommand(compiler[0], macroArgs, dir);
+    cmds += conf->startCommand(compiler[0], compiler.mid(1) << "-dumpmachine", dir);
+    QList<int>        rets;
+    QList<QByteArray> outs;
+    conf->waitCommands(cmds, &rets, &outs);
+    qc_removedir(dir);
+
+    // there is no -dumpmachine with some, but without -dM there is nothing
+    if (rets[0] != 0)
+        return qc_snapshot;
+    data = "snapshot\n" + (rets[1] == 0 ? outs[1].trimmed() : QByteArray()) + '\n' + outs[0];
+    qc_parse_snapshot(data, &qc_snapshot);
+    conf->debug(QString("compiler snapshot: %1 macros, target %2")
+                    .arg(qc_snapshot.macros.count())
+                    .arg(qc_snapshot.target));
+#ifdef QC_SHARED_CACHE
+    qc_cache_put(conf, key, data);
+#endif
+    return qc_snapshot;
+}
+
+bool Conf::hasMacro(const QString &name) { return qc_compiler_snapshot(this).macros.contains(name); }
+
+QString Conf::macroValue(const QString &name) { return qc_compiler_snapshot(this).macros.value(name); }
+
+QString Conf::compilerId()
+{
+    const QMap<QString, QString> &macros = qc_compiler_snapshot(this).macros;
+    // clang and icc also say they are gcc
+    if (macros.contains("__INTEL_COMPILER"))
+        return "icc";
+    if (macros.contains("__clang__"))
+        return "clang";
+    if (macros.contains("__GNUC__"))
+        return "gcc";
+    if (macros.contains("_MSC_VER"))
+        return "msvc";
+    return QString();
+}
+
+QString Conf::compilerVersion()
+{
+    const QMap<QString, QString> &macros = qc_compiler_snapshot(this).macros;
+    QString                       id     = compilerId();
+    if (id == "clang")
+        return QString("%1.%2.%3").arg(macros["__clang_major__"], macros["__clang_minor__"],
+                                       macros["__clang_patchlevel__"]);
+    if (id == "gcc")
+        return QString("%1.%2.%3").arg(macros["__GNUC__"], macros["__GNUC_MINOR__"], macros["__GNUC_PATCHLEVEL__"]);
+    if (id == "icc")
+        return macros["__INTEL_COMPILER"];
+    if (id == "msvc")
+        return macros["_MSC_VER"];
+    return QString();
+}
+
+QString Conf::cxxStandard()
+{
+    const char *standards[][2] = { { "199711L", "c++98" }, { "201103L", "c++11" }, { "201402L", "c++14" },
+                                   { "201703L", "c++17" }, { "202002L", "c++20" }, { "202302L", "c++23" } };
+
+    QString value = macroValue("__cplusplus");
+    for (size_t n = 0; n < sizeof(standards) / sizeof(standards[0]); ++n) {
+        if (value == standards[n][0])
+            return standards[n][1];
+    }
+    // a draft, or nothing
+    return value;
+}
+
+QString Conf::targetTriple() { return qc_compiler_snapshot(this).target; }
+
 QString Conf::findProgram(const QString &prog) { return qc_findprogram(prog); }
 
 bool Conf::findSimpleLibrary(const QString &incvar, const QString &libvar, const QString &incname,
@@ -761,32 +3851,21 @@ bool Conf::findSimpleLibrary(const QString &incvar, const QString &libvar, const
 
 bool Conf::findFooConfig(const QString &path, QString *version, QStringList *incs, QString *libs, QString *otherflags)
 {
-    QStringList args;
-    QByteArray  out;
-    int         ret;
-
-    args += "--version";
-    ret = doCommand(path, args, &out);
-    if (ret != 0)
-        return false;
-
-    QString version_out = QString::fromLatin1(out).trimmed();
-
-    args.clear();
-    args += "--libs";
-    ret = doCommand(path, args, &out);
-    if (ret != 0)
-        return false;
-
-    QString libs_out = QString::fromLatin1(out).trimmed();
-
-    args.clear();
-    args += "--cflags";
-    ret = doCommand(path, args, &out);
-    if (ret != 0)
+    QList<ConfCommand *> cmds;
+    QList<int>           rets;
+    QList<QByteArray>    outs;
+
+    // --version, --libs and --cflags don't depend on each other
+    cmds += startCommand(path, QStringList() << "--version");
+    cmds += startCommand(path, QStringList() << "--libs");
+    cmds += startCommand(path, QStringList() << "--cflags");
+    waitCommands(cmds, &rets, &outs);
+    if (rets.count(0) != rets.count())
         return false;
 
-    QString cflags = QString::fromLatin1(out).trimmed();
+    QString version_out = QString::fromLatin1(outs[0]).trimmed();
+    QString libs_out    = QString::fromLatin1(outs[1]).trimmed();
+    QString cflags      = QString::fromLatin1(outs[2]).trimmed();
 
     QStringList incs_out, otherflags_out;
     qc_splitcflags(cflags, &incs_out, &otherflags_out);
@@ -798,21 +3877,138 @@ bool Conf::findFooConfig(const QString &path, QString *version, QStringList *inc
     return true;
 }
 
-bool Conf::findPkgConfig(const QString &name, VersionMode mode, const QString &req_version, QString *version,
-                         QStringList *incs, QString *libs, QString *otherflags)
+// notes the .pc file used for a package, and the dirs pkg-config searches,
+//   where one could show up, for the conf service
+static void qc_add_pkgconfig_inputs(Conf *conf, const QString &pcfile)
 {
-    QStringList args;
-    QByteArray  out;
-    int         ret;
+    static QMutex      mutex;
+    static bool        done = false;
+    static QStringList dirs;
 
-    args += name;
-    args += "--exists";
-    ret = doCommand("pkg-config", args, &out);
-    if (ret != 0)
-        return false;
+    mutex.lock();
+    if (!done) {
+        done = true;
+#ifdef Q_OS_WIN
+        QChar sep = ';';
+#else
+        QChar sep = ':';
+#endif
+        QByteArray out;
+        conf->doCommand("pkg-config", QStringList() << "--variable=pc_path" << "pkg-config", &out);
+        QString path = QString::fromLocal8Bit(out).trimmed();
+        path += sep + qc_getenv("PKG_CONFIG_PATH") + sep + qc_getenv("PKG_CONFIG_LIBDIR");
+        foreach (const QString &dir, path.split(sep)) {
+            if (!dir.isEmpty())
+                dirs += dir;
+        }
+    }
+    mutex.unlock();
+
+    foreach (const QString &dir, dirs)
+        qc_add_input(dir);
+    qc_add_input(pcfile);
+}
+
+static QMutex                 qc_qt_properties_mutex;
+static bool                   qc_qt_properties_known = false;
+static QMap<QString, QString> qc_qt_properties;
+
+// all that qmake -query says, asked once
+static QMap<QString, QString> qc_query_qt(Conf *conf)
+{
+    QMutexLocker locker(&qc_qt_properties_mutex);
+    if (!qc_qt_properties_known) {
+        qc_qt_properties_known = true;
+        QByteArray out;
+        if (conf->doCommand(conf->qmake_path, QStringList() << "-query", &out) == 0) {
+            foreach (const QByteArray &line, out.split('\n')) {
+                int at = line.indexOf(':');
+                if (at > 0)
+                    qc_qt_properties.insert(QString::fromLocal8Bit(line.left(at)),
+                                            QString::fromLocal8Bit(line.mid(at + 1)).trimmed());
+            }
+        }
+    }
+    return qc_qt_properties;
+}
+
+// the header dir of a Qt 4 module, for those not named like QtNetwork
+static QString qc_qt4_module_dir(const QString &name)
+{
+    const char *irregular[][2] = { { "dbus", "QtDBus" },
+                                   { "opengl", "QtOpenGL" },
+                                   { "xmlpatterns", "QtXmlPatterns" },
+                                   { "webkit", "QtWebKit" },
+                                   { "scripttools", "QtScriptTools" },
+                                   { "uitools", "QtUiTools" } };
+    for (size_t n = 0; n < sizeof(irregular) / sizeof(irregular[0]); ++n) {
+        if (name == irregular[n][0])
+            return irregular[n][1];
+    }
+    return "Qt" + name.left(1).toUpper() + name.mid(1);
+}
+
+bool Conf::findQtModule(const QString &name, QString *version)
+{
+    QMap<QString, QString> props = qc_query_qt(this);
+
+    // the qt_lib_<name>.pri files that qmake itself reads for QT += name
+    QStringList dirs;
+    const char *vars[] = { "QT_INSTALL_ARCHDATA", "QT_HOST_DATA", "QT_INSTALL_DATA", 0 };
+    for (int n = 0; vars[n]; ++n) {
+        QString dir = props.value(vars[n]);
+        if (!dir.isEmpty() && !dirs.contains(dir + "/mkspecs/modules"))
+            dirs += dir + "/mkspecs/modules";
+    }
+    QString key = QString("QT.%1.VERSION").arg(name);
+    foreach (const QString &dir, dirs) {
+        QString path = QDir(dir).filePath(QString("qt_lib_%1.pri").arg(name));
+        qc_add_input(dir);
+        qc_add_input(path);
+        QFile f(path);
+        if (!f.open(QFile::ReadOnly))
+            continue;
+        debug(QString("found %1").arg(path));
+        while (!f.atEnd()) {
+            QString line = QString::fromLocal8Bit(f.readLine()).trimmed();
+            int     at   = line.indexOf('=');
+            if (at > 0 && line.left(at).trimmed() == key)
+                *version = line.mid(at + 1).trimmed();
+        }
+        return true;
+    }
+
+    // Qt 4 has no such files, but a dir of headers for each module
+    if (props.value("QT_VERSION").startsWith("4.")) {
+        QString headers = props.value("QT_INSTALL_HEADERS");
+        qc_add_input(headers);
+        if (!headers.isEmpty() && QDir(headers).exists(qc_qt4_module_dir(name))) {
+            *version = props.value("QT_VERSION");
+            return true;
+        }
+    }
+    return false;
+}
 
+bool Conf::findPkgConfig(const QString &name, VersionMode mode, const QString &req_version, QString *version,
+                         QStringList *incs, QString *libs, QString *otherflags)
+{
+    QList<ConfCommand *> cmds;
+    QList<int>           rets;
+    QList<QByteArray>    outs;
+
+    // all of these are independent queries, so run them at once.  if the
+    //   package doesn't exist, the others simply fail as well.
+    // a static variant needs the private libs as well
+    QStringList libsArgs = QStringList() << name << "--libs";
+    if (variant == "static")
+        libsArgs += "--static";
+    cmds += startCommand("pkg-config", QStringList() << name << "--modversion");
+    cmds += startCommand("pkg-config", libsArgs);
+    cmds += startCommand("pkg-config", QStringList() << name << "--cflags");
+    cmds += startCommand("pkg-config", QStringList() << name << "--exists");
     if (mode != VersionAny) {
-        args.clear();
+        QStringList args;
         args += name;
         if (mode == VersionMin)
             args += QString("--atleast-version=%1").arg(req_version);
@@ -820,37 +4016,24 @@ bool Conf::findPkgConfig(const QString &name, VersionMode mode, const QString &r
             args += QString("--max-version=%1").arg(req_version);
         else
             args += QString("--exact-version=%1").arg(req_version);
-        ret = doCommand("pkg-config", args, &out);
-        if (ret != 0)
-            return false;
+        cmds += startCommand("pkg-config", args);
     }
-
-    args.clear();
-    args += name;
-    args += "--modversion";
-    ret = doCommand("pkg-config", args, &out);
-    if (ret != 0)
-        return false;
-
-    QString version_out = QString::fromLatin1(out).trimmed();
-
-    args.clear();
-    args += name;
-    args += "--libs";
-    ret = doCommand("pkg-config", args, &out);
-    if (ret != 0)
-        return false;
-
-    QString libs_out = QString::fromLatin1(out).trimmed();
-
-    args.clear();
-    args += name;
-    args += "--cflags";
-    ret = doCommand("pkg-config", args, &out);
-    if (ret != 0)
+    int pcfiledir = -1;
+    if (qc_service_enabled()) {
+        pcfiledir = cmds.count();
+        cmds += startCommand("pkg-config", QStringList() << name << "--variable=pcfiledir");
+    }
+    waitCommands(cmds, &rets, &outs);
+    if (pcfiledir != -1) {
+        QString dir = QString::fromLocal8Bit(outs[pcfiledir]).trimmed();
+        qc_add_pkgconfig_inputs(this, rets[pcfiledir] == 0 ? QDir(dir).filePath(name + ".pc") : QString());
+    }
+    if (rets.count(0) != rets.count())
         return false;
 
-    QString cflags = QString::fromLatin1(out).trimmed();
+    QString version_out = QString::fromLatin1(outs[0]).trimmed();
+    QString libs_out    = QString::fromLatin1(outs[1]).trimmed();
+    QString cflags      = QString::fromLatin1(outs[2]).trimmed();
 
     QStringList incs_out, otherflags_out;
     qc_splitcflags(cflags, &incs_out, &otherflags_out);
@@ -864,41 +4047,118 @@ bool Conf::findPkgConfig(const QString &name, VersionMode mode, const QString &r
 
 void Conf::addDefine(const QString &str)
 {
-    if (DEFINES.isEmpty())
-        DEFINES = str;
-    else
-        DEFINES += QString(" ") + str;
+    QcCheckOutput added;
+    added.DEFINES = str;
+    qc_add_to_output(this, added);
     debug(QString("DEFINES += %1").arg(str));
 }
 
 void Conf::addLib(const QString &str)
 {
-    QStringList libs = qc_splitflags(str);
+    QcCheckOutput added;
+    QStringList   libs = qc_splitflags(str);
     foreach (const QString &lib, libs) {
         if (lib.startsWith("-l")) {
-            LIBS.append(lib);
+            added.LIBS.append(lib);
         } else {
-            LIBS.append(qc_normalize_path(lib)); // we don't care about -L prefix since normalier does not touch it.
+            // we don't care about -L prefix since normalier does not touch it.
+            added.LIBS.append(qc_normalize_path(lib));
         }
     }
+    qc_add_to_output(this, added);
     debug(QString("LIBS += %1").arg(str));
 }
 
 void Conf::addIncludePath(const QString &str)
 {
-    INCLUDEPATH.append(qc_normalize_path(str));
+    QcCheckOutput added;
+    added.INCLUDEPATH.append(qc_normalize_path(str));
+    qc_add_to_output(this, added);
     debug(QString("INCLUDEPATH += %1").arg(str));
 }
 
 void Conf::addExtra(const QString &str)
 {
-    extra += str + '\n';
+    QcCheckOutput added;
+    added.extra = str + '\n';
+    qc_add_to_output(this, added);
     debug(QString("extra += %1").arg(str));
 }
 
+// what conf.pri says for a variant of configure --variants
+static QString qc_variant_config(const QString &variant)
+{
+    if (variant == "debug")
+        return "CONFIG -= release\nCONFIG += debug\n";
+    if (variant == "release")
+        return "CONFIG -= debug\nCONFIG += release\n";
+    if (variant == "static")
+        return "CONFIG += static staticlib\n";
+    if (variant == "lto")
+        return "CONFIG += ltcg\n";
+    return QString("CONFIG += %1\n").arg(variant);
+}
+
+static bool qc_write_conf_pri(Conf *conf, const QString &fname)
+{
+    QFile f(fname);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    QString str;
+    str += "# qconf\n\n";
+    str += "greaterThan(QT_MAJOR_VERSION, 4):CONFIG += c++11\n";
+
+    QString var;
+    var = qc_normalize_path(qc_getenv("PREFIX"));
+    if (!var.isEmpty())
+        str += QString("PREFIX = %1\n").arg(var);
+    var = qc_normalize_path(qc_getenv("BINDIR"));
+    if (!var.isEmpty())
+        str += QString("BINDIR = %1\n").arg(var);
+    var = qc_normalize_path(qc_getenv("INCDIR"));
+    if (!var.isEmpty())
+        str += QString("INCDIR = %1\n").arg(var);
+    var = qc_normalize_path(qc_getenv("LIBDIR"));
+    if (!var.isEmpty())
+        str += QString("LIBDIR = %1\n").arg(var);
+    var = qc_normalize_path(qc_getenv("DATADIR"));
+    if (!var.isEmpty())
+        str += QString("DATADIR = %1\n").arg(var);
+    str += '\n';
+
+    if (qc_getenv("QC_STATIC") == "Y")
+        str += "CONFIG += staticlib\n";
+    if (!conf->variant.isEmpty())
+        str += qc_variant_config(conf->variant);
+
+    // TODO: don't need this?
+    // str += "QT_PATH_PLUGINS = " + QString(qInstallPathPlugins()) + '\n';
+
+    if (!conf->DEFINES.isEmpty())
+        str += "DEFINES += " + conf->DEFINES + '\n';
+    if (!conf->INCLUDEPATH.isEmpty())
+        str += "INCLUDEPATH += " + qc_prepare_includepath(conf->INCLUDEPATH) + '\n';
+    if (!conf->LIBS.isEmpty())
+        str += "LIBS += " + qc_prepare_libs(conf->LIBS) + '\n';
+    if (!conf->extra.isEmpty())
+        str += conf->extra;
+    str += '\n';
+
+    var = qc_getenv("QC_EXTRACONF");
+    if (!var.isEmpty())
+        str += ("\n# Extra conf from command line\n" + var + "\n");
+
+    QByteArray cs = str.toLatin1();
+    f.write(cs);
+    f.close();
+    return true;
+}
+
 //----------------------------------------------------------------------------
 // main
 //----------------------------------------------------------------------------
+#ifndef QC_NO_MAIN
 #include "conf4.moc"
 
 #ifdef HAVE_MODULES
@@ -915,6 +4175,12 @@ int main(int argc, char **argv)
 #include "modules_new.cpp"
 #endif
 
+#ifdef QC_HAVE_NETWORK
+    // conf --serve NAME is the conf service, started by configure --service
+    if (argc == 3 && QString(argv[1]) == "--serve")
+        return qc_serve(QString(argv[2]));
+#endif
+
     conf->debug_enabled = (qc_getenv("QC_VERBOSE") == "Y") ? true : false;
     if (conf->debug_enabled)
         printf(" -> ok\n");
@@ -926,6 +4192,10 @@ int main(int argc, char **argv)
     conf->qmake_path    = qc_getenv("QC_QMAKE");
     conf->qmakespec     = qc_getenv("QC_QMAKESPEC");
     conf->maketool      = qc_getenv("QC_MAKETOOL");
+    QString jobSlots    = qc_jobserver()->init(qc_getenv("QC_JOBS").toInt());
+    qc_init_timeouts();
+    if (!qc_init_replay())
+        return 1;
 
     if (conf->debug_enabled)
         printf("conf command: [%s]\n", qPrintable(confCommand));
@@ -948,71 +4218,56 @@ int main(int argc, char **argv)
         printf("qmake path:   [%s]\n", qPrintable(conf->qmake_path));
         printf("qmakespec:    [%s]\n", qPrintable(conf->qmakespec));
         printf("make tool:    [%s]\n", qPrintable(conf->maketool));
+        printf("job slots:    [%s]\n", jobSlots.isEmpty() ? "no limit" : qPrintable(jobSlots));
         printf("\n");
     }
+#ifndef QC_HAVE_NETWORK
+    if (qc_getenv("QC_SERVICE") == "Y")
+        conf->debug("conf was built without QtNetwork, not using the conf service");
+#endif
 
-    bool success = false;
-    if (conf->exec()) {
-        QFile f("conf.pri");
-        if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
-            printf("Error writing %s\n", qPrintable(f.fileName()));
+    // with --variants, each one gets a conf.pri and a Makefile in a dir of
+    //   its own, named after it
+#if QT_VERSION >= 0x060000
+    Qt::SplitBehavior flags = Qt::SkipEmptyParts;
+#else
+    QString::SplitBehavior flags = QString::SkipEmptyParts;
+#endif
+    QStringList variants = qc_getenv("QC_VARIANTS").split(',', flags);
+    if (variants.isEmpty())
+        variants += QString();
+    // the dir must be one right below the build dir
+    foreach (const QString &variant, variants) {
+        if (variant == "." || variant.contains("..") || variant.contains('/') || variant.contains('\\')) {
+            printf("Error: bad variant name '%s'\n", qPrintable(variant));
             return 1;
         }
+    }
 
-        QString str;
-        str += "# qconf\n\n";
-        str += "greaterThan(QT_MAJOR_VERSION, 4):CONFIG += c++11\n";
-
-        QString var;
-        var = qc_normalize_path(qc_getenv("PREFIX"));
-        if (!var.isEmpty())
-            str += QString("PREFIX = %1\n").arg(var);
-        var = qc_normalize_path(qc_getenv("BINDIR"));
-        if (!var.isEmpty())
-            str += QString("BINDIR = %1\n").arg(var);
-        var = qc_normalize_path(qc_getenv("INCDIR"));
-        if (!var.isEmpty())
-            str += QString("INCDIR = %1\n").arg(var);
-        var = qc_normalize_path(qc_getenv("LIBDIR"));
-        if (!var.isEmpty())
-            str += QString("LIBDIR = %1\n").arg(var);
-        var = qc_normalize_path(qc_getenv("DATADIR"));
-        if (!var.isEmpty())
-            str += QString("DATADIR = %1\n").arg(var);
-        str += '\n';
-
-        if (qc_getenv("QC_STATIC") == "Y")
-            str += "CONFIG += staticlib\n";
-
-        // TODO: don't need this?
-        // str += "QT_PATH_PLUGINS = " + QString(qInstallPathPlugins()) + '\n';
-
-        if (!conf->DEFINES.isEmpty())
-            str += "DEFINES += " + conf->DEFINES + '\n';
-        if (!conf->INCLUDEPATH.isEmpty())
-            str += "INCLUDEPATH += " + qc_prepare_includepath(conf->INCLUDEPATH) + '\n';
-        if (!conf->LIBS.isEmpty())
-            str += "LIBS += " + qc_prepare_libs(conf->LIBS) + '\n';
-        if (!conf->extra.isEmpty())
-            str += conf->extra;
-        str += '\n';
-
-        var = qc_getenv("QC_EXTRACONF");
-        if (!var.isEmpty())
-            str += ("\n# Extra conf from command line\n" + var + "\n");
-
-        QByteArray cs = str.toLatin1();
-        f.write(cs);
-        f.close();
-        success = true;
+    QStringList dirs;
+    foreach (const QString &variant, variants) {
+        if (!variant.isEmpty())
+            printf("%sVariant %s:\n", dirs.isEmpty() ? "" : "\n", qPrintable(variant));
+        conf->variant = variant;
+        conf->DEFINES.clear();
+        conf->INCLUDEPATH.clear();
+        conf->LIBS.clear();
+        conf->extra.clear();
+        if (!conf->exec())
+            return 1;
+
+        QString dir = variant.isEmpty() ? QString(".") : variant;
+        QString pri = QDir(dir).filePath("conf.pri");
+        if (!QDir().mkpath(dir) || !qc_write_conf_pri(conf, pri)) {
+            printf("Error writing %s\n", qPrintable(pri));
+            return 1;
+        }
+        dirs += dir;
     }
     QString qmake_path = conf->qmake_path;
     QString qmakespec  = conf->qmakespec;
     delete conf;
 
-    if (!success)
-        return 1;
-
     // run qmake on the project file
     QStringList args;
     if (!qmakespec.isEmpty()) {
@@ -1020,9 +4275,19 @@ int main(int argc, char **argv)
         args += qmakespec;
     }
     args += proPath;
-    int ret = qc_runprogram(qmake_path, args, 0, true);
-    if (ret != 0)
-        return 1;
+    for (int n = 0; n < dirs.count(); ++n) {
+        QDir::setCurrent(dirs[n]);
+        QElapsedTimer timer;
+        timer.start();
+        int ret = qc_runprogram(qmake_path, args, 0, true);
+        qc_report_timing(variants[n].isEmpty() ? QString("qmake") : "qmake." + variants[n], timer);
+        QDir::setCurrent(builddir);
+        if (ret != 0)
+            return 1;
+    }
 
+    if (qc_replay_misses > 0)
+        printf("Warning: %d commands were not in the record, and failed\n", qc_replay_misses);
     return 0;
 }
+#endif
@@ -12,6 +12,8 @@ preserved.
 #include <QtCore>
 
 class Conf;
+class ConfCommand;
+class QcCheckOutput;
 
 enum VersionMode { VersionMin, VersionExact, VersionMax, VersionAny };
 
@@ -44,8 +46,20 @@ public:
     // default: "yes" or "no", based on result of exec()
     virtual QString resultString() const;
 
-    // this is where the checking code goes
+    // this is where the checking code goes.  with a single job, checks run
+    // one at a time in declaration order, and what a check adds with
+    // addDefine() and friends shows up in the Conf members right away.
+    // with configure --jobs, or under a parallel make, they run on worker
+    // threads at the same time, in an order of their own, and what they
+    // add only shows up once all checks are done, so a check that must
+    // work both ways can't depend on the results of another.
     virtual bool exec() = 0;
+
+    // with configure --variants, whether the result for conf->variant may
+    // differ from that of the first variant.  exec() is only called again
+    // for those.
+    // default: false
+    virtual bool variantSpecific() const;
 };
 
 // Conf
@@ -58,6 +72,7 @@ public:
     QString qmake_path;
     QString qmakespec;
     QString maketool;
+    QString variant; // the one being configured, or empty (configure --variants)
 
     QString     DEFINES;
     QStringList INCLUDEPATH;
@@ -91,6 +106,14 @@ public:
     int doCommand(const QString &s, QByteArray *out = 0);
     int doCommand(const QString &prog, const QStringList &args, QByteArray *out = 0);
 
+    // like doCommand, but without waiting for the command to finish, so
+    // that several commands can run at the same time.  every started
+    // command must be waited for with waitCommand or waitCommands, which
+    // return what doCommand would have and delete the command.
+    ConfCommand *startCommand(const QString &prog, const QStringList &args, const QString &workdir = QString());
+    int          waitCommand(ConfCommand *c, QByteArray *out = 0);
+    void         waitCommands(const QList<ConfCommand *> &list, QList<int> *rets, QList<QByteArray> *outs = 0);
+
     bool    doCompileAndLink(const QString &filedata, const QStringList &incs, const QString &libs,
                              const QString &proextra, int *retcode = 0);
     bool    checkHeader(const QString &path, const QString &h);
@@ -103,6 +126,29 @@ public:
     bool findFooConfig(const QString &path, QString *version, QStringList *incs, QString *libs, QString *otherflags);
     bool findPkgConfig(const QString &name, VersionMode mode, const QString &req_version, QString *version,
                        QStringList *incs, QString *libs, QString *otherflags);
+    bool findQtModule(const QString &name, QString *version);
+
+    // whether each of headers can be included, with incs added to the
+    // include path.  this takes a single run of the preprocessor, which is
+    // much cheaper than a checkHeader or findHeader for each one.
+    QList<bool> checkHeaders(const QStringList &headers, const QStringList &incs = QStringList());
+
+    // whether each of functions links, with incs and libs added, also
+    // adding HAVE_<FUNCTION> for those that do.  they are linked all at
+    // once, and a set that fails is split in two until the missing ones
+    // are found, so a few missing ones only cost a few more links.
+    QList<bool> checkFunctions(const QStringList &functions, const QStringList &incs = QStringList(),
+                               const QString &libs = QString());
+
+    // what the compiler predefines, and the target it builds for, from a
+    // snapshot taken once per run and kept in the probe cache.  all of
+    // them are empty if the compiler can't tell, as with cl.
+    bool    hasMacro(const QString &name);
+    QString macroValue(const QString &name);
+    QString compilerId();      // gcc, clang, icc or msvc
+    QString compilerVersion(); // like 12.2.0
+    QString cxxStandard();     // the default, like c++17
+    QString targetTriple();    // like x86_64-linux-gnu
 
     void addDefine(const QString &str);
     void addLib(const QString &str);
@@ -114,6 +160,8 @@ private:
 
     friend class ConfObj;
     void added(ConfObj *o);
+    bool execSerial(const QList<ConfObj *> &order, QMap<ConfObj *, QcCheckOutput> *outputs,
+                    QMap<QString, qint64> *durations);
 };
 
 #endif
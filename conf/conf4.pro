@@ -7,3 +7,8 @@ DESTDIR  = $$PWD
 HEADERS += conf4.h
 SOURCES += conf4.cpp
 
+# for the remote probe cache
+greaterThan(QT_MAJOR_VERSION, 4):qtHaveModule(network) {
+	QT += network
+	DEFINES += QC_HAVE_NETWORK
+}
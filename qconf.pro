@@ -41,6 +41,16 @@ isEmpty(LDFLAGS) {
 
 RESOURCES += src/qconf.qrc
 
+# native configexe stub, used for configure.bin
+unix {
+	configexe_stub.target = $$PWD/src/configexe/configexe_stub
+	configexe_stub.depends = $$PWD/src/configexe/configexe.c $$PWD/src/configexe/embed.c $$PWD/src/configexe/embed.h
+	configexe_stub.commands = $$QMAKE_CC -O2 -o $$configexe_stub.target $$PWD/src/configexe/embed.c $$PWD/src/configexe/configexe.c
+	QMAKE_EXTRA_TARGETS += configexe_stub
+	PRE_TARGETDEPS += $$configexe_stub.target
+	QMAKE_CLEAN += $$configexe_stub.target
+}
+
 # install
 # we check for empty BINDIR here in case we're debugging with configexe on unix
 !isEmpty(BINDIR):!isEmpty(DATADIR) {
@@ -50,4 +60,10 @@ RESOURCES += src/qconf.qrc
 	libfiles.path = $$DATADIR/qconf
 	libfiles.files = $$IN_PWD/conf $$IN_PWD/modules
 	INSTALLS += libfiles
+	unix {
+		stubfile.path = $$DATADIR/qconf
+		stubfile.files = $$IN_PWD/src/configexe/configexe_stub
+		stubfile.CONFIG += no_check_exist executable
+		INSTALLS += stubfile
+	}
 }
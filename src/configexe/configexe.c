@@ -12,8 +12,10 @@ preserved.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
-//#include <unistd.h>
+#include <ctype.h>
 #include <limits.h>
+#include <time.h>
+#include <signal.h>
 #include "embed.h"
 
 #if defined(WIN32) || defined(_WIN32)
@@ -22,19 +24,33 @@ preserved.
 
 #ifdef QC_OS_WIN
 #include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/wait.h>
 #endif
 
+// the scratch dir of this run, see make_qconftemp
+static char *qconftemp_path = NULL;
+
 #ifdef QC_OS_WIN
-static char *qconftemp_path = "qconftemp";
 static char path_separator = ';';
+static char *bin_subdir = "\\bin";
+static char *qtdir_var = "%QTDIR%";
 #else
-static char *qconftemp_path = ".qconftemp";
 static char path_separator = ':';
+static char *bin_subdir = "/bin";
+static char *qtdir_var = "$QTDIR";
 #endif
 
 static int qc_verbose = 0;
+static int qc_timeout = 0; // seconds a query may take, 0 for no limit
 static char *ex_qtdir = NULL;
 static char *qc_qtselect = NULL;
+static char *qc_site = NULL; // the site file, if any
 static char *qtsearchtext="4 or 5";
 
 static char *prefix = NULL;
@@ -43,7 +59,7 @@ static char *includedir = NULL;
 static char *libdir = NULL;
 static char *datadir = NULL;
 
-static int run_buffer_stdout(const char *command, char *out_buf, size_t buf_size);
+static int run_buffer_stdout(char **argv, char *out_buf, size_t buf_size);
 
 enum ArgType
 {
@@ -62,7 +78,7 @@ typedef struct qcarg
 typedef struct qcfile
 {
 	char *name;
-	unsigned char *data;
+	const unsigned char *data;
 	unsigned int size;
 } qcfile_t;
 
@@ -82,6 +98,8 @@ typedef struct qcdata
 	char *qtinfo;
 } qcdata_t;
 
+static void qcdata_delete(qcdata_t *q);
+
 static char *alloc_str(const unsigned char *src, int len)
 {
 	char *out;
@@ -158,77 +176,128 @@ static char *append_free(char *in, const char *add)
 	return out;
 }
 
-// FIXME: handle bad data, don't malloc 0, etc
-static qcdata_t *parse_data(unsigned char *data, unsigned int size)
+typedef struct qcreader
 {
-	unsigned char *p;
-	qcdata_t *q;
-	unsigned int len;
-	int n;
+	const unsigned char *p;
+	const unsigned char *end;
+	int ok;
+} qcreader_t;
+
+static unsigned int reader_read32(qcreader_t *r)
+{
+	unsigned int out;
 
-	(void)size;
+	if(!r->ok || r->end - r->p < 4)
+	{
+		r->ok = 0;
+		return 0;
+	}
+	out = read32(r->p);
+	r->p += 4;
+	return out;
+}
 
-	q = (qcdata_t *)malloc(sizeof(qcdata_t));
-	p = data;
-	len = read32(p);
-	p += 4;
-	q->usage = alloc_str(p, len);
-	p += len;
+// returns pointer to the next len bytes and skips over them
+static const unsigned char *reader_take(qcreader_t *r, unsigned int len)
+{
+	const unsigned char *out;
 
-	q->args_count = read32(p);
-	p += 4;
-	q->args = (qcarg_t *)malloc(sizeof(qcarg_t) * q->args_count);
-	for(n = 0; n < q->args_count; ++n)
+	if(!r->ok || (unsigned int)(r->end - r->p) < len)
 	{
-		len = read32(p);
-		p += 4;
-		q->args[n].name = alloc_str(p, len);
-		p += len;
+		r->ok = 0;
+		return NULL;
+	}
+	out = r->p;
+	r->p += len;
+	return out;
+}
 
-		len = read32(p);
-		p += 4;
-		q->args[n].envvar = alloc_str(p, len);
-		p += len;
+static char *reader_str(qcreader_t *r)
+{
+	unsigned int len;
+	const unsigned char *p;
+
+	len = reader_read32(r);
+	p = reader_take(r, len);
+	if(!p)
+		return NULL;
+	return alloc_str(p, len);
+}
+
+static qcdata_t *parse_data(const embed_data_t *e)
+{
+	qcreader_t r;
+	qcdata_t *q;
+	unsigned int len;
+	unsigned int at;
+	unsigned int count;
+	int n;
+
+	q = (qcdata_t *)calloc(1, sizeof(qcdata_t));
+
+	r.p = e->datasec;
+	r.end = e->datasec + e->datasec_size;
+	r.ok = 1;
 
-		q->args[n].type = *(p++);
+	q->usage = reader_str(&r);
 
+	// each arg takes at least a byte, so a count past the size is bogus
+	count = reader_read32(&r);
+	if(!r.ok || count > e->datasec_size)
+		goto fail;
+	q->args_count = (int)count;
+	q->args = (qcarg_t *)calloc(q->args_count + 1, sizeof(qcarg_t));
+	for(n = 0; n < q->args_count && r.ok; ++n)
+	{
+		q->args[n].name = reader_str(&r);
+		q->args[n].envvar = reader_str(&r);
+		if(reader_take(&r, 1))
+			q->args[n].type = r.p[-1];
 		q->args[n].val = NULL;
 	}
 
-	q->files_count = read32(p);
-	p += 4;
-	q->files = (qcfile_t *)malloc(sizeof(qcfile_t) * q->files_count);
-	for(n = 0; n < q->files_count; ++n)
+	// the files are found through the toc, just skip over them here
+	n = reader_read32(&r);
+	for(; n > 0 && r.ok; --n)
 	{
-		len = read32(p);
-		p += 4;
-		q->files[n].name = alloc_str(p, len);
-		p += len;
-
-		len = read32(p);
-		p += 4;
-		q->files[n].data = (unsigned char *)malloc(len);
-		memcpy(q->files[n].data, p, len);
-		q->files[n].size = len;
-		p += len;
+		reader_take(&r, reader_read32(&r));
+		reader_take(&r, reader_read32(&r));
 	}
 
-	len = read32(p);
-	p += 4;
-	q->pro_name = alloc_str(p, len);
-	p += len;
-
-	len = read32(p);
-	p += 4;
-	q->pro_file = alloc_str(p, len);
-	p += len;
-
-	len = read32(p);
-	p += 4;
-	q->qtinfo = alloc_str(p, len);
-	p += len;
+	q->pro_name = reader_str(&r);
+	q->pro_file = reader_str(&r);
+	q->qtinfo = reader_str(&r);
+	if(!r.ok)
+		goto fail;
+
+	// toc entries are:
+	//    <uint32 size> <name> <uint32 datasec offset> <uint32 size>
+	r.p = e->toc;
+	r.end = e->toc + e->toc_size;
+
+	count = reader_read32(&r);
+	if(!r.ok || count > e->toc_size)
+		goto fail;
+	q->files_count = (int)count;
+	q->files = (qcfile_t *)calloc(q->files_count + 1, sizeof(qcfile_t));
+	for(n = 0; n < q->files_count && r.ok; ++n)
+	{
+		q->files[n].name = reader_str(&r);
+		at = reader_read32(&r);
+		len = reader_read32(&r);
+		if(at > e->datasec_size || len > e->datasec_size - at)
+			r.ok = 0;
+		q->files[n].data = e->datasec + at;
+		q->files[n].size = len;
+	}
+	if(!r.ok)
+		goto fail;
 
 	return q;
+
+fail:
+	qcdata_delete(q);
+	return NULL;
 }
 
 static void qcdata_delete(qcdata_t *q)
@@ -238,24 +307,32 @@ static void qcdata_delete(qcdata_t *q)
 	if(q->usage)
 		free(q->usage);
 
-	for(n = 0; n < q->args_count; ++n)
+	if(q->args)
 	{
-		free(q->args[n].name);
-		free(q->args[n].envvar);
-		if(q->args[n].val)
-			free(q->args[n].val);
+		for(n = 0; n < q->args_count; ++n)
+		{
+			free(q->args[n].name);
+			free(q->args[n].envvar);
+			if(q->args[n].val)
+				free(q->args[n].val);
+		}
+		free(q->args);
 	}
 
-	for(n = 0; n < q->files_count; ++n)
+	// file data points into the mapped executable
+	if(q->files)
 	{
-		free(q->files[n].name);
-		free(q->files[n].data);
+		for(n = 0; n < q->files_count; ++n)
+			free(q->files[n].name);
+		free(q->files);
 	}
 
 	if(q->pro_name)
 		free(q->pro_name);
 	if(q->pro_file)
 		free(q->pro_file);
+	if(q->qtinfo)
+		free(q->qtinfo);
 
 	free(q);
 }
@@ -349,40 +426,103 @@ static int file_exists(const char *path)
 		return 0;
 }
 
-static char *check_qmake_path(const char *qtdir)
+static char *trim_space(char *str)
 {
-	char *str;
+	char *end;
+
+	while(*str == ' ' || *str == '\t')
+		++str;
+	end = str + strlen(str);
+	while(end > str && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+		--end;
+	*end = 0;
+	return str;
+}
+
+// the value of key in the site file, or NULL.  it has "key = value"
+//   lines, and the last line for a key wins.
+static char *site_value(const char *key)
+{
+	FILE *fp;
+	char line[4096];
+	char *k, *v;
+	char *out;
+
+	if(!qc_site)
+		return NULL;
+	fp = fopen(qc_site, "r");
+	if(!fp)
+		return NULL;
+
+	out = NULL;
+	while(fgets(line, sizeof(line), fp))
+	{
+		v = strchr(line, '=');
+		if(!v)
+			continue;
+		*v = 0;
+		k = trim_space(line);
+		v = trim_space(v + 1);
+		if(strcmp(k, key) != 0 || !*v)
+			continue;
+		if(out)
+			free(out);
+		out = strdup(v);
+	}
+	fclose(fp);
+
+	if(out && qc_verbose)
+		printf("site: %s = %s\n", key, out);
+	return out;
+}
 
-	str = separators_to_native(qtdir);
 #ifdef QC_OS_WIN
-	str = append_free(str, "\\qmake.exe");
+static char *qmake_names[] =
+{
+	"\\qmake.exe",
+	NULL
+};
 #else
-	str = append_free(str, "/qmake");
+// same order as the configure script
+static char *qmake_names[] =
+{
+	"/qmake-qt5",
+	"/qmake5",
+	"/qmake-qt4",
+	"/qmake4",
+	"/qmake",
+	NULL
+};
 #endif
-	if (qc_verbose) {
-		printf("Check if \"%s\" exists\n", str);
-	}
-	if(file_exists(str))
-	{
-		return str;
-	}
-	else
+
+static char *check_qmake_path(const char *qtdir)
+{
+	char *str;
+	int n;
+
+	for(n = 0; qmake_names[n]; ++n)
 	{
+		str = separators_to_native(qtdir);
+		str = append_free(str, qmake_names[n]);
+		if (qc_verbose) {
+			printf("Check if \"%s\" exists\n", str);
+		}
+		if(file_exists(str))
+			return str;
 		free(str);
-		return NULL;
 	}
+	return NULL;
 }
 
 static int qmake_query(const char *qmake_path, const char *var, char *out_buf, size_t buf_size)
 {
-	char command[PATH_MAX];
-	int cnt = snprintf(command, sizeof(command) - 1, "%s -query %s", qmake_path, var);
-	if (cnt > 0 && cnt < (int)sizeof(command))
-	{
-		command[sizeof(command) - 1] = '\0'; // To be sure line has null-terminator
-		return run_buffer_stdout(command, out_buf, buf_size);
-	}
-	return 0; // fail
+	char *argv[4];
+
+	argv[0] = (char *)qmake_path;
+	argv[1] = "-query";
+	argv[2] = (char *)var;
+	argv[3] = NULL;
+	return run_buffer_stdout(argv, out_buf, buf_size);
 }
 
 static int qmake_query_maj_ver(const char *qmake_path, char *out_buf, size_t buf_size)
@@ -470,7 +610,7 @@ static char *find_qmake()
 	qtdir = ex_qtdir;
 	if(qtdir)
 	{
-		qtdir = append_free(strdup(qtdir), "\\bin");
+		qtdir = append_free(strdup(qtdir), bin_subdir);
 		path = check_qmake_path(qtdir);
 		free(qtdir);
 
@@ -488,7 +628,7 @@ static char *find_qmake()
 	qtdir = get_envvar("QTDIR");
 	if(qtdir)
 	{
-		qtdir = append_free(strdup(qtdir), "\\bin");
+		qtdir = append_free(strdup(qtdir), bin_subdir);
 		path = check_qmake_path(qtdir);
 		free(qtdir);
 
@@ -501,7 +641,7 @@ static char *find_qmake()
 		try_syspath = 0;
 	}
 	if(qc_verbose)
-		printf("Warning: qmake not found via %%QTDIR%%\n");
+		printf("Warning: qmake not found via %s\n", qtdir_var);
 
 	/* if not set explicitly try something implicit */
 	if (try_syspath) {
@@ -533,16 +673,43 @@ static char *find_qmake()
 	return NULL;
 }
 
-static int run_buffer_stdout(const char *command, char *out_buf, size_t buf_size)
+// where the output of a spawned command goes
+enum OutputMode
+{
+	OutputKeep,      // our own stdout/stderr
+	OutputSilent,    // stdout is discarded
+	OutputSilentAll, // stdout and stderr are discarded
+	OutputConfLog    // stdout and stderr go to conf.log in the scratch dir
+};
+
+#ifdef QC_OS_WIN
+static char *join_args(char **argv)
+{
+	char *str;
+	int n;
+
+	str = strdup(argv[0]);
+	for(n = 1; argv[n]; ++n)
+	{
+		str = append_free(str, " ");
+		str = append_free(str, argv[n]);
+	}
+	return str;
+}
+
+static int run_buffer_stdout(char **argv, char *out_buf, size_t buf_size)
 {
 	FILE *file;
+	char *command;
 
+	command = join_args(argv);
 	file = popen(command, "r");
+	free(command);
 	if (file)
 	{
 		size_t bytes_left = buf_size - 1; // 1 for null terminator
 		size_t bytes_read;
-		while (bytes_left && (bytes_read = fread(out_buf, 1, bytes_left, file)) > 0)
+		while (bytes_left && (bytes_read = fread(out_buf + (buf_size - 1 - bytes_left), 1, bytes_left, file)) > 0)
 			bytes_left -= bytes_read;
 
 		out_buf[buf_size - bytes_left - 1] = '\0';
@@ -555,77 +722,159 @@ static int run_buffer_stdout(const char *command, char *out_buf, size_t buf_size
 	return 0; // fail
 }
 
-static int run_silent_stdout(const char *cmd)
+// returns the exit code of the command, or -1 if it couldn't be run
+static int run_command(char **argv, int output)
 {
 	char *str;
 	int ret;
 
-	str = strdup(cmd);
-#ifdef QC_OS_WIN
-	str = append_free(str, " >NUL");
-#else
-	str = append_free(str, " >/dev/null");
-#endif
+	str = join_args(argv);
+	if(output == OutputSilent)
+		str = append_free(str, " >NUL");
+	else if(output == OutputSilentAll)
+		str = append_free(str, " >NUL 2>&1");
+	else if(output == OutputConfLog)
+		str = append_free(str, " >conf.log 2>&1");
+	if (qc_verbose && output == OutputConfLog)
+		printf("Starting \"%s\"\n", str);
 	ret = system(str);
 	free(str);
 
 	return ret;
 }
-
-static int run_silent_all(const char *cmd)
-{
-	char *str;
-	int ret;
-
-	str = strdup(cmd);
-#ifdef QC_OS_WIN
-	str = append_free(str, " >NUL 2>&1");
 #else
-	str = append_free(str, " >/dev/null 2>&1");
-#endif
-	ret = system(str);
-	free(str);
+// forks and execs argv directly, no shell involved.  the child's stdout
+//   and stderr are redirected to out_fd and err_fd unless they are -1.
+//   with new_group, the child gets a process group of its own, so that
+//   everything it starts can be killed along with it.
+static pid_t spawn(char **argv, int out_fd, int err_fd, int new_group)
+{
+	pid_t pid;
 
-	return ret;
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if(pid == 0)
+	{
+		if(new_group)
+			setpgid(0, 0);
+		if(out_fd != -1)
+			dup2(out_fd, 1);
+		if(err_fd != -1)
+			dup2(err_fd, 2);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	return pid;
 }
 
-static int run_conflog_all(const char *cmd)
+static int wait_exit_code(pid_t pid)
 {
-	char *str;
-	int ret;
+	int status;
 
-	str = strdup(cmd);
-#ifdef QC_OS_WIN
-	str = append_free(str, " >..\\conf.log 2>&1");
-#else
-	str = append_free(str, " >../conf.log 2>&1");
-#endif
-	if (qc_verbose)
-		printf("Starting \"%s\"\n", str);
-	ret = system(str);
-	free(str);
-
-	return ret;
+	while(waitpid(pid, &status, 0) == -1)
+	{
+		if(errno != EINTR)
+			return -1;
+	}
+	if(!WIFEXITED(status))
+		return -1;
+	return WEXITSTATUS(status);
 }
 
-static int qc_ensuredir(const char *path)
+// the command is killed if it takes longer than --timeout
+static int run_buffer_stdout(char **argv, char *out_buf, size_t buf_size)
 {
-#ifdef QC_OS_WIN
-	if(_mkdir(path) == 0)
-		return 1;
-	else if(errno == EEXIST)
-		return 1;
-	else
+	int fds[2];
+	pid_t pid;
+	size_t at;
+	ssize_t ret;
+	char discard[256];
+	time_t end;
+	struct pollfd p;
+	int left;
+
+	out_buf[0] = 0; // just in case
+	if(pipe(fds) != 0)
 		return 0;
-#else
-	if(mkdir(path, S_IRWXU | S_IRWXG) == 0)
-		return 1;
-	else if(errno == EEXIST)
-		return 1;
-	else
+	pid = spawn(argv, fds[1], -1, 1);
+	close(fds[1]);
+	if(pid == -1)
+	{
+		close(fds[0]);
 		return 0;
-#endif
+	}
+
+	end = time(NULL) + qc_timeout;
+	at = 0;
+	while(1)
+	{
+		if(qc_timeout > 0)
+		{
+			left = (int)(end - time(NULL));
+			p.fd = fds[0];
+			p.events = POLLIN;
+			p.revents = 0;
+			ret = left > 0 ? poll(&p, 1, left * 1000) : 0;
+			if(ret == -1 && errno == EINTR)
+				continue;
+			if(ret == 0)
+			{
+				kill(-pid, SIGKILL);
+				kill(pid, SIGKILL);
+				close(fds[0]);
+				wait_exit_code(pid);
+				printf("\"%s\" timed out after %d seconds\n", argv[0], qc_timeout);
+				return 0;
+			}
+		}
+
+		// keep draining after the buffer is full so the child can't block
+		if(at < buf_size - 1)
+			ret = read(fds[0], out_buf + at, buf_size - 1 - at);
+		else
+			ret = read(fds[0], discard, sizeof(discard));
+		if(ret == -1 && errno == EINTR)
+			continue;
+		if(ret <= 0)
+			break;
+		if(at < buf_size - 1)
+			at += ret;
+	}
+	out_buf[at] = '\0';
+	close(fds[0]);
+
+	if(wait_exit_code(pid) != 0)
+		return 0; // fail
+
+	return 1; // ok
+}
+
+// returns the exit code of the command, or -1 if it couldn't be run
+static int run_command(char **argv, int output)
+{
+	int fd;
+	pid_t pid;
+
+	fd = -1;
+	if(output == OutputSilent || output == OutputSilentAll)
+		fd = open("/dev/null", O_WRONLY);
+	else if(output == OutputConfLog)
+		fd = open("conf.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(output != OutputKeep && fd == -1)
+		return -1;
+
+	if (qc_verbose && output == OutputConfLog)
+		printf("Starting \"%s\"\n", argv[0]);
+	pid = spawn(argv, fd, output == OutputSilent ? -1 : fd, 0);
+	if(fd != -1)
+		close(fd);
+	if(pid == -1)
+		return -1;
+
+	return wait_exit_code(pid);
 }
+#endif
 
 static int qc_chdir(const char *path)
 {
@@ -645,32 +894,112 @@ static int qc_chdir(const char *path)
 
 static int qc_removedir(const char *path)
 {
-	char *str;
+#ifdef QC_OS_WIN
+	char *argv[5];
 	int ret;
 
-#ifdef QC_OS_WIN
-	str = strdup("deltree /y ");
-	str = append_free(str, path);
-	ret = run_silent_all(str);
-	free(str);
+	argv[0] = "deltree";
+	argv[1] = "/y";
+	argv[2] = (char *)path;
+	argv[3] = NULL;
+	ret = run_command(argv, OutputSilentAll);
 	if(ret != 0)
 	{
-		str = strdup("rmdir /s /q ");
-		str = append_free(str, path);
-		ret = run_silent_all(str);
-		free(str);
+		argv[0] = "rmdir";
+		argv[1] = "/s";
+		argv[2] = "/q";
+		argv[3] = (char *)path;
+		argv[4] = NULL;
+		ret = run_command(argv, OutputSilentAll);
 	}
-#else
-	str = strdup("rm -rf ");
-	str = append_free(str, path);
-	ret = system(str);
-	free(str);
-#endif
 
 	if(ret == 0)
 		return 1;
 	else
 		return 0;
+#else
+	DIR *dir;
+	struct dirent *ent;
+	struct stat buf;
+	char *str;
+	int ok;
+
+	dir = opendir(path);
+	if(!dir)
+		return 0;
+	ok = 1;
+	while((ent = readdir(dir)))
+	{
+		if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+		str = append_free(append_str(path, "/"), ent->d_name);
+		if(lstat(str, &buf) == 0 && S_ISDIR(buf.st_mode))
+		{
+			if(!qc_removedir(str))
+				ok = 0;
+		}
+		else if(unlink(str) != 0)
+			ok = 0;
+		free(str);
+	}
+	closedir(dir);
+	if(rmdir(path) != 0)
+		ok = 0;
+
+	return ok;
+#endif
+}
+
+static void print_file(const char *path)
+{
+	FILE *fp;
+	char buf[4096];
+	size_t size;
+
+	fp = fopen(path, "r");
+	if(!fp)
+		return;
+	while((size = fread(buf, 1, sizeof(buf), fp)) > 0)
+		fwrite(buf, 1, size, stdout);
+	fclose(fp);
+}
+
+// the log of building conf stays in the scratch dir, so that configures
+//   running at the same time don't write to the same file.  it is only
+//   copied out when the build failed, and renamed into place so that
+//   conf.log is never half written.
+static void keep_conf_log()
+{
+	char *from, *tmp;
+	FILE *in, *out;
+	char buf[4096];
+	size_t size;
+	int ok;
+
+	from = strdup(qconftemp_path);
+	from = append_free(from, "/conf.log");
+	tmp = strdup(qconftemp_path);
+	tmp = append_free(tmp, ".log");
+	in = fopen(from, "rb");
+	out = in ? fopen(tmp, "wb") : NULL;
+	ok = in && out;
+	while(ok && (size = fread(buf, 1, sizeof(buf), in)) > 0)
+		ok = fwrite(buf, 1, size, out) == size;
+	if(in)
+		fclose(in);
+	if(out && fclose(out) != 0)
+		ok = 0;
+	if(ok)
+	{
+#ifdef QC_OS_WIN
+		remove("conf.log");
+#endif
+		ok = rename(tmp, "conf.log") == 0;
+	}
+	if(!ok)
+		remove(tmp);
+	free(from);
+	free(tmp);
 }
 
 static int gen_file(qcdata_t *q, const char *name, const char *dest)
@@ -718,17 +1047,16 @@ static int gen_files(qcdata_t *q, const char *dest)
 
 static int try_make(const char *makecmd, char **maketool)
 {
-	char *str;
-	int ret;
+	char *argv[3];
 
-	str = strdup(makecmd);
-	str = append_free(str, " clean");
-	ret = run_conflog_all(str);
-	free(str);
-	if(ret != 0)
+	argv[0] = (char *)makecmd;
+	argv[1] = "clean";
+	argv[2] = NULL;
+	if(run_command(argv, OutputConfLog) != 0)
 		return 0;
 
-	if(run_conflog_all(makecmd) != 0) {
+	argv[1] = NULL;
+	if(run_command(argv, OutputConfLog) != 0) {
 		if (qc_verbose)
 			printf("\"%s\" failed\n", makecmd);
 		return 0;
@@ -738,6 +1066,7 @@ static int try_make(const char *makecmd, char **maketool)
 	return 1;
 }
 
+#ifdef QC_OS_WIN
 static char *maketool_list_common[] =
 {
 	"mingw32-make",
@@ -760,15 +1089,73 @@ static char *maketool_list_vs[] =
 	"nmake",
 	NULL
 };
+#else
+static char *maketool_list_common[] =
+{
+	"gmake",
+	"make",
+	NULL
+};
+#endif
+
+static void cleanup_qconftemp()
+{
+	if(!qconftemp_path)
+		return;
+	qc_removedir(qconftemp_path);
+	free(qconftemp_path);
+	qconftemp_path = NULL;
+}
+
+static void cleanup_qconftemp_on_signal(int sig)
+{
+	cleanup_qconftemp();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+// every run gets a scratch dir of its own, so that several configures can
+//   run at once in the same dir.  it is removed however we exit, and the
+//   conf program gets it through QC_TMPDIR.
+static int make_qconftemp()
+{
+#ifdef QC_OS_WIN
+	char buf[64];
+	int n;
+
+	for(n = 0; n < 100; ++n)
+	{
+		sprintf(buf, "qconftemp.%d.%d", _getpid(), n);
+		if(_mkdir(buf) == 0)
+			break;
+		if(errno != EEXIST)
+			return 0;
+	}
+	if(n == 100)
+		return 0;
+#else
+	char buf[] = ".qconftemp.XXXXXX";
+
+	if(!mkdtemp(buf))
+		return 0;
+#endif
+	qconftemp_path = strdup(buf);
+	atexit(cleanup_qconftemp);
+	signal(SIGINT, cleanup_qconftemp_on_signal);
+	signal(SIGTERM, cleanup_qconftemp_on_signal);
+	set_envvar("QC_TMPDIR", qconftemp_path);
+	return 1;
+}
 
 static int do_conf_create(qcdata_t *q, const char *qmake_path, const char *spec, char **maketool)
 {
-	char *str;
+	char *argv[3];
 	int n;
 	int at;
 	char **maketool_list;
+	char *site_list[2];
 
-	if(!qc_ensuredir(qconftemp_path))
+	if(!make_qconftemp())
 		return 0;
 
 	if(!gen_files(q, qconftemp_path))
@@ -778,24 +1165,32 @@ static int do_conf_create(qcdata_t *q, const char *qmake_path, const char *spec,
 		return 0;
 
 	// TODO: support -spec once QC_MAKESPEC matters
-	str = strdup(qmake_path);
-	str = append_free(str, " conf4.pro");
-	if(run_silent_stdout(str) != 0)
+	argv[0] = (char *)qmake_path;
+	argv[1] = "conf4.pro";
+	argv[2] = NULL;
+	if(run_command(argv, OutputSilent) != 0)
 	{
-		free(str);
 		qc_chdir("..");
 		return 0;
 	}
-	free(str);
 
 	at = -1;
-	if (strstr(spec, "win32-msvc")) {
+#ifdef QC_OS_WIN
+	if (spec && strstr(spec, "win32-msvc")) {
 		maketool_list = maketool_list_vs;
-	} else if(strstr(spec, "win32-g++")) {
+	} else if(spec && strstr(spec, "win32-g++")) {
 		maketool_list = maketool_list_mingw;
 	} else {
 		maketool_list = maketool_list_common;
 	}
+#else
+	(void)spec;
+	maketool_list = maketool_list_common;
+#endif
+	site_list[0] = site_value("make");
+	site_list[1] = NULL;
+	if(site_list[0])
+		maketool_list = site_list;
 	for(n = 0; maketool_list[n]; ++n)
 	{
 		if(qc_verbose)
@@ -808,6 +1203,8 @@ static int do_conf_create(qcdata_t *q, const char *qmake_path, const char *spec,
 	}
 
 	qc_chdir("..");
+	if(site_list[0])
+		free(site_list[0]);
 	if(at == -1)
 		return 0;
 
@@ -816,23 +1213,21 @@ static int do_conf_create(qcdata_t *q, const char *qmake_path, const char *spec,
 
 static int do_conf_run()
 {
-	char *str, *npath;
+	char *argv[2];
+	char *str;
 	int ret;
 
 	str = strdup(qconftemp_path);
 	str = append_free(str, "/conf");
-	npath = separators_to_native(str);
+	argv[0] = separators_to_native(str);
+	argv[1] = NULL;
 	free(str);
-	ret = system(npath);
-	free(npath);
+	ret = run_command(argv, OutputKeep);
+	free(argv[0]);
 
 	return ret;
 }
 
-static void cleanup_qconftemp()
-{
-	qc_removedir(qconftemp_path);
-}
 
 static void try_print_var(const char *var, const char *val)
 {
@@ -848,6 +1243,7 @@ static int do_conf(qcdata_t *q, const char *argv0)
 	char *maketool;
 	int qt_maj_version = 0;
 	char *specs_name = NULL;
+	char *site_spec;
 	int n;
 	int ret;
 
@@ -866,7 +1262,12 @@ static int do_conf(qcdata_t *q, const char *argv0)
 	if(qc_verbose)
 		printf("\n");
 
-	qmake_path = find_qmake();
+	// what is given on the command line or in the environment comes
+	//   before the site file
+	qmake_path = ex_qtdir ? NULL : site_value("qmake");
+	site_spec = get_envvar("QMAKESPEC") ? NULL : site_value("qmakespec");
+	if(!qmake_path)
+		qmake_path = find_qmake();
 	if(!qmake_path)
 	{
 		if(qc_verbose)
@@ -882,7 +1283,9 @@ static int do_conf(qcdata_t *q, const char *argv0)
 	if(qc_verbose)
 		printf("qmake found in %s\n", qmake_path);
 
-	// figure out what version it is.
+	// figure out what version it is, unless the site file says what it
+	//   was needed for
+	if(!site_spec)
 	{
 		char buf[20]; // version string output always small
 		if (qmake_query_maj_ver(qmake_path, buf, sizeof(buf))) {
@@ -902,6 +1305,12 @@ static int do_conf(qcdata_t *q, const char *argv0)
 	}
 
 	// find specc name
+	if(site_spec)
+	{
+		specs_name = site_spec;
+		set_envvar("QC_QMAKESPEC", specs_name);
+	}
+	else
 	{
 		char *spec = get_envvar("QMAKESPEC");
 		if (!spec) {
@@ -948,10 +1357,10 @@ static int do_conf(qcdata_t *q, const char *argv0)
 	//   overriding the makespec to (if any).  since at this time we don't
 	//   ever override the makespec on windows, we don't need this yet.
 
-	cleanup_qconftemp();
 	maketool = NULL;
 	if(!do_conf_create(q, qmake_path, specs_name, &maketool))
 	{
+		keep_conf_log();
 		cleanup_qconftemp();
 		if(qc_verbose)
 			printf(" -> fail\n");
@@ -965,7 +1374,7 @@ static int do_conf(qcdata_t *q, const char *argv0)
 		if(qc_verbose)
 		{
 			printf("conf.log:\n");
-			system("type conf.log");
+			print_file("conf.log");
 		}
 
 		free(qmake_path);
@@ -1015,25 +1424,24 @@ static int do_conf(qcdata_t *q, const char *argv0)
 
 int main(int argc, char **argv)
 {
-	unsigned char *data;
-	unsigned int size;
+	embed_data_t e;
 	qcdata_t *q;
 	int n;
 	int at;
 	int quit;
 	char *arg, *var, *val;
 
-	if(!embed_get_data(argv[0], &data, &size))
+	if(!embed_open(argv[0], &e))
 	{
 		fprintf(stderr, "Error: Can't import data.\n");
 		return 1;
 	}
 
-	q = parse_data(data, size);
+	q = parse_data(&e);
 	if(!q)
 	{
 		fprintf(stderr, "Error: Can't parse internal data.\n");
-		free(data);
+		embed_close(&e);
 		return 1;
 	}
 
@@ -1103,6 +1511,52 @@ int main(int argc, char **argv)
 			if (val && strlen(val))
 				qc_qtselect = parse_qtselect(val);
 		}
+		else if(strcmp(var, "timeout") == 0)
+		{
+			if(val)
+			{
+				qc_timeout = atoi(val);
+				set_envvar("QC_TIMEOUT", val);
+			}
+		}
+		else if(strcmp(var, "deadline") == 0)
+		{
+			if(val)
+			{
+				// the conf program gets the absolute time
+				char buf[32];
+				sprintf(buf, "%ld", (long)time(NULL) + atol(val));
+				set_envvar("QC_DEADLINE_AT", buf);
+			}
+		}
+		else if(strcmp(var, "variants") == 0)
+		{
+			if(val)
+				set_envvar("QC_VARIANTS", val);
+		}
+		else if(strcmp(var, "service") == 0)
+		{
+			set_envvar("QC_SERVICE", "Y");
+		}
+		else if(strcmp(var, "record") == 0)
+		{
+			if(val)
+				set_envvar("QC_RECORD", val);
+		}
+		else if(strcmp(var, "replay") == 0)
+		{
+			if(val)
+				set_envvar("QC_REPLAY", val);
+		}
+		else if(strcmp(var, "site") == 0)
+		{
+			if(val)
+			{
+				if(qc_site)
+					free(qc_site);
+				qc_site = strdup(val);
+			}
+		}
 		else
 		{
 			at = find_arg(q->args, q->args_count, var);
@@ -1141,6 +1595,7 @@ int main(int argc, char **argv)
 	if(quit)
 	{
 		qcdata_delete(q);
+		embed_close(&e);
 		if(ex_qtdir)
 			free(ex_qtdir);
 
@@ -1161,10 +1616,38 @@ int main(int argc, char **argv)
 
 		if(datadir)
 			free(datadir);
+
+		if(qc_site)
+			free(qc_site);
 		
 		return 1;
 	}
 
+	// the site file is also read by conf
+	if(!qc_site && get_envvar("QC_SITE") && *get_envvar("QC_SITE"))
+		qc_site = strdup(get_envvar("QC_SITE"));
+	if(!qc_site && file_exists("qconf.site"))
+		qc_site = strdup("qconf.site");
+	if(qc_site)
+	{
+		FILE *fp = fopen(qc_site, "r");
+		if(!fp)
+		{
+			fprintf(stderr, "Error: Can't read the site file %s.\n", qc_site);
+			qcdata_delete(q);
+			embed_close(&e);
+			return 1;
+		}
+		fclose(fp);
+		set_envvar("QC_SITE", qc_site);
+	}
+
+#ifndef QC_OS_WIN
+	// same default as the configure script
+	if(!prefix && find_arg(q->args, q->args_count, "prefix") != -1)
+		prefix = strdup("/usr/local");
+#endif
+
 	if(prefix)
 	{
 		set_envvar("PREFIX", prefix);
@@ -1198,6 +1681,7 @@ int main(int argc, char **argv)
 
 	n = do_conf(q, argv[0]);
 	qcdata_delete(q);
+	embed_close(&e);
 	if(ex_qtdir)
 		free(ex_qtdir);
 
@@ -1219,6 +1703,9 @@ int main(int argc, char **argv)
 	if(datadir)
 		free(datadir);
 
+	if(qc_site)
+		free(qc_site);
+
 	if(n)
 		return 0;
 	else
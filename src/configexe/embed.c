@@ -15,52 +15,30 @@ preserved.
 #if defined(WIN32) || defined(_WIN32)
 # define QC_OS_WIN
 # include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
 #endif
 
-// this hash stuff is total overkill but i was bored
+// the appended data looks like this:
+//
+//    <stub> <blocksig> <uint32 size> <datasec> <toc> <trailer>
+//
+// the blocksig and size are only there for older stubs, which locate
+//   the data section by scanning the whole executable for the blocksig.
+//   we read the fixed-size trailer at the end of the file instead:
+//
+//    "QCONFEXE" <uint32 version> <uint32 datasec offset> <uint32 datasec size>
+//    <uint32 toc offset> <uint32 toc size> <uint32 checksum>
+//
+// offsets are from the start of the file, and the checksum covers the
+//   datasec and the toc, which are adjacent.
 
-static const char *BLOCKSIG_ID = "QCONF_CONFIGWIN_BLOCKSIG";
+static const char *TRAILER_MAGIC = "QCONFEXE";
 
-static unsigned int calc_hash(const char *in, int len)
-{
-	unsigned int x;
-	int n;
-
-	x = 0;
-	for(n = 0; n < len; ++n)
-	{
-		x <<= 4;
-		x ^= (unsigned int)in[n];
-	}
-	return x;
-}
-
-// result should be "QCONF_CONFIGWIN_BLOCKSIG_68b7e7d7"
-//
-// the basic idea here is that we use this string as a marker for our
-//   appended data section, but we don't want to include this actual
-//   string in our code otherwise it could be misinterpretted as the
-//   marker
-static char *blocksig()
-{
-	char *blocksig_data;
-	int idlen;
-	unsigned int hash;
-	char hashstr[9];
-	int n;
-
-	idlen = strlen(BLOCKSIG_ID);
-	hash = calc_hash(BLOCKSIG_ID, idlen);
-	blocksig_data = (char *)malloc(idlen + 1 + 8 + 1);
-	memcpy(blocksig_data, BLOCKSIG_ID, idlen);
-	blocksig_data[idlen] = '_';
-	sprintf(hashstr, "%08x", hash);
-	for(n = 0; n < 8; ++n)
-		blocksig_data[idlen + 1 + n] = hashstr[n];
-	blocksig_data[idlen + 1 + 8] = 0;
-
-	return blocksig_data;
-}
+#define TRAILER_VERSION 1
 
 static char *app_file_path(const char *argv0)
 {
@@ -71,127 +49,161 @@ static char *app_file_path(const char *argv0)
 	module_name[MAX_PATH] = 0;
 	return strdup(module_name);
 #else
+	char buf[4096];
+	ssize_t len;
+
+	// argv0 isn't reliable when we are started through PATH
+	len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+	if(len > 0)
+	{
+		buf[len] = 0;
+		return strdup(buf);
+	}
 	return strdup(argv0);
 #endif
 }
 
-static int find_partial(const char *in, int in_size, const char *sub, int sub_size)
+unsigned int read32(const unsigned char *in)
 {
-	int n;
-	int size;
+	unsigned int out = in[0];
+	out <<= 8;
+	out += in[1];
+	out <<= 8;
+	out += in[2];
+	out <<= 8;
+	out += in[3];
+	return out;
+}
+
+// 32-bit FNV-1a
+unsigned int embed_checksum(const unsigned char *in, unsigned int size)
+{
+	unsigned int x;
+	unsigned int n;
 
-	for(n = 0; n < in_size; ++n)
+	x = 2166136261u;
+	for(n = 0; n < size; ++n)
 	{
-		if(sub_size < in_size - n)
-			size = sub_size;
-		else
-			size = in_size - n;
-		if(memcmp(in + n, sub, size) == 0)
-			return n;
+		x ^= in[n];
+		x *= 16777619u;
 	}
-
-	return -1;
+	return x;
 }
 
-static int seek_string(FILE *fp, const char *str)
+static void *map_file(const char *fname, unsigned int *ret_size)
 {
-	char block[8192];
-	int str_at;
-	int str_len;
-	int size;
-	int ret;
-	int pos;
-
-	str_len = strlen(str);
-	str_at = 0;
-	pos = ftell(fp);
-	while(!feof(fp))
+#ifdef QC_OS_WIN
+	HANDLE file;
+	HANDLE mapping;
+	DWORD size;
+	void *base;
+
+	file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return NULL;
+	size = GetFileSize(file, NULL);
+	if(size == INVALID_FILE_SIZE || size < EMBED_TRAILER_SIZE)
 	{
-		size = fread(block, 1, 8192, fp);
-		if(size < 1)
-			break;
-
-		ret = find_partial(block, size, str + str_at, str_len - str_at);
-		if(ret != -1)
-		{
-			if(str_at + (size - ret) >= str_len)
-			{
-				if(fseek(fp, pos + ret - str_at + str_len, SEEK_SET) != 0)
-					return 0;
-
-				return 1;
-			}
-			else
-				str_at += (size - ret);
-		}
-
-		pos += size;
+		CloseHandle(file);
+		return NULL;
 	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(!mapping)
+		return NULL;
+	// the view keeps the mapping alive
+	base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(!base)
+		return NULL;
 
-	return 0;
+	*ret_size = size;
+	return base;
+#else
+	int fd;
+	struct stat buf;
+	void *base;
+
+	fd = open(fname, O_RDONLY);
+	if(fd == -1)
+		return NULL;
+	if(fstat(fd, &buf) != 0 || buf.st_size < EMBED_TRAILER_SIZE || buf.st_size > 0xffffffffL)
+	{
+		close(fd);
+		return NULL;
+	}
+	base = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+		return NULL;
+
+	*ret_size = buf.st_size;
+	return base;
+#endif
 }
 
-unsigned int read32(const unsigned char *in)
+static void unmap_file(void *base, unsigned int size)
 {
-	unsigned int out = in[0];
-	out <<= 8;
-	out += in[1];
-	out <<= 8;
-	out += in[2];
-	out <<= 8;
-	out += in[3];
-	return out;
+#ifdef QC_OS_WIN
+	(void)size;
+	UnmapViewOfFile(base);
+#else
+	munmap(base, size);
+#endif
 }
 
-// format is:
-//    <blocksig> <uint32 size> <data....>
-
-static int import_data(const char *argv0, const char *sig, unsigned char **ret_data, unsigned int *ret_size)
+int embed_open(const char *argv0, embed_data_t *e)
 {
 	char *fname;
-	FILE *fp;
-	int ret;
-	unsigned char buf[4];
+	const unsigned char *base;
+	const unsigned char *p;
 	unsigned int size;
-	unsigned char *data;
+	unsigned int datasec_at, datasec_size, toc_at, toc_size;
+
+	memset(e, 0, sizeof(embed_data_t));
 
 	fname = app_file_path(argv0);
 	if(!fname)
 		return 0;
-	fp = fopen(fname, "rb");
-	if(!fp)
-		return 0;
-	if(!seek_string(fp, sig))
-		return 0;
-	ret = fread(buf, 4, 1, fp);
-	if(ret < 1)
-		return 0;
-	size = read32(buf);
-	data = (unsigned char *)malloc(size);
-	if(!data)
+	e->map_base = map_file(fname, &e->map_size);
+	free(fname);
+	if(!e->map_base)
 		return 0;
-	ret = fread(data, size, 1, fp);
-	if(ret < 1)
-	{
-		free(data);
-		return 0;
-	}
-	fclose(fp);
 
-	*ret_data = data;
-	*ret_size = size;
+	base = (const unsigned char *)e->map_base;
+	size = e->map_size;
+	p = base + size - EMBED_TRAILER_SIZE;
+	if(memcmp(p, TRAILER_MAGIC, 8) != 0 || read32(p + 8) != TRAILER_VERSION)
+		goto fail;
+
+	datasec_at = read32(p + 12);
+	datasec_size = read32(p + 16);
+	toc_at = read32(p + 20);
+	toc_size = read32(p + 24);
+
+	// everything must lie before the trailer, with the toc right after
+	//   the datasec
+	if(datasec_at > size - EMBED_TRAILER_SIZE || datasec_size > size - EMBED_TRAILER_SIZE - datasec_at)
+		goto fail;
+	if(toc_at != datasec_at + datasec_size || toc_size > size - EMBED_TRAILER_SIZE - toc_at)
+		goto fail;
+	if(embed_checksum(base + datasec_at, datasec_size + toc_size) != read32(p + 28))
+		goto fail;
+
+	e->datasec = base + datasec_at;
+	e->datasec_size = datasec_size;
+	e->toc = base + toc_at;
+	e->toc_size = toc_size;
 	return 1;
+
+fail:
+	embed_close(e);
+	return 0;
 }
 
-int embed_get_data(const char *argv0, unsigned char **ret_data, unsigned int *ret_size)
+void embed_close(embed_data_t *e)
 {
-	char *sig;
-	int ret;
-
-	sig = blocksig();
-	//printf("%s\n", sig);
-	ret = import_data(argv0, sig, ret_data, ret_size);
-	free(sig);
-
-	return ret;
+	if(e->map_base)
+		unmap_file(e->map_base, e->map_size);
+	memset(e, 0, sizeof(embed_data_t));
 }
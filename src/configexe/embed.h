@@ -9,8 +9,26 @@ preserved.
 #ifndef EMBED_H
 #define EMBED_H
 
+// size of the trailer at the very end of the executable
+#define EMBED_TRAILER_SIZE 32
+
+typedef struct embed_data
+{
+	// both point into the read-only mapping of the executable
+	const unsigned char *datasec;
+	unsigned int datasec_size;
+	const unsigned char *toc;
+	unsigned int toc_size;
+
+	void *map_base;
+	unsigned int map_size;
+} embed_data_t;
+
 unsigned int read32(const unsigned char *in);
 
-int embed_get_data(const char *argv0, unsigned char **ret_data, unsigned int *ret_size);
+unsigned int embed_checksum(const unsigned char *in, unsigned int size);
+
+int embed_open(const char *argv0, embed_data_t *e);
+void embed_close(embed_data_t *e);
 
 #endif
@@ -24,6 +24,11 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#ifdef Q_OS_UNIX
+// for getrusage
+#include <sys/resource.h>
+#endif
+
 #include "stringhelp.h"
 
 #define VERSION "2.0"
@@ -40,42 +45,43 @@ bool looksLikeInPlace(const QString &path)
     return false;
 }
 
-QString escapeFile(const QString &str)
+// these run over every embedded source file and every usage line, so they
+//   reserve room for a few escapes up front instead of growing the output
+//   one character at a time
+
+QString escapeFile(QStringView str)
 {
     QString out;
-    for (int n = 0; n < (int)str.length(); ++n) {
-        if (str[n] == '$' || str[n] == '`' || str[n] == '\\')
+    out.reserve(str.size() + str.size() / 16 + 16);
+    for (QStringView::const_iterator it = str.begin(); it != str.end(); ++it) {
+        if (*it == '$' || *it == '`' || *it == '\\')
             out += '\\';
-        out += str[n];
+        out += *it;
     }
     return out;
 }
 
 QString escapeArg(const QString &str)
 {
-    QString out;
-    for (int n = 0; n < (int)str.length(); ++n) {
-        if (str[n] == '-')
-            out += '_';
-        else
-            out += str[n];
-    }
+    QString out = str;
+    out.replace('-', '_');
     return out;
 }
 
-QString c_escape(const QString &in)
+QString c_escape(QStringView in)
 {
     QString out;
-    for (int n = 0; n < in.length(); ++n) {
-        /*if(in[n] == '\\')
+    out.reserve(in.size() + 16);
+    for (QStringView::const_iterator it = in.begin(); it != in.end(); ++it) {
+        /*if(*it == '\\')
             out += "\\\\";
         else*/
-        if (in[n] == '\"')
+        if (*it == '\"')
             out += "\\\"";
-        else if (in[n] == '\n')
+        else if (*it == '\n')
             out += "\\n";
         else
-            out += in[n];
+            out += *it;
     }
     return out;
 }
@@ -120,8 +126,11 @@ QString formatBlock(const QString &in)
     }
 
     QString str;
-    for (n = 0; n < lines.count(); ++n)
-        str += lines[n] + '\n';
+    str.reserve(in.length() + lines.count());
+    for (n = 0; n < lines.count(); ++n) {
+        str += lines[n];
+        str += '\n';
+    }
     return str;
 }
 
@@ -142,12 +151,28 @@ static QByteArray lenval(const QByteArray &in)
     return out;
 }
 
-static QByteArray embed_file(const QString &name, const QByteArray &data)
+// 32-bit FNV-1a, must match embed_checksum() in the stub
+static quint32 embed_checksum(const QByteArray &in)
 {
-    QByteArray out;
-    out += lenval(name.toLatin1());
-    out += lenval(data);
-    return out;
+    quint32 x = 2166136261u;
+    for (int n = 0; n < in.size(); ++n) {
+        x ^= (quint8)in[n];
+        x *= 16777619u;
+    }
+    return x;
+}
+
+// appends the file to the datasec, and an entry pointing at its data to
+//   the toc, so the stub can find it without walking the datasec
+static void embed_file(QByteArray *datasec, QByteArray *toc, const QString &name, const QByteArray &data)
+{
+    QByteArray buf(8, 0);
+    *datasec += lenval(name.toLatin1());
+    write32((quint8 *)buf.data(), datasec->size() + 4);
+    write32((quint8 *)buf.data() + 4, data.size());
+    *datasec += lenval(data);
+    *toc += lenval(name.toLatin1());
+    *toc += buf;
 }
 
 static QByteArray get_configexe_stub()
@@ -227,8 +252,7 @@ public:
                 line  = generateFirst();
                 first = false;
             }
-            while ((int)line.length() < indent)
-                line += ' ';
+            line = line.leftJustified(indent);
             line += *it;
             str += line + '\n';
         }
@@ -335,6 +359,8 @@ public:
 
         QString str;
         str += genHeader();
+        str += genTmpdir();
+        str += genTimings();
         str += genUsage();
         str += genFindStuff();
         str += genQtInfo();
@@ -348,6 +374,8 @@ public:
 
         // argument parsing
         str += createConfArgsSection();
+        str += genDeadline();
+        str += "qc_phase args\n\n";
 
         // set the builtin defaults
         if (usePrefix) {
@@ -375,6 +403,9 @@ public:
         str += "echo\n";
         str += "fi\n\n";
 
+        str += genSite();
+        str += genFindMake();
+
         if (qt4) {
             if (byoq) {
                 str += "printf \"Preparing internal Qt 4+ build environment ... \"\n\n";
@@ -393,7 +424,8 @@ public:
                 // str += "if [ \"$QMAKESPEC\" == \"\" ]; then\n";
                 // str += "	export QMAKESPEC=linux-g++\n";
                 // str += "fi\n";
-                str += "qm=$PWD/byoq/qt/bin/qmake\n\n";
+                str += "qm=$PWD/byoq/qt/bin/qmake\n";
+                str += "qc_phase qt\n\n";
             }
 
             str += "printf \"Verifying Qt build environment ... \"\n\n";
@@ -410,6 +442,19 @@ public:
         }
         str += "export QC_VERBOSE\n"; // export verbose flag also
         str += "export QC_QTSELECT\n";
+        str += "export QC_NO_SHARED_CACHE\n";
+        str += "export QC_REMOTE_CACHE\n";
+        str += "export QC_REMOTE_CACHE_ID\n";
+        str += "export QC_JOBS\n";
+        str += "export QC_TIMEOUT\n";
+        str += "export QC_DEADLINE_AT\n";
+        str += "export QC_VARIANTS\n";
+        str += "export QC_SERVICE\n";
+        str += "export QC_RECORD\n";
+        str += "export QC_REPLAY\n";
+        str += "export QC_SITE\n";
+        str += QString("QC_CONF_ID=%1\n").arg(genConfId());
+        str += "export QC_CONF_ID\n";
 
         str += genDoQConf();
 
@@ -417,6 +462,7 @@ public:
         if (!qt4) {
             str += genRunExtra();
             str += genRunQMake();
+            str += "qc_phase qmake\n\n";
         }
 
         str += genFooter();
@@ -424,14 +470,17 @@ public:
         return str.toLatin1();
     }
 
-    QByteArray generateExe()
+    // native is for configure.bin, the unix build of the stub
+    QByteArray generateExe(const QByteArray &stub, bool native = false)
     {
         // main options
         mainopts.clear();
         mainopts += ConfOpt("qtdir", "path", "EX_QTDIR", "Directory where Qt is installed.");
 
         if (usePrefix) {
-            mainopts += ConfOpt("prefix", "path", "PREFIX", "Base path for build/install.  No default.");
+            mainopts += ConfOpt("prefix", "path", "PREFIX",
+                                native ? "Base path for build/install.  Default: /usr/local"
+                                       : "Base path for build/install.  No default.");
             if (useBindir)
                 mainopts += ConfOpt("bindir", "path", "BINDIR", "Directory for binaries.  Default: PREFIX/bin");
             if (useIncdir)
@@ -450,15 +499,30 @@ public:
         // combine main and extra opts together
         all = mainopts + appopts + depopts;
 
-        QByteArray out     = get_configexe_stub();
-        QByteArray sig     = "QCONF_CONFIGWIN_BLOCKSIG_68b7e7d7";
-        QByteArray datasec = makeDatasec();
+        QByteArray out = stub;
+        QByteArray toc;
+        QByteArray datasec = makeDatasec(&toc, native);
+
+        // older stubs scan for the signature instead of reading the trailer
+        QByteArray sig = "QCONF_CONFIGWIN_BLOCKSIG_68b7e7d7";
         out += sig;
         out += lenval(datasec);
+
+        // trailer, see embed.c
+        QByteArray trailer(32, 0);
+        memcpy(trailer.data(), "QCONFEXE", 8);
+        write32((quint8 *)trailer.data() + 8, 1);
+        write32((quint8 *)trailer.data() + 12, out.size() - datasec.size());
+        write32((quint8 *)trailer.data() + 16, datasec.size());
+        write32((quint8 *)trailer.data() + 20, out.size());
+        write32((quint8 *)trailer.data() + 24, toc.size());
+        write32((quint8 *)trailer.data() + 28, embed_checksum(datasec + toc));
+        out += toc;
+        out += trailer;
         return out;
     }
 
-    QByteArray makeDatasec() const
+    QByteArray makeDatasec(QByteArray *toc, bool native) const
     {
         QByteArray out;
         QByteArray buf(4, 0);
@@ -479,16 +543,20 @@ public:
 
         write32((quint8 *)buf.data(), 5);
         out += buf;
-        out += embed_file("modules.cpp", filemodulescpp);
-        out += embed_file("modules_new.cpp", filemodulesnewcpp);
-        out += embed_file("conf4.h", fileconfh);
-        out += embed_file("conf4.cpp", fileconfcpp);
-        out += embed_file("conf4.pro", fileconfpro);
+        *toc += buf;
+        embed_file(&out, toc, "modules.cpp", filemodulescpp);
+        embed_file(&out, toc, "modules_new.cpp", filemodulesnewcpp);
+        embed_file(&out, toc, "conf4.h", fileconfh);
+        embed_file(&out, toc, "conf4.cpp", fileconfcpp);
+        embed_file(&out, toc, "conf4.pro", fileconfpro);
 
         out += lenval(name.toLatin1());
         out += lenval(profile.toLatin1());
 
-        out += lenval(formatBlock(qt4_info_str_win).toLatin1());
+        QString qtinfo = qt4_info_str_win;
+        if (native)
+            qtinfo.replace("%QTDIR%", "$QTDIR").replace("%PATH%", "$PATH");
+        out += lenval(formatBlock(qtinfo).toLatin1());
 
         return out;
     }
@@ -505,14 +573,107 @@ private:
         return str;
     }
 
+    // every run gets a scratch dir of its own, so that several can run at
+    //   once in the same dir.  it is made by the first phase that needs it,
+    //   and the trap removes it however we exit.
+    QString genTmpdir()
+    {
+        QString str = "qc_tmpdir_made=\n"
+                      "qc_make_tmpdir() {\n"
+                      "	if [ -n \"$qc_tmpdir_made\" ]; then\n"
+                      "		return 0\n"
+                      "	fi\n"
+                      "	QC_TMPDIR=`mktemp -d .qconftemp.XXXXXX 2>/dev/null`\n"
+                      "	if [ -z \"$QC_TMPDIR\" ]; then\n"
+                      "		QC_TMPDIR=\".qconftemp.$$\"\n"
+                      "		rm -rf \"$QC_TMPDIR\"\n"
+                      "		mkdir \"$QC_TMPDIR\" || exit 1\n"
+                      "	fi\n"
+                      "	export QC_TMPDIR\n"
+                      "	trap 'rm -rf \"$QC_TMPDIR\"' EXIT\n"
+                      "	trap 'exit 1' HUP INT TERM\n"
+                      "	qc_tmpdir_made=Y\n"
+                      "}\n"
+                      "\n";
+        return str;
+    }
+
+    // --timings records when each phase ends, and the conf program adds
+    //   the time of each check and of qmake, both in the scratch dir.
+    //   qc_show_timings turns them into conf.timings, one "phase
+    //   milliseconds" line each, which is the only file left behind.
+    QString genTimings()
+    {
+        QString str = "# milliseconds since the epoch, or whole seconds if date has no %N\n"
+                      "qc_now() {\n"
+                      "	t=`date +%s%N 2>/dev/null`\n"
+                      "	case \"$t\" in\n"
+                      "		\"\"|*[!0-9]*) t=`date +%s`000000000 ;;\n"
+                      "	esac\n"
+                      "	echo $((t / 1000000))\n"
+                      "}\n"
+                      "\n"
+                      "# marks the end of phase $1\n"
+                      "qc_phase() {\n"
+                      "	if [ \"$QC_TIMINGS\" = \"Y\" ]; then\n"
+                      "		echo \"$1 `qc_now`\" >>\"$qc_timings_raw\"\n"
+                      "	fi\n"
+                      "}\n"
+                      "\n"
+                      "qc_show_timings() {\n"
+                      "	if [ \"$QC_TIMINGS\" = \"Y\" ]; then\n"
+                      "		qc_report=\"$QC_TMPDIR/timings.report\"\n"
+                      "		prev=$qc_start\n"
+                      "		while read phase t; do\n"
+                      "			echo \"$phase $((t - prev))\"\n"
+                      "			prev=$t\n"
+                      "		done <\"$qc_timings_raw\" >\"$qc_report\"\n"
+                      "		if [ -f \"$QC_TIMINGS_FILE\" ]; then\n"
+                      "			sed 's/^/conf_run./' \"$QC_TIMINGS_FILE\" >>\"$qc_report\"\n"
+                      "		fi\n"
+                      "		echo \"total $((`qc_now` - qc_start))\" >>\"$qc_report\"\n"
+                      "		mv -f \"$qc_report\" conf.timings\n"
+                      "		echo\n"
+                      "		echo \"Timings (ms), also written to conf.timings:\"\n"
+                      "		while read phase ms; do\n"
+                      "			printf \"  %-30s %8s\\n\" \"$phase\" \"$ms\"\n"
+                      "		done <conf.timings\n"
+                      "	fi\n"
+                      "}\n"
+                      "\n"
+                      "# --timings has to be known before the arguments are parsed\n"
+                      "for qc_arg in \"$@\"; do\n"
+                      "	if [ \"$qc_arg\" = \"--timings\" ]; then\n"
+                      "		QC_TIMINGS=Y\n"
+                      "	fi\n"
+                      "done\n"
+                      "if [ \"$QC_TIMINGS\" = \"Y\" ]; then\n"
+                      "	qc_start=`qc_now`\n"
+                      "	qc_make_tmpdir\n"
+                      "	qc_timings_raw=\"$QC_TMPDIR/timings\"\n"
+                      "	# conf changes to the variant dirs, so it gets a full path\n"
+                      "	QC_TIMINGS_FILE=\"$PWD/$QC_TMPDIR/timings.conf\"\n"
+                      "	export QC_TIMINGS_FILE\n"
+                      "	: >\"$qc_timings_raw\"\n"
+                      "fi\n"
+                      "\n";
+        return str;
+    }
+
     QString genFooter()
     {
-        QString str = "echo\n";
+        QString str = "qc_show_timings\n";
+        str += "echo\n";
         //"if [ \"$QTDIR\" != \"$ORIG_QTDIR\" ]; then\n"
         //"	echo Good, your configure finished.  Now run \\'QTDIR=$QTDIR make\\'.\n"
         //"else\n"
-        if (qt4)
-            str += "echo \"Good, your configure finished.  Now run $MAKE.\"\n";
+        if (qt4) {
+            str += "if [ -n \"$QC_VARIANTS\" ]; then\n"
+                   "	echo \"Good, your configure finished.  Now run $MAKE in `echo $QC_VARIANTS | tr , ' '`.\"\n"
+                   "else\n"
+                   "	echo \"Good, your configure finished.  Now run $MAKE.\"\n"
+                   "fi\n";
+        }
         //"fi\n"
         str += "echo\n";
         return str;
@@ -563,6 +724,26 @@ private:
         QList<ConfUsageOpt> list = optsToUsage(mainopts);
         list += ConfUsageOpt("verbose", "", "Show extra configure output.");
         list += ConfUsageOpt("qtselect", "N", "Select major Qt version (4 or 5).");
+        list += ConfUsageOpt("timings", "", "Show how long each configure phase took, and write it to conf.timings.");
+        list += ConfUsageOpt("no-shared-cache", "",
+                             "Don't use or update the probe results shared by all configure runs on this host.");
+        list += ConfUsageOpt("remote-cache", "url", "Also share probe results through an HTTP server at url.");
+        list += ConfUsageOpt("remote-cache-id", "id",
+                             "Share them only with hosts using the same id, which must have the same headers and "
+                             "libraries installed (required with --remote-cache).");
+        list += ConfUsageOpt("jobs", "N", "Run up to N checks and commands at once (default: a parallel make's or 1).");
+        list += ConfUsageOpt("timeout", "secs", "Kill any command of a check that runs longer than secs seconds.");
+        list += ConfUsageOpt("deadline", "secs", "Give up if configure isn't done after secs seconds.");
+        list += ConfUsageOpt("variants", "list",
+                             "Configure each of a comma-separated list of variants (e.g. debug,release,static) in a "
+                             "subdirectory of the same name.");
+        list += ConfUsageOpt("service", "",
+                             "Keep the check results in a conf process that stays around, and reuse them as long "
+                             "as what they depend on is unchanged.");
+        list += ConfUsageOpt("record", "file", "Write every command run by the checks, and what it returned, to file.");
+        list += ConfUsageOpt("replay", "file", "Answer the commands of the checks from a file written by --record.");
+        list += ConfUsageOpt("site", "file",
+                             "Preseed qmake, the makespec, make and the results of checks.  Default: qconf.site");
         list += ConfUsageOpt("help", "", "This help text.");
         str += genUsageSection("Main options:", list);
 
@@ -588,6 +769,18 @@ private:
         QList<ConfUsageOpt> list = optsToUsage(mainopts);
         list += ConfUsageOpt("verbose", "", "Show extra configure output.");
         list += ConfUsageOpt("qtselect", "N", "Select major Qt version (4 or 5).");
+        list += ConfUsageOpt("timeout", "secs", "Kill any command of a check that runs longer than secs seconds.");
+        list += ConfUsageOpt("deadline", "secs", "Give up if configure isn't done after secs seconds.");
+        list += ConfUsageOpt("variants", "list",
+                             "Configure each of a comma-separated list of variants (e.g. debug,release,static) in a "
+                             "subdirectory of the same name.");
+        list += ConfUsageOpt("service", "",
+                             "Keep the check results in a conf process that stays around, and reuse them as long "
+                             "as what they depend on is unchanged.");
+        list += ConfUsageOpt("record", "file", "Write every command run by the checks, and what it returned, to file.");
+        list += ConfUsageOpt("replay", "file", "Answer the commands of the checks from a file written by --record.");
+        list += ConfUsageOpt("site", "file",
+                             "Preseed qmake, the makespec, make and the results of checks.  Default: qconf.site");
         list += ConfUsageOpt("help", "", "This help text.");
         str += genUsageSection("Main options:", list);
 
@@ -604,6 +797,23 @@ private:
         return str;
     }
 
+    // --deadline counts from when the arguments are parsed, and the conf
+    //   program gets the absolute time, so it knows how much is left
+    QString genDeadline()
+    {
+        return "for qc_secs in \"$QC_TIMEOUT\" \"$QC_DEADLINE\"; do\n"
+               "	case \"$qc_secs\" in\n"
+               "		*[!0-9]*)\n"
+               "			echo \"configure: --timeout and --deadline take a number of seconds\" >&2\n"
+               "			exit 1\n"
+               "			;;\n"
+               "	esac\n"
+               "done\n"
+               "if [ -n \"$QC_DEADLINE\" ]; then\n"
+               "	QC_DEADLINE_AT=$((`date +%s` + QC_DEADLINE))\n"
+               "fi\n";
+    }
+
     QString genFindStuff()
     {
         QString str;
@@ -664,7 +874,63 @@ private:
                "WHICH=which_command\n"
                "\n";
 
-        // make
+        return str;
+    }
+
+    // a site file preseeds what configure would otherwise find, so that it
+    //   runs quickly on build hosts that are all set up the same way.  it
+    //   has "key = value" lines, and the last line for a key wins.  what is
+    //   given on the command line or in the environment still comes first.
+    QString genSite()
+    {
+        return "qc_site_value() {\n"
+               "	sed -n \"s/^[ 	]*$1[ 	]*=[ 	]*//p\" \"$QC_SITE\" | sed 's/[ 	]*$//' | tail -n 1\n"
+               "}\n"
+               "\n"
+               "if [ -z \"$QC_SITE\" ] && [ -f qconf.site ]; then\n"
+               "	QC_SITE=qconf.site\n"
+               "fi\n"
+               "qc_site_qmake=\n"
+               "qc_site_qmakespec=\n"
+               "qc_site_make=\n"
+               "if [ -n \"$QC_SITE\" ]; then\n"
+               "	if [ ! -r \"$QC_SITE\" ]; then\n"
+               "		echo \"configure: can't read the site file $QC_SITE\" >&2\n"
+               "		exit 1\n"
+               "	fi\n"
+               "	# conf reads it too\n"
+               "	case \"$QC_SITE\" in\n"
+               "		/*) ;;\n"
+               "		*) QC_SITE=\"$PWD/$QC_SITE\" ;;\n"
+               "	esac\n"
+               "	if [ -z \"$EX_QTDIR\" ]; then\n"
+               "		qc_site_qmake=`qc_site_value qmake`\n"
+               "	fi\n"
+               "	if [ -z \"$QMAKESPEC\" ]; then\n"
+               "		qc_site_qmakespec=`qc_site_value qmakespec`\n"
+               "	fi\n"
+               "	if [ -z \"$MAKE\" ]; then\n"
+               "		qc_site_make=`qc_site_value make`\n"
+               "		MAKE=$qc_site_make\n"
+               "	fi\n"
+               "	if [ \"$QC_VERBOSE\" = \"Y\" ]; then\n"
+               "		echo \"site file is $QC_SITE\"\n"
+               "		for qc_v in \"qmake=$qc_site_qmake\" \"qmakespec=$qc_site_qmakespec\" \"make=$qc_site_make\"; do\n"
+               "			if [ -n \"${qc_v#*=}\" ]; then\n"
+               "				echo \"site: ${qc_v%%=*} = ${qc_v#*=}\"\n"
+               "			fi\n"
+               "		done\n"
+               "		echo\n"
+               "	fi\n"
+               "fi\n"
+               "qc_phase site\n"
+               "\n";
+    }
+
+    QString genFindMake()
+    {
+        QString str;
+
         str += "# find a make command\n"
                "if [ -z \"$MAKE\" ]; then\n"
                "	MAKE=\n"
@@ -680,6 +946,7 @@ private:
                "		exit 1\n"
                "	fi\n"
                "fi\n"
+               "qc_phase make\n"
                "\n";
 
         return str;
@@ -732,6 +999,54 @@ private:
                             "			QC_QTSELECT=\"${optarg}\"\n"
                             "			shift\n"
                             "			;;\n"
+                            "		--timings)\n"
+                            "			QC_TIMINGS=\"Y\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--no-shared-cache)\n"
+                            "			QC_NO_SHARED_CACHE=\"Y\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--remote-cache=*)\n"
+                            "			QC_REMOTE_CACHE=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--remote-cache-id=*)\n"
+                            "			QC_REMOTE_CACHE_ID=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--jobs=*)\n"
+                            "			QC_JOBS=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--timeout=*)\n"
+                            "			QC_TIMEOUT=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--deadline=*)\n"
+                            "			QC_DEADLINE=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--variants=*)\n"
+                            "			QC_VARIANTS=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--service)\n"
+                            "			QC_SERVICE=\"Y\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--record=*)\n"
+                            "			QC_RECORD=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--replay=*)\n"
+                            "			QC_REPLAY=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
+                            "		--site=*)\n"
+                            "			QC_SITE=\"${optarg}\"\n"
+                            "			shift\n"
+                            "			;;\n"
                             "		--help) show_usage; exit ;;\n"
                             "		*) echo \"configure: WARNING: unrecognized options: $1\" >&2; shift; ;;\n"
                             "	esac\n"
@@ -795,7 +1110,7 @@ private:
                "	echo\n"
                "fi\n"
                "\n"
-               "qm=\"\"\n"
+               "qm=\"$qc_site_qmake\"\n"
                "qt4_names=\"qmake-qt4 qmake4\"\n"
                "qt5_names=\"qmake-qt5 qmake5\"\n"
                "names=\"qmake\"\n"
@@ -928,10 +1243,11 @@ private:
                "fi\n"
                "if [ \"$QC_VERBOSE\" = \"Y\" ]; then\n"
                "	echo qmake found in \"$qm\"\n"
-               "fi\n\n";
+               "fi\n"
+               "qc_phase qt\n\n";
 
         str += "# try to determine the active makespec\n"
-               "defmakespec=$QMAKESPEC\n"
+               "defmakespec=${QMAKESPEC:-$qc_site_qmakespec}\n"
                "if [ -z \"$defmakespec\" ]; then\n"
                "	if $WHICH readlink >/dev/null 2>&1; then\n"
                "		READLINK=`$WHICH readlink`\n"
@@ -949,6 +1265,11 @@ private:
                "fi\n"
                "\n"
                "qm_spec=\"\"\n"
+               "if [ -n \"$qc_site_qmakespec\" ]; then\n"
+               "	qm_spec=$qc_site_qmakespec\n"
+               "	QMAKESPEC=$qm_spec\n"
+               "	export QMAKESPEC\n"
+               "fi\n"
                "# if the makespec is macx-xcode, force macx-g++\n"
                "if [ \"$defmakespec\" = \"macx-xcode\" ]; then\n"
                "	qm_spec=macx-g++\n"
@@ -957,24 +1278,38 @@ private:
                "	if [ \"$QC_VERBOSE\" = \"Y\" ]; then\n"
                "		echo overriding makespec to $qm_spec\n"
                "	fi\n"
-               "fi\n\n";
+               "fi\n"
+               "qc_phase makespec\n\n";
 
         return str;
     }
 
     QString genDoQConf()
     {
-        QString outdir  = ".qconftemp";
+        QString outdir  = "$QC_TMPDIR";
         QString cleanup = QString("rm -rf \"%1\"").arg(outdir);
 
-        QString str;
-        str += QString("%1\n").arg(cleanup);
+        QString str = "qc_make_tmpdir\n\n";
+
+        str += QString("qc_conf=\"%1/conf\"\n").arg(outdir);
+        if (qt4) {
+            // with --service, conf is built once for its sources and qmake,
+            //   and kept in the cache
+            str += "qc_conf_cache=\n"
+                   "if [ \"$QC_SERVICE\" = \"Y\" ] && [ -n \"$XDG_CACHE_HOME$HOME\" ]; then\n"
+                   "	qc_conf_qm=$(echo \"$qm $qm_spec\" | cksum | sed 's/ .*//')\n"
+                   "	qc_conf_cache=\"${XDG_CACHE_HOME:-$HOME/.cache}/qconf/conf/$QC_CONF_ID-$qc_conf_qm\"\n"
+                   "	if [ -x \"$qc_conf_cache/conf\" ]; then\n"
+                   "		qc_conf=\"$qc_conf_cache/conf\"\n"
+                   "	fi\n"
+                   "fi\n"
+                   "if [ \"$qc_conf\" = \"$QC_TMPDIR/conf\" ]; then\n";
+        }
 
         str += QString("(\n"
-                       "	mkdir \"%1\"\n"
-                       "	gen_files \"%2\"\n"
-                       "	cd \"%3\"\n")
-                   .arg(outdir)
+                       "	gen_files \"%1\"\n"
+                       "	qc_phase gen_files\n"
+                       "	cd \"%2\"\n")
                    .arg(outdir)
                    .arg(outdir);
 
@@ -985,19 +1320,33 @@ private:
                    "		\"$qm\" conf4.pro >/dev/null\n"
                    "	fi\n"
                    "	$MAKE clean >/dev/null 2>&1\n"
-                   "	$MAKE >../conf.log 2>&1\n";
+                   "	# under a parallel make, the jobserver in MAKEFLAGS is passed on\n"
+                   "	qc_make_jobs=\n"
+                   "	case \"$MAKEFLAGS\" in\n"
+                   "	*--jobserver-*) ;;\n"
+                   "	*) [ -n \"$QC_JOBS\" ] && qc_make_jobs=\"-j$QC_JOBS\" ;;\n"
+                   "	esac\n"
+                   "	# the log stays in the scratch dir, see below\n"
+                   "	$MAKE $qc_make_jobs >conf.log 2>&1 || exit\n"
+                   "	qc_phase conf_build\n";
         }
-        str += ")\n\n";
+        str += ")\n";
+        if (qt4)
+            str += "fi\n";
+        str += "\n";
 
         if (qt4) {
-            str += QString("if [ \"$?\" != \"0\" ]; then\n"
-                           "	%1\n"
-                           "	if [ \"$QC_VERBOSE\" = \"Y\" ]; then\n"
-                           "		echo \" -> fail\"\n"
-                           "	else\n"
-                           "		echo \"fail\"\n"
-                           "	fi\n")
-                       .arg(cleanup);
+            // configures running at the same time each have their own log,
+            //   which only becomes conf.log if the build failed.  it is
+            //   renamed into place, so conf.log is never half written.
+            str += "if [ \"$?\" != \"0\" ]; then\n"
+                   "	cp -f \"$QC_TMPDIR/conf.log\" \"$QC_TMPDIR.log\" 2>/dev/null \\\n"
+                   "		&& mv -f \"$QC_TMPDIR.log\" conf.log\n"
+                   "	if [ \"$QC_VERBOSE\" = \"Y\" ]; then\n"
+                   "		echo \" -> fail\"\n"
+                   "	else\n"
+                   "		echo \"fail\"\n"
+                   "	fi\n";
 
             str += echoBlock(1,
                              "\n"
@@ -1009,10 +1358,21 @@ private:
 
             str += "	if [ \"$QC_VERBOSE\" = \"Y\" ]; then\n"
                    "		echo \"conf.log:\"\n"
-                   "		cat conf.log\n"
+                   "		cat \"$QC_TMPDIR/conf.log\"\n"
                    "	fi\n";
 
-            str += "	exit 1;\n"
+            str += QString("	%1\n"
+                           "	exit 1;\n"
+                           "fi\n")
+                       .arg(cleanup);
+
+            // a copy that is moved into place, so that a configure running at
+            //   the same time never sees half of it
+            str += "if [ \"$qc_conf\" = \"$QC_TMPDIR/conf\" ] && [ -n \"$qc_conf_cache\" ] \\\n"
+                   "	&& mkdir -p \"$qc_conf_cache\" 2>/dev/null \\\n"
+                   "	&& cp \"$qc_conf\" \"$qc_conf_cache/conf.$$\" 2>/dev/null \\\n"
+                   "	&& mv -f \"$qc_conf_cache/conf.$$\" \"$qc_conf_cache/conf\"; then\n"
+                   "	qc_conf=\"$qc_conf_cache/conf\"\n"
                    "fi\n\n";
         }
 
@@ -1029,9 +1389,10 @@ private:
             str += QString("export QC_MAKETOOL\n");
         }
 
-        str += QString("\"%1/conf\"\n").arg(outdir);
+        str += "\"$qc_conf\"\n";
 
         str += "ret=\"$?\"\n";
+        str += "qc_phase conf_run\n";
         str += "if [ \"$ret\" = \"1\" ]; then\n";
         str += QString("	%1\n").arg(cleanup);
         str += "	echo\n";
@@ -1096,13 +1457,26 @@ private:
 
     QString genEmbeddedFile(const QString &name, const QByteArray &a)
     {
-        QString str;
-        str += QString("cat >\"%1\" <<EOT\n").arg(name);
+        QString str = QString("cat >\"%1\" <<EOT\n").arg(name);
         str += escapeFile(QString::fromLatin1(a));
         str += "\nEOT\n";
         return str;
     }
 
+    // identifies the conf sources, so that a conf built from them can be
+    //   kept by configure --service
+    QString genConfId() const
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(QByteArray(qt4 ? "qt4" : "qt3"));
+        hash.addData(filemodulescpp);
+        hash.addData(filemodulesnewcpp);
+        hash.addData(fileconfh);
+        hash.addData(fileconfcpp);
+        hash.addData(fileconfpro);
+        return QString::fromLatin1(hash.result().toHex().left(16));
+    }
+
     QString genEmbeddedFiles()
     {
         QString str;
@@ -1222,6 +1596,7 @@ public:
         required   = false;
         disabled   = false;
         pkgconfig  = false;
+        qtmodule   = false;
     }
 
     QString         name, longname, section;
@@ -1230,6 +1605,7 @@ public:
     QList<QCModArg> args;
 
     bool        pkgconfig;
+    bool        qtmodule; // pkgname is the module
     QString     pkgname;
     VersionMode pkgvermode;
     QString     pkgver;
@@ -1257,260 +1633,556 @@ public:
     bool            qt4, byoq;
 };
 
-Conf xmlToConf(const QDomElement &e)
+enum ConfLoadResult { ConfLoaded, ConfParseError, ConfBadFormat };
+
+// reads the .qc file in a single pass.  elements are recognized at any
+//   depth below the root, and <required/> and <disabled/> apply to every
+//   enclosing <dep>.
+ConfLoadResult xmlToConf(QIODevice *dev, Conf *_conf)
 {
-    Conf conf;
-    conf.name = e.elementsByTagName("name").item(0).toElement().text();
-
-    conf.profile = e.elementsByTagName("profile").item(0).toElement().text();
-
-    QDomNodeList nl = e.elementsByTagName("dep");
-    for (int n = 0; n < (int)nl.count(); ++n) {
-        QDomElement i = nl.item(n).toElement();
-        Dep         dep;
-        dep.name = i.attribute("type");
-        if (dep.name == "pkg") {
-            dep.name         = i.attribute("name");
-            dep.longname     = dep.name;
-            dep.pkgconfig    = true;
-            dep.pkgname      = i.attribute("pkgname");
-            QString     str  = i.attribute("version");
-            VersionMode mode = VersionAny;
-            QString     ver;
-            if (str.startsWith(">=")) {
-                mode = VersionMin;
-                ver  = str.mid(2);
-            } else if (str.startsWith("<=")) {
-                mode = VersionMax;
-                ver  = str.mid(2);
-            } else if (!str.isEmpty()) {
-                mode = VersionExact;
-                ver  = str;
-            }
-            dep.pkgvermode = mode;
-            dep.pkgver     = ver;
+    Conf             conf;
+    QXmlStreamReader xml(dev);
+    QString          root;
+    QList<int>       openDeps;
+    bool             haveName = false, haveProfile = false;
+    bool             qt3 = false, byoq = false;
+
+    while (!xml.atEnd()) {
+        QXmlStreamReader::TokenType type = xml.readNext();
+        if (type == QXmlStreamReader::EndElement) {
+            if (xml.name() == QLatin1String("dep") && !openDeps.isEmpty())
+                openDeps.removeLast();
+            continue;
         }
-        if (i.elementsByTagName("required").count() > 0)
-            dep.required = true;
-        if (i.elementsByTagName("disabled").count() > 0)
-            dep.disabled = true;
-        conf.deps += dep;
-    }
+        if (type != QXmlStreamReader::StartElement)
+            continue;
 
-    nl = e.elementsByTagName("arg");
-    for (int n = 0; n < (int)nl.count(); ++n) {
-        QDomElement i = nl.item(n).toElement();
-        QCModArg    a;
-        a.name = i.attribute("name");
-        a.arg  = i.attribute("arg");
-        a.desc = i.text();
-        conf.args += a;
+        QString tag = xml.name().toString();
+        if (root.isEmpty()) {
+            root = tag;
+            continue;
+        }
+
+        if (tag == "name") {
+            QString text = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+            if (!haveName)
+                conf.name = text;
+            haveName = true;
+        } else if (tag == "profile") {
+            QString text = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+            if (!haveProfile)
+                conf.profile = text;
+            haveProfile = true;
+        } else if (tag == "dep") {
+            QXmlStreamAttributes attrs = xml.attributes();
+            Dep                  dep;
+            dep.name = attrs.value("type").toString();
+            if (dep.name == "pkg" || dep.name == "qtmodule") {
+                dep.qtmodule  = dep.name == "qtmodule";
+                dep.pkgconfig = !dep.qtmodule;
+                dep.name      = attrs.value("name").toString();
+                if (dep.qtmodule) {
+                    dep.longname = "Qt " + dep.name;
+                    dep.pkgname  = dep.name;
+                } else {
+                    dep.longname = dep.name;
+                    dep.pkgname  = attrs.value("pkgname").toString();
+                }
+                QString     str  = attrs.value("version").toString();
+                VersionMode mode = VersionAny;
+                QString     ver;
+                if (str.startsWith(">=")) {
+                    mode = VersionMin;
+                    ver  = str.mid(2);
+                } else if (str.startsWith("<=")) {
+                    mode = VersionMax;
+                    ver  = str.mid(2);
+                } else if (!str.isEmpty()) {
+                    mode = VersionExact;
+                    ver  = str;
+                }
+                dep.pkgvermode = mode;
+                dep.pkgver     = ver;
+            }
+            conf.deps += dep;
+            openDeps += conf.deps.count() - 1;
+        } else if (tag == "required") {
+            foreach (int n, openDeps)
+                conf.deps[n].required = true;
+        } else if (tag == "disabled") {
+            foreach (int n, openDeps)
+                conf.deps[n].disabled = true;
+        } else if (tag == "arg") {
+            QCModArg a;
+            a.name = xml.attributes().value("name").toString();
+            a.arg  = xml.attributes().value("arg").toString();
+            a.desc = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+            conf.args += a;
+        } else if (tag == "lib") {
+            conf.libmode = true;
+        } else if (tag == "noprefix") {
+            conf.noprefix = true;
+        } else if (tag == "nobindir") {
+            conf.nobindir = true;
+        } else if (tag == "incdir") {
+            conf.useincdir = true;
+        } else if (tag == "libdir") {
+            conf.uselibdir = true;
+        } else if (tag == "datadir") {
+            conf.usedatadir = true;
+        } else if (tag == "moddir") {
+            conf.moddirs += xml.readElementText(QXmlStreamReader::IncludeChildElements);
+        } else if (tag == "qt3") {
+            qt3 = true;
+        } else if (tag == "byoq") {
+            byoq = true;
+        }
     }
 
-    if (e.elementsByTagName("lib").count() > 0)
-        conf.libmode = true;
+    // the whole document must be well-formed before we look at the root
+    if (xml.hasError() || root.isEmpty())
+        return ConfParseError;
+    if (root != "qconf")
+        return ConfBadFormat;
 
-    if (e.elementsByTagName("noprefix").count() > 0)
-        conf.noprefix = true;
+    conf.qt4 = !qt3;
+    if (conf.qt4 && byoq)
+        conf.byoq = true;
 
-    if (e.elementsByTagName("nobindir").count() > 0)
-        conf.nobindir = true;
+    *_conf = conf;
+    return ConfLoaded;
+}
 
-    if (e.elementsByTagName("incdir").count() > 0)
-        conf.useincdir = true;
+static bool readFile(const QString &fname, QByteArray *out, QIODevice::OpenMode mode = QIODevice::ReadOnly)
+{
+    QFile f(fname);
+    if (!f.open(mode))
+        return false;
+    *out = f.readAll();
+    return true;
+}
 
-    if (e.elementsByTagName("libdir").count() > 0)
-        conf.uselibdir = true;
+// the peak resident set size of the process in KiB, or -1 if unknown
+static qint64 peakRss()
+{
+#ifdef Q_OS_UNIX
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return -1;
+#ifdef Q_OS_MACOS
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
 
-    if (e.elementsByTagName("datadir").count() > 0)
-        conf.usedatadir = true;
+// Time and peak memory per phase of a run, for --timings.  Phases with the
+//   same name are added up, e.g. over all projects of a --batch run.
+class Timings {
+public:
+    // adds the time since timer was started to phase, and restarts timer
+    void add(const QString &phase, QElapsedTimer *timer)
+    {
+        qint64       nsecs = timer->nsecsElapsed();
+        qint64       rss   = peakRss();
+        QMutexLocker locker(&mutex);
+        int          n = names.indexOf(phase);
+        if (n == -1) {
+            names += phase;
+            phases += Phase();
+            n = phases.count() - 1;
+        }
+        Phase &p = phases[n];
+        p.nsecs += nsecs;
+        ++p.count;
+        p.peakRss = qMax(p.peakRss, rss);
+        timer->restart();
+    }
 
-    nl = e.elementsByTagName("moddir");
-    for (int n = 0; n < (int)nl.count(); ++n) {
-        QDomElement i = nl.item(n).toElement();
-        conf.moddirs += i.text();
+    QString report()
+    {
+        QMutexLocker locker(&mutex);
+        QString      str = "Timings:\n";
+        for (int n = 0; n < phases.count(); ++n) {
+            const Phase &p = phases[n];
+            str += QString("  %1 %2 ms").arg(names[n], -12).arg(p.nsecs / 1000000.0, 10, 'f', 2);
+            if (p.count > 1)
+                str += QString(" (%1 runs)").arg(p.count);
+            if (p.peakRss >= 0)
+                str += QString(", peak RSS %1 KiB").arg(p.peakRss);
+            str += '\n';
+        }
+        return str;
     }
 
-    conf.qt4 = true;
-    if (e.elementsByTagName("qt3").count() > 0)
-        conf.qt4 = false;
+private:
+    class Phase {
+    public:
+        qint64 nsecs, peakRss;
+        int    count;
 
-    if (conf.qt4 && e.elementsByTagName("byoq").count() > 0)
-        conf.byoq = true;
+        Phase() : nsecs(0), peakRss(-1), count(0) { }
+    };
 
-    return conf;
-}
+    QMutex       mutex;
+    QStringList  names;
+    QList<Phase> phases;
+};
 
-int main(int argc, char **argv)
-{
-    QCoreApplication app(argc, argv);
-    Conf             conf;
-    QString          fname;
-    bool             skipLoad = false;
+// A module found in a module directory
+class ModuleEntry {
+public:
+    QString   name; // file name without .qcm
+    QString   path;
+    qint64    mtime, size;
+    QCModInfo info;
 
-    if (argc < 2) {
-        // try to find a .qc file
-        QDir        cur;
-        QStringList list = cur.entryList(QStringList() << "*.qc");
-        if (list.isEmpty()) {
-            // try to find a .pro file to work from
-            list = cur.entryList(QStringList() << "*.pro");
-            if (list.isEmpty()) {
-                printf("qconf: no .qc or .pro file found.\n");
-                return 1;
+    ModuleEntry() : mtime(0), size(0) { }
+};
+
+// Keeps the QCMOD metadata of the modules in the module directories.  Each
+//   directory is scanned once per run, and the metadata is kept in an index
+//   file in the user's cache directory.  On later runs only the modules whose
+//   mtime or size changed are read and parsed again.  If there is no cache
+//   directory, or it isn't writable, every run simply parses all modules.
+//
+// All methods are thread safe.
+class ModuleRegistry {
+public:
+    // the module called name in the first of dirs that has one
+    bool find(const QString &name, const QStringList &dirs, ModuleEntry *entry)
+    {
+        QMutexLocker locker(&mutex);
+        foreach (const QString &dir, dirs) {
+            const QHash<QString, ModuleEntry> &        entries = scan(dir);
+            QHash<QString, ModuleEntry>::ConstIterator it      = entries.find(name);
+            if (it != entries.end()) {
+                *entry = *it;
+                return true;
             }
-            QFileInfo fi(cur.filePath(list[0]));
-            conf.name    = fi.baseName();
-            conf.profile = fi.fileName();
+        }
+        return false;
+    }
 
-            // save to .qc
-            fname = conf.name + ".qc";
-            QFile f(fname);
-            if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
-                printf("qconf: unable to write %s\n", qPrintable(fname));
-                return 1;
+    // all modules in dirs, sorted by name.  modules hidden by one of the same
+    //   name in an earlier dir are left out.
+    QList<ModuleEntry> list(const QStringList &dirs)
+    {
+        QMutexLocker               locker(&mutex);
+        QMap<QString, ModuleEntry> found;
+        foreach (const QString &dir, dirs) {
+            const QHash<QString, ModuleEntry> &entries = scan(dir);
+            for (QHash<QString, ModuleEntry>::ConstIterator it = entries.begin(); it != entries.end(); ++it) {
+                if (!found.contains(it.key()))
+                    found.insert(it.key(), *it);
             }
-            QDomDocument doc;
-            QDomElement  e = doc.createElement("qconf");
-            QDomElement  i;
-            i = doc.createElement("name");
-            i.appendChild(doc.createTextNode(conf.name));
-            e.appendChild(i);
-            i = doc.createElement("profile");
-            i.appendChild(doc.createTextNode(conf.profile));
-            e.appendChild(i);
-            doc.appendChild(e);
-            QByteArray cs = doc.toString().toUtf8();
-            f.write(cs);
-            f.close();
-            skipLoad = true;
-        } else {
-            fname = list[0];
         }
-    } else {
-        QString cs = argv[1];
-        if (cs.left(2) == "--") {
-            if (cs == "--help") {
-                printf("Usage: qconf [.qc file]\n\n");
-                printf("Options:\n");
-                printf("  --version    Show version number\n");
-                printf("  --help       This help\n");
-                printf("\n");
-                return 0;
-            } else if (cs == "--version") {
-                printf("qconf version: %s by Psi IM Team\n", VERSION);
-                return 0;
+        return found.values();
+    }
+
+    // the contents of the module at path.  each module is read only once.
+    bool contents(const QString &path, QByteArray *buf)
+    {
+        QMutexLocker locker(&mutex);
+        if (!data.contains(path)) {
+            QByteArray b;
+            if (!readFile(path, &b, QFile::ReadOnly | QFile::Text))
+                return false;
+            data.insert(path, b);
+        }
+        *buf = data.value(path);
+        return true;
+    }
+
+private:
+    enum { IndexMagic = 0x51434d49, IndexVersion = 1 };
+
+    QMutex                                      mutex;
+    QHash<QString, QHash<QString, ModuleEntry>> scanned; // by absolute dir, then by module name
+    QHash<QString, QByteArray>                  data; // by path
+
+    const QHash<QString, ModuleEntry> &scan(const QString &dir)
+    {
+        QString                                                    absdir = QDir(dir).absolutePath();
+        QHash<QString, QHash<QString, ModuleEntry>>::ConstIterator it     = scanned.find(absdir);
+        if (it != scanned.end())
+            return *it;
+
+        QHash<QString, ModuleEntry> indexed = loadIndex(absdir);
+        QHash<QString, ModuleEntry> entries;
+        QHash<QString, ModuleEntry> parsed;
+        bool                        changed = false;
+        QFileInfoList files = QDir(absdir).entryInfoList(QStringList() << "*.qcm", QDir::Files, QDir::Name);
+        foreach (const QFileInfo &fi, files) {
+            ModuleEntry e;
+            e.name  = fi.completeBaseName();
+            e.path  = fi.absoluteFilePath();
+            e.mtime = fi.lastModified().toMSecsSinceEpoch();
+            e.size  = fi.size();
+
+            QHash<QString, ModuleEntry>::ConstIterator i = indexed.find(e.name);
+            if (i != indexed.end() && i->mtime == e.mtime && i->size == e.size) {
+                e.info = i->info;
+                parsed.insert(e.name, e);
             } else {
-                printf("Unknown option: %s\n", qPrintable(cs));
-                return 0;
+                // unreadable modules are still listed, but not indexed.
+                //   reading them again fails later with a proper error.
+                QByteArray buf;
+                if (readFile(e.path, &buf, QFile::ReadOnly | QFile::Text)) {
+                    e.info = QCModInfo::getModInfo(buf);
+                    data.insert(e.path, buf);
+                    parsed.insert(e.name, e);
+                }
+                changed = true;
             }
+            entries.insert(e.name, e);
         }
-        fname = QFile::decodeName(QByteArray(argv[1]));
+        if (changed || parsed.count() != indexed.count())
+            saveIndex(absdir, parsed);
+
+        return *scanned.insert(absdir, entries);
     }
 
-    if (!skipLoad) {
-        QFile f(fname);
-        if (!f.open(QFile::ReadOnly)) {
-            printf("qconf: error reading %s\n", qPrintable(f.fileName()));
-            return 1;
-        }
-        QDomDocument doc;
-        if (!doc.setContent(&f)) {
-            printf("qconf: error parsing %s\n", qPrintable(f.fileName()));
-            return 1;
+    static QString indexPath(const QString &absdir)
+    {
+        QString base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+        if (base.isEmpty())
+            return QString();
+        QByteArray key = QCryptographicHash::hash(absdir.toUtf8(), QCryptographicHash::Sha1).toHex();
+        return base + "/qconf/modules-" + QString::fromLatin1(key) + ".index";
+    }
+
+    static QHash<QString, ModuleEntry> loadIndex(const QString &absdir)
+    {
+        QHash<QString, ModuleEntry> out;
+        QString                     fname = indexPath(absdir);
+        QFile                       f(fname);
+        if (fname.isEmpty() || !f.open(QFile::ReadOnly))
+            return out;
+
+        QDataStream in(&f);
+        in.setVersion(QDataStream::Qt_5_0);
+        quint32 magic, version, count;
+        QString dir;
+        in >> magic >> version >> dir >> count;
+        if (in.status() != QDataStream::Ok || magic != IndexMagic || version != IndexVersion || dir != absdir)
+            return out;
+        for (quint32 n = 0; n < count && in.status() == QDataStream::Ok; ++n) {
+            ModuleEntry e;
+            quint32     nargs;
+            in >> e.name >> e.mtime >> e.size >> e.info.longname >> e.info.section >> nargs;
+            for (quint32 k = 0; k < nargs && in.status() == QDataStream::Ok; ++k) {
+                QCModArg a;
+                in >> a.name >> a.arg >> a.desc;
+                e.info.args += a;
+            }
+            e.path = QDir(absdir).filePath(e.name + ".qcm");
+            out.insert(e.name, e);
         }
-        f.close();
+        if (in.status() != QDataStream::Ok)
+            out.clear();
+        return out;
+    }
 
-        QDomElement base = doc.documentElement();
-        if (base.tagName() != "qconf") {
-            printf("qconf: bad format of %s\n", qPrintable(f.fileName()));
-            return 1;
+    static void saveIndex(const QString &absdir, const QHash<QString, ModuleEntry> &entries)
+    {
+        QString fname = indexPath(absdir);
+        if (fname.isEmpty() || !QDir().mkpath(QFileInfo(fname).absolutePath()))
+            return;
+
+        // written to a temporary file and renamed, so qconf processes
+        //   running at the same time never see a partial index
+        QSaveFile f(fname);
+        if (!f.open(QFile::WriteOnly))
+            return;
+        QDataStream out(&f);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << quint32(IndexMagic) << quint32(IndexVersion) << absdir << quint32(entries.count());
+        for (QHash<QString, ModuleEntry>::ConstIterator it = entries.begin(); it != entries.end(); ++it) {
+            out << it->name << it->mtime << it->size << it->info.longname << it->info.section
+                << quint32(it->info.args.count());
+            foreach (const QCModArg &a, it->info.args)
+                out << a.name << a.arg << a.desc;
         }
-        conf = xmlToConf(base);
+        f.commit();
     }
+};
 
-    // see if the appdir looks like an in-place qconf build
-    QString appdir = QCoreApplication::applicationDirPath();
-    QString localDataPath;
-    if (looksLikeInPlace(appdir))
-        localDataPath = appdir;
+// Inputs that don't depend on the project: the conf sources and the
+//   module directories.  These are read once and shared by every project
+//   generated in the same run, possibly from several threads.
+class SharedInputs {
+public:
+    QString     confdirpath, stubpath;
+    QStringList    moddirs; // searched after the project's own moddirs
+    ModuleRegistry modules;
+    bool           writeBin;
+    bool           force; // ignore the input stamps
+    bool           check; // compare with the existing outputs instead of writing
+    Timings *      timings; // null unless --timings
 
-    QStringList moddirs;
-    if (!conf.moddirs.isEmpty())
-        moddirs += conf.moddirs;
+    SharedInputs() : writeBin(false), force(false), check(false), timings(0) { }
 
-    QString confdirpath;
-    if (!localDataPath.isEmpty()) {
-        moddirs += localDataPath + "/modules";
-        confdirpath = localDataPath + "/conf";
-    } else {
-#ifdef DATADIR
-        moddirs += QString(DATADIR) + "/qconf/modules";
-        confdirpath = QString(DATADIR) + "/qconf/conf";
-#else
-        moddirs += "./modules";
-        confdirpath = "./conf";
-#endif
+    void addTiming(const QString &phase, QElapsedTimer *timer)
+    {
+        if (timings)
+            timings->add(phase, timer);
     }
 
-    QDir confdir(confdirpath);
-    if (!confdir.exists()) {
-#ifdef Q_OS_WIN
-        confdir = QDir(appdir + "/../share/qconf/conf");
-        if (!confdir.exists()) {
-#endif
-            printf("qconf: %s does not exist.\n", qPrintable(confdir.absolutePath()));
-            return 1;
-#ifdef Q_OS_WIN
+    // conf4.h, conf4.cpp and conf4.pro, or conf.cpp and conf.pro for qt3
+    bool confFiles(bool qt4, QByteArray *confh, QByteArray *confcpp, QByteArray *confpro, QString *error)
+    {
+        QMutexLocker locker(&mutex);
+        ConfFiles &  files = qt4 ? conf4 : conf3;
+        if (!files.loaded) {
+            QDir confdir(confdirpath);
+            if (qt4 && !readFile(confdir.filePath("conf4.h"), &files.h)) {
+                *error = QString("qconf: cannot read %1\n").arg(confdir.filePath("conf4.h"));
+                return false;
+            }
+            QString fname = confdir.filePath(qt4 ? "conf4.cpp" : "conf.cpp");
+            if (!readFile(fname, &files.cpp)) {
+                *error = QString("qconf: cannot read %1\n").arg(fname);
+                return false;
+            }
+            fname = confdir.filePath(qt4 ? "conf4.pro" : "conf.pro");
+            if (!readFile(fname, &files.pro)) {
+                *error = QString("qconf: cannot read %1\n").arg(fname);
+                return false;
+            }
+            files.pro += "\nDEFINES += HAVE_MODULES\n";
+            files.pro += "\ngreaterThan(QT_MAJOR_VERSION, 4):CONFIG += c++11\n";
+            files.loaded = true;
         }
-#endif
+        *confh   = files.h;
+        *confcpp = files.cpp;
+        *confpro = files.pro;
+        return true;
     }
 
-    QFile      f;
-    QByteArray confh;
-    if (conf.qt4) {
-        f.setFileName(confdir.filePath("conf4.h"));
-        if (!f.open(QFile::ReadOnly)) {
-            printf("qconf: cannot read %s\n", qPrintable(f.fileName()));
-            return 1;
+    // the native stub for configure.bin
+    bool configBinStub(QByteArray *out, QString *error)
+    {
+        QMutexLocker locker(&mutex);
+        if (stub.isEmpty() && !readFile(stubpath, &stub)) {
+            *error = QString("qconf: cannot read %1\n").arg(stubpath);
+            return false;
         }
-        confh = f.readAll();
-        f.close();
+        *out = stub;
+        return true;
     }
 
-    f.setFileName(confdir.filePath(conf.qt4 ? "conf4.cpp" : "conf.cpp"));
+private:
+    class ConfFiles {
+    public:
+        bool       loaded;
+        QByteArray h, cpp, pro;
+
+        ConfFiles() : loaded(false) { }
+    };
+
+    QMutex     mutex;
+    ConfFiles  conf3, conf4;
+    QByteArray stub;
+};
+
+static bool loadQcFile(const QString &fname, Conf *conf, QString *log, SharedInputs *shared)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QFile f(fname);
     if (!f.open(QFile::ReadOnly)) {
-        printf("qconf: cannot read %s\n", qPrintable(f.fileName()));
-        return 1;
+        *log += QString("qconf: error reading %1\n").arg(f.fileName());
+        return false;
     }
-    QByteArray confcpp = f.readAll();
+    ConfLoadResult r = xmlToConf(&f, conf);
     f.close();
+    if (r == ConfParseError) {
+        *log += QString("qconf: error parsing %1\n").arg(f.fileName());
+        return false;
+    }
+    if (r == ConfBadFormat) {
+        *log += QString("qconf: bad format of %1\n").arg(f.fileName());
+        return false;
+    }
+    shared->addTiming("load", &timer);
+    return true;
+}
 
-    f.setFileName(confdir.filePath(conf.qt4 ? "conf4.pro" : "conf.pro"));
-    if (!f.open(QFile::ReadOnly)) {
-        printf("qconf: cannot read %s\n", qPrintable(f.fileName()));
-        return 1;
+// one line of the input stamp: hash and name of an input
+static QString stampLine(const QByteArray &data, const QString &name)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex()) + ' ' + name
+        + '\n';
+}
+
+static bool writeOutput(const QString &fname, const QByteArray &data, bool executable)
+{
+    QFile out(fname);
+    if (!out.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    out.write(data);
+    out.close();
+#ifdef Q_OS_UNIX
+    if (executable)
+        chmod(QFile::encodeName(fname).data(), 0755);
+#else
+    Q_UNUSED(executable);
+#endif
+    return true;
+}
+
+// writes configure, configure.exe and possibly configure.bin for conf into
+//   outdir.  relative moddirs of the project are taken from outdir as well.
+//
+// the hashes of all inputs are recorded in outdir/.qconfstamp, and
+//   nothing is written if they match the previous run.  with --check,
+//   the outputs are compared with the existing files instead.
+static bool generateProject(Conf conf, const QString &qcfile, const QString &outdir, SharedInputs *shared,
+                            QString *log)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir       dir(outdir);
+    QByteArray confh, confcpp, confpro;
+    QString    error;
+    if (!shared->confFiles(conf.qt4, &confh, &confcpp, &confpro, &error)) {
+        *log += error;
+        return false;
     }
-    QByteArray confpro = f.readAll();
-    f.close();
-    confpro += "\nDEFINES += HAVE_MODULES\n";
-    confpro += "\ngreaterThan(QT_MAJOR_VERSION, 4):CONFIG += c++11\n";
 
-    printf("Project name: %s\n", qPrintable(conf.name));
-    printf("Profile: %s\n", qPrintable(conf.profile));
-    printf("Deps: ");
+    QByteArray qcdata;
+    if (!readFile(qcfile, &qcdata)) {
+        *log += QString("qconf: error reading %1\n").arg(qcfile);
+        return false;
+    }
+    QString stamp = QString("qconf %1\n").arg(VERSION);
+    stamp += stampLine(qcdata, QFileInfo(qcfile).fileName());
+
+    QStringList moddirs;
+    foreach (const QString &moddir, conf.moddirs)
+        moddirs += dir.filePath(moddir);
+    moddirs += shared->moddirs;
+
+    *log += QString("Project name: %1\n").arg(conf.name);
+    *log += QString("Profile: %1\n").arg(conf.profile);
+    *log += "Deps: ";
     if (conf.deps.isEmpty())
-        printf("none\n");
+        *log += "none\n";
     else {
         bool first = true;
         for (QList<Dep>::ConstIterator it = conf.deps.begin(); it != conf.deps.end(); ++it) {
             const Dep &dep = *it;
-            printf("%s%s%s", first ? "" : " ", qPrintable(dep.name), dep.required ? "*" : "");
+            *log += (first ? "" : " ") + dep.name + (dep.required ? "*" : "");
             first = false;
         }
-        printf("\n");
+        *log += "\n";
     }
-    printf("\n");
+    *log += "\n";
 
     // look up dep module information
     QByteArray allmods;
@@ -1518,7 +2190,7 @@ int main(int argc, char **argv)
     for (QList<Dep>::Iterator it = conf.deps.begin(); it != conf.deps.end(); ++it) {
         Dep &dep = *it;
 
-        if (dep.pkgconfig) {
+        if (dep.pkgconfig || dep.qtmodule) {
             QString desc    = dep.longname;
             QString modestr = "VersionAny";
             if (dep.pkgvermode != VersionAny) {
@@ -1534,8 +2206,9 @@ int main(int argc, char **argv)
                 }
                 desc += dep.pkgver;
             }
-            modscreate += QString("    o = new qc_internal_pkgconfig(conf, \"%1\", \"%2\", %3, \"%4\");\n    "
-                                  "o->required = %5;\n    o->disabled = %6;\n")
+            modscreate += QString("    o = new %1(conf, \"%2\", \"%3\", %4, \"%5\");\n    "
+                                  "o->required = %6;\n    o->disabled = %7;\n")
+                              .arg(dep.qtmodule ? "qc_internal_qtmodule" : "qc_internal_pkgconfig")
                               .arg(dep.pkgname)
                               .arg(desc)
                               .arg(modestr)
@@ -1546,36 +2219,23 @@ int main(int argc, char **argv)
         }
 
         // look for module
-        QString   modfname = QString("%1.qcm").arg(dep.name);
-        QFileInfo fi;
-        bool      found = false;
-        for (QStringList::ConstIterator mit = moddirs.begin(); mit != moddirs.end(); ++mit) {
-            QDir moddir(*mit);
-            fi.setFile(moddir.filePath(modfname));
-            // printf("checking for: [%s]\n", fi.filePath().latin1());
-            if (fi.exists()) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            printf("qconf: no such module '%s'!\n", qPrintable(dep.name));
-            return 1;
+        ModuleEntry mod;
+        QByteArray  buf;
+        if (!shared->modules.find(dep.name, moddirs, &mod)) {
+            *log += QString("qconf: no such module '%1'!\n").arg(dep.name);
+            return false;
         }
-        QFile mod(fi.filePath());
-        if (!mod.open(QFile::ReadOnly | QFile::Text)) {
-            printf("qconf: error opening '%s'!\n", qPrintable(mod.fileName()));
-            return 1;
+        if (!shared->modules.contents(mod.path, &buf)) {
+            *log += QString("qconf: error opening '%1'!\n").arg(mod.path);
+            return false;
         }
-        QByteArray buf = mod.readAll();
-        mod.close();
 
-        QCModInfo info = QCModInfo::getModInfo(buf);
-        dep.longname   = info.longname;
-        dep.section    = info.section;
-        dep.args       = info.args;
+        dep.longname = mod.info.longname;
+        dep.section  = mod.info.section;
+        dep.args     = mod.info.args;
 
-        allmods += (QString("#line 1 \"%1\"\n").arg(modfname).toLocal8Bit() + buf);
+        allmods += (QString("#line 1 \"%1.qcm\"\n").arg(dep.name).toLocal8Bit() + buf);
+        stamp += stampLine(buf, mod.path);
 
         modscreate += QString("    o = new qc_%1(conf);\n    o->required = %2;\n    o->disabled = %3;\n")
                           .arg(escapeArg(dep.name))
@@ -1583,14 +2243,8 @@ int main(int argc, char **argv)
                           .arg(dep.disabled ? "true" : "false");
     }
     QByteArray modsnew = modscreate.toLatin1();
+    shared->addTiming("modules", &timer);
 
-    // write configure
-    QFile out;
-    out.setFileName("configure");
-    if (!out.open(QFile::WriteOnly | QFile::Truncate)) {
-        printf("qconf: error writing configure\n");
-        return 1;
-    }
     ConfGen cg;
     cg.name    = conf.name;
     cg.profile = conf.profile;
@@ -1648,28 +2302,360 @@ int main(int argc, char **argv)
         cg.addAppOption(a.name, a.arg, QString("QC_") + escapeArg(a.name.toUpper()), a.desc);
     }
 
-    QByteArray cs = cg.generate();
-    out.write(cs);
-    out.close();
-#ifdef Q_OS_UNIX
-    chmod("configure", 0755);
-#endif
+    QStringList outputs;
+    outputs += "configure";
+    QByteArray exestub, binstub;
+    if (conf.qt4) {
+        outputs += "configure.exe";
+        exestub = get_configexe_stub();
+        if (shared->writeBin) {
+            outputs += "configure.bin";
+            if (!shared->configBinStub(&binstub, &error)) {
+                *log += error;
+                return false;
+            }
+        }
+    }
 
-    printf("'configure' written.\n");
+    stamp += stampLine(confh, "conf.h");
+    stamp += stampLine(confcpp, "conf.cpp");
+    stamp += stampLine(confpro, "conf.pro");
+    stamp += stampLine(exestub, "configexe_stub.exe");
+    if (!binstub.isEmpty())
+        stamp += stampLine(binstub, "configexe_stub");
+    stamp += QString("outputs %1\n").arg(outputs.join(" "));
+
+    QString    stampPath = dir.filePath(".qconfstamp");
+    QByteArray oldStamp;
+    bool       upToDate
+        = !shared->force && !shared->check && readFile(stampPath, &oldStamp) && oldStamp == stamp.toUtf8();
+    foreach (const QString &output, outputs)
+        upToDate = upToDate && QFileInfo(dir.filePath(output)).exists();
+    if (upToDate) {
+        foreach (const QString &output, outputs)
+            *log += QString("'%1' is up to date, skipped.\n").arg(output);
+        return true;
+    }
 
+    // outputs[n] is generated into data[n]
+    QList<QByteArray> data;
+    timer.restart();
+    data += cg.generate();
+    shared->addTiming("generate", &timer);
     if (conf.qt4) {
-        // write configexe
-        out.setFileName("configure.exe");
-        if (!out.open(QFile::WriteOnly | QFile::Truncate)) {
-            printf("qconf: error writing configure.exe\n");
+        data += cg.generateExe(exestub);
+        if (shared->writeBin)
+            data += cg.generateExe(binstub, true);
+        shared->addTiming("generateExe", &timer);
+    }
+
+    if (shared->check) {
+        bool same = true;
+        for (int n = 0; n < outputs.count(); ++n) {
+            QByteArray old;
+            if (!readFile(dir.filePath(outputs[n]), &old)) {
+                *log += QString("'%1' is missing.\n").arg(outputs[n]);
+                same = false;
+            } else if (old != data[n]) {
+                *log += QString("'%1' differs from the generated output.\n").arg(outputs[n]);
+                same = false;
+            } else {
+                *log += QString("'%1' matches.\n").arg(outputs[n]);
+            }
+        }
+        return same;
+    }
+
+    // a stale stamp must not survive a partial write
+    QFile::remove(stampPath);
+
+    for (int n = 0; n < outputs.count(); ++n) {
+        // only the windows program is not made executable
+        if (!writeOutput(dir.filePath(outputs[n]), data[n], outputs[n] != "configure.exe")) {
+            *log += QString("qconf: error writing %1\n").arg(outputs[n]);
+            return false;
+        }
+        *log += QString("'%1' written.\n").arg(outputs[n]);
+    }
+    shared->addTiming("write", &timer);
+
+    if (!writeOutput(stampPath, stamp.toUtf8(), false))
+        *log += QString("qconf: warning: unable to write %1\n").arg(stampPath);
+
+    return true;
+}
+
+// one project of a --batch run
+class BatchJob : public QRunnable {
+public:
+    QString       fname;
+    SharedInputs *shared;
+    QMutex *      printMutex;
+    QAtomicInt *  failures;
+
+    void run()
+    {
+        QString log;
+        Conf    conf;
+        bool    ok = loadQcFile(fname, &conf, &log, shared)
+            && generateProject(conf, fname, QFileInfo(fname).absolutePath(), shared, &log);
+        if (!ok)
+            failures->ref();
+
+        QMutexLocker locker(printMutex);
+        printf("== %s\n%s\n", qPrintable(fname), qPrintable(log));
+        fflush(stdout);
+    }
+};
+
+// adds the .qc files in path, searching directories recursively
+static void collectQcFiles(const QString &path, QStringList *out)
+{
+    QFileInfo fi(path);
+    if (!fi.isDir()) {
+        *out += path;
+        return;
+    }
+    QDirIterator it(path, QStringList() << "*.qc", QDir::Files, QDirIterator::Subdirectories);
+    QStringList  list;
+    while (it.hasNext())
+        list += it.next();
+    list.sort();
+    *out += list;
+}
+
+// the tests include this file and bring their own main
+#ifndef QC_NO_MAIN
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    Conf             conf;
+    QString          fname;
+    bool             skipLoad = false;
+    SharedInputs     shared;
+    Timings          timings;
+    QElapsedTimer    total;
+    total.start();
+
+    bool        batch       = false;
+    int         jobs        = 0;
+    bool        listModules = false;
+    QString     moduleInfo;
+    QStringList batchPaths;
+    for (int n = 1; n < argc; ++n) {
+        QString cs = argv[n];
+        if (cs.left(2) == "--") {
+            if (cs == "--help") {
+                printf("Usage: qconf [options] [.qc file]\n");
+                printf("       qconf --batch [--jobs=N] [options] <.qc file or dir>...\n");
+                printf("       qconf --list-modules|--module-info=NAME [module dir]...\n\n");
+                printf("Options:\n");
+                printf("  --bin        Also write configure.bin, a native configure program\n");
+                printf("  --force      Regenerate even if no input changed since the last run\n");
+                printf("  --check      Compare the generated output with the existing files\n");
+                printf("               instead of writing it.  Fails if they differ.\n");
+                printf("  --timings    Show the time and peak memory of each phase\n");
+                printf("  --batch      Generate every given project, next to its .qc file.\n");
+                printf("               Directories are searched for .qc files recursively.\n");
+                printf("  --jobs=N     Number of projects to generate in parallel with --batch\n");
+                printf("  --list-modules      List the available modules\n");
+                printf("  --module-info=NAME  Show the description and options of a module\n");
+                printf("  --version    Show version number\n");
+                printf("  --help       This help\n");
+                printf("\n");
+                return 0;
+            } else if (cs == "--version") {
+                printf("qconf version: %s by Psi IM Team\n", VERSION);
+                return 0;
+            } else if (cs == "--bin") {
+                shared.writeBin = true;
+            } else if (cs == "--force") {
+                shared.force = true;
+            } else if (cs == "--check") {
+                shared.check = true;
+            } else if (cs == "--timings") {
+                shared.timings = &timings;
+            } else if (cs == "--batch") {
+                batch = true;
+            } else if (cs.startsWith("--jobs=")) {
+                jobs = cs.mid(7).toInt();
+            } else if (cs == "--list-modules") {
+                listModules = true;
+            } else if (cs.startsWith("--module-info=")) {
+                moduleInfo = cs.mid(14);
+            } else {
+                printf("Unknown option: %s\n", qPrintable(cs));
+                return 0;
+            }
+        } else {
+            batchPaths += QFile::decodeName(QByteArray(argv[n]));
+            if (fname.isEmpty())
+                fname = batchPaths.last();
+        }
+    }
+
+    if (listModules || !moduleInfo.isEmpty()) {
+        // positional arguments are module dirs here
+    } else if (batch) {
+        if (batchPaths.isEmpty()) {
+            printf("qconf: no .qc files or directories given.\n");
+            return 1;
+        }
+    } else if (fname.isEmpty()) {
+        // try to find a .qc file
+        QDir        cur;
+        QStringList list = cur.entryList(QStringList() << "*.qc");
+        if (list.isEmpty()) {
+            // try to find a .pro file to work from
+            list = cur.entryList(QStringList() << "*.pro");
+            if (list.isEmpty()) {
+                printf("qconf: no .qc or .pro file found.\n");
+                return 1;
+            }
+            QFileInfo fi(cur.filePath(list[0]));
+            conf.name    = fi.baseName();
+            conf.profile = fi.fileName();
+
+            // save to .qc
+            fname = conf.name + ".qc";
+            QFile f(fname);
+            if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+                printf("qconf: unable to write %s\n", qPrintable(fname));
+                return 1;
+            }
+            QDomDocument doc;
+            QDomElement  e = doc.createElement("qconf");
+            QDomElement  i;
+            i = doc.createElement("name");
+            i.appendChild(doc.createTextNode(conf.name));
+            e.appendChild(i);
+            i = doc.createElement("profile");
+            i.appendChild(doc.createTextNode(conf.profile));
+            e.appendChild(i);
+            doc.appendChild(e);
+            QByteArray cs = doc.toString().toUtf8();
+            f.write(cs);
+            f.close();
+            skipLoad = true;
+        } else {
+            fname = list[0];
+        }
+    }
+
+    if (!batch && !skipLoad && !listModules && moduleInfo.isEmpty()) {
+        QString log;
+        if (!loadQcFile(fname, &conf, &log, &shared)) {
+            printf("%s", qPrintable(log));
             return 1;
         }
-        cs = cg.generateExe();
-        out.write(cs);
-        out.close();
+    }
+
+    // see if the appdir looks like an in-place qconf build
+    QString appdir = QCoreApplication::applicationDirPath();
+    QString localDataPath;
+    if (looksLikeInPlace(appdir))
+        localDataPath = appdir;
 
-        printf("'configure.exe' written.\n");
+    QString confdirpath;
+    if (!localDataPath.isEmpty()) {
+        shared.moddirs += localDataPath + "/modules";
+        confdirpath     = localDataPath + "/conf";
+        shared.stubpath = localDataPath + "/src/configexe/configexe_stub";
+    } else {
+#ifdef DATADIR
+        shared.moddirs += QString(DATADIR) + "/qconf/modules";
+        confdirpath     = QString(DATADIR) + "/qconf/conf";
+        shared.stubpath = QString(DATADIR) + "/qconf/configexe_stub";
+#else
+        shared.moddirs += QDir::current().absoluteFilePath("modules");
+        confdirpath     = "./conf";
+        shared.stubpath = QDir::current().absoluteFilePath("src/configexe/configexe_stub");
+#endif
+    }
+
+    if (listModules || !moduleInfo.isEmpty()) {
+        QStringList dirs = batchPaths + shared.moddirs;
+        if (listModules) {
+            foreach (const ModuleEntry &mod, shared.modules.list(dirs)) {
+                QString section = mod.info.section.isEmpty() ? QString() : QString(" [%1]").arg(mod.info.section);
+                printf("%-20s %s%s\n", qPrintable(mod.name), qPrintable(mod.info.longname), qPrintable(section));
+            }
+            return 0;
+        }
+
+        ModuleEntry mod;
+        if (!shared.modules.find(moduleInfo, dirs, &mod)) {
+            printf("qconf: no such module '%s'!\n", qPrintable(moduleInfo));
+            return 1;
+        }
+        printf("Module: %s\n", qPrintable(mod.name));
+        printf("File: %s\n", qPrintable(mod.path));
+        printf("Name: %s\n", qPrintable(mod.info.longname));
+        if (!mod.info.section.isEmpty())
+            printf("Section: %s\n", qPrintable(mod.info.section));
+        if (!mod.info.args.isEmpty()) {
+            printf("Options:\n");
+            foreach (const QCModArg &a, mod.info.args) {
+                QString opt = "--" + a.name + (a.arg.isEmpty() ? QString() : "=[" + a.arg + "]");
+                printf("  %-30s %s\n", qPrintable(opt), qPrintable(a.desc));
+            }
+        }
+        return 0;
+    }
+
+    QDir confdir(confdirpath);
+    if (!confdir.exists()) {
+#ifdef Q_OS_WIN
+        confdir = QDir(appdir + "/../share/qconf/conf");
+        if (!confdir.exists()) {
+#endif
+            printf("qconf: %s does not exist.\n", qPrintable(confdir.absolutePath()));
+            return 1;
+#ifdef Q_OS_WIN
+        }
+#endif
+    }
+    shared.confdirpath = confdir.absolutePath();
+
+    if (!batch) {
+        QString log;
+        bool    ok = generateProject(conf, fname, QDir::currentPath(), &shared, &log);
+        printf("%s", qPrintable(log));
+        if (shared.timings) {
+            timings.add("total", &total);
+            printf("\n%s", qPrintable(timings.report()));
+        }
+        return ok ? 0 : 1;
     }
 
-    return 0;
+    QStringList files;
+    foreach (const QString &path, batchPaths)
+        collectQcFiles(path, &files);
+
+    QThreadPool pool;
+    if (jobs > 0)
+        pool.setMaxThreadCount(jobs);
+    QMutex     printMutex;
+    QAtomicInt failures(0);
+    foreach (const QString &file, files) {
+        BatchJob *job   = new BatchJob;
+        job->fname      = file;
+        job->shared     = &shared;
+        job->printMutex = &printMutex;
+        job->failures   = &failures;
+        pool.start(job);
+    }
+    pool.waitForDone();
+
+    int failed = failures.loadAcquire();
+    if (shared.check)
+        printf("%d of %d projects match.\n", files.count() - failed, files.count());
+    else
+        printf("%d of %d projects generated.\n", files.count() - failed, files.count());
+    if (shared.timings) {
+        timings.add("total", &total);
+        printf("\n%s", qPrintable(timings.report()));
+    }
+    return failed ? 1 : 0;
 }
+#endif
@@ -20,26 +20,22 @@
 
 #include "stringhelp.h"
 
-static QString getNext(QString *str)
+// finds the next word of str at *pos, along with the whitespace in front
+//   of it.  returns false if only whitespace is left.
+static bool getNext(QStringView str, int *pos, QStringView *word)
 {
-    if (str->isEmpty())
-        return QString();
-
-    // are we in space?
-    int n = 0;
-    if (str->at(n).isSpace()) {
-        // get out of it
-        while (n < (int)str->length() && str->at(n).isSpace())
-            ++n;
-        if (n == (int)str->length())
-            return QString();
-    }
+    int start = *pos;
+    int n     = start;
+    while (n < (int)str.size() && str[n].isSpace())
+        ++n;
+    if (n == (int)str.size())
+        return false;
     // find end or next space
-    while (n < (int)str->length() && !str->at(n).isSpace())
+    while (n < (int)str.size() && !str[n].isSpace())
         ++n;
-    QString result = str->mid(0, n);
-    *str           = str->mid(n);
-    return result;
+    *word = str.mid(start, n - start);
+    *pos  = n;
+    return true;
 }
 
 // wraps a string against a fixed width
@@ -47,34 +43,26 @@ QStringList wrapString(const QString &str, int wid)
 {
     QStringList lines;
     QString     cur;
-    QString     tmp       = str;
+    QStringView word;
+    int         pos       = 0;
     bool        firstword = true;
-    // printf("parsing: [%s]\n", qPrintable(tmp));
-    while (1) {
-        QString word = getNext(&tmp);
-        if (word.isNull()) {
-            lines += cur;
-            break;
-        }
-        // printf("word:[%s]\n", qPrintable(word));
+    while (getNext(str, &pos, &word)) {
         if (!cur.isEmpty()) {
-            if ((int)cur.length() + (int)word.length() > wid) {
+            if ((int)cur.length() + (int)word.size() > wid) {
                 lines += cur;
-                cur = "";
+                cur.clear();
             }
         }
         if (cur.isEmpty() && !firstword) {
             // trim the whitespace in front
-            for (int n = 0; n < (int)word.length(); ++n) {
-                if (!word.at(n).isSpace()) {
-                    if (n > 0)
-                        word = word.mid(n);
-                    break;
-                }
-            }
+            int n = 0;
+            while (n < (int)word.size() && word[n].isSpace())
+                ++n;
+            word = word.mid(n);
         }
-        cur += word;
+        cur.append(word.data(), word.size());
         firstword = false;
     }
+    lines += cur;
     return lines;
 }
@@ -0,0 +1,51 @@
+#!/bin/sh
+#
+# bench.sh - times qconf on synthetic projects and checks its output
+#
+# usage: bench.sh <qconf> [reference qconf]
+#
+# Generates a small and a large synthetic project (QC_BENCH_DEPS and
+# QC_BENCH_ARGS set the size of the large one) and shows the --timings
+# report of <qconf> for each.  With a reference qconf, e.g. one built from
+# the previous commit, the reference writes the outputs first and <qconf>
+# has to reproduce them byte for byte (qconf --check).
+
+set -e
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 <qconf> [reference qconf]" >&2
+	exit 1
+fi
+
+abspath() {
+	case "$1" in
+		/*) echo "$1" ;;
+		*) echo "$PWD/$1" ;;
+	esac
+}
+
+gen=`abspath "$0"`
+gen="`dirname "$gen"`/gensynthetic.sh"
+qconf=`abspath "$1"`
+ref=
+if [ -n "$2" ]; then
+	ref=`abspath "$2"`
+fi
+
+tmp=`mktemp -d "${TMPDIR:-/tmp}/qconfbench.XXXXXX"`
+trap 'rm -rf "$tmp"' EXIT
+
+sh "$gen" "$tmp/small" 50 20
+sh "$gen" "$tmp/large" "${QC_BENCH_DEPS:-2000}" "${QC_BENCH_ARGS:-500}"
+
+failed=0
+for p in small large; do
+	echo "== $p"
+	if [ -n "$ref" ]; then
+		(cd "$tmp/$p" && "$ref" synthetic.qc >/dev/null)
+		(cd "$tmp/$p" && "$qconf" --check --timings synthetic.qc) || failed=1
+	else
+		(cd "$tmp/$p" && "$qconf" --force --timings synthetic.qc) || failed=1
+	fi
+done
+exit $failed
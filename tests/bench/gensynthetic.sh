@@ -0,0 +1,87 @@
+#!/bin/sh
+#
+# gensynthetic.sh - writes a synthetic qconf project for benchmarks
+#
+# usage: gensynthetic.sh <dir> [deps] [args]
+#
+# <dir>/synthetic.qc gets [deps] deps (default 2000) and [args] options of
+# its own (default 500).  Every fourth dep is a pkg-config one, the others
+# use a module of their own in <dir>/modules with two options each.  The
+# output only depends on the arguments, so two qconf builds can be
+# compared on it.
+
+set -e
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 <dir> [deps] [args]" >&2
+	exit 1
+fi
+dir=$1
+deps=${2:-2000}
+args=${3:-500}
+
+mkdir -p "$dir/modules"
+
+echo "TEMPLATE = app" >"$dir/synthetic.pro"
+
+{
+	echo "<qconf>"
+	echo "  <name>Synthetic $deps/$args</name>"
+	echo "  <profile>synthetic.pro</profile>"
+	echo "  <moddir>modules</moddir>"
+
+	n=0
+	while [ $n -lt "$deps" ]; do
+		if [ $((n % 4)) -eq 3 ]; then
+			echo "  <dep type='pkg' name='Synthetic package $n' pkgname='synth$n' version='&gt;=1.$n'/>"
+		elif [ $((n % 3)) -eq 0 ]; then
+			echo "  <dep type='synth$n'><required/></dep>"
+		else
+			echo "  <dep type='synth$n'/>"
+		fi
+		n=$((n + 1))
+	done
+
+	n=0
+	while [ $n -lt "$args" ]; do
+		if [ $((n % 2)) -eq 0 ]; then
+			echo "  <arg name='with-option$n' arg='value'>Value of option $n of the synthetic project, with a description long enough to be wrapped in the help output</arg>"
+		else
+			echo "  <arg name='enable-option$n'>Enable option $n</arg>"
+		fi
+		n=$((n + 1))
+	done
+
+	echo "</qconf>"
+} >"$dir/synthetic.qc"
+
+n=0
+while [ $n -lt "$deps" ]; do
+	if [ $((n % 4)) -ne 3 ]; then
+		cat >"$dir/modules/synth$n.qcm" <<EOT
+/*
+-----BEGIN QCMOD-----
+name: Synthetic module $n
+section: Section $((n % 8))
+arg: with-synth$n-inc=[path],Path to the include files of synthetic module $n
+arg: disable-synth$n-extra,Leave out the extra parts of synthetic module $n
+-----END QCMOD-----
+*/
+class qc_synth$n : public ConfObj
+{
+public:
+	qc_synth$n(Conf *c) : ConfObj(c) {}
+	QString name() const { return "Synthetic module $n"; }
+	QString shortname() const { return "synth$n"; }
+	bool exec()
+	{
+		QString s = conf->getenv("QC_WITH_SYNTH${n}_INC");
+		if (!s.isEmpty())
+			conf->addIncludePath(s);
+		return true;
+	}
+};
+EOT
+	fi
+	n=$((n + 1))
+done
@@ -0,0 +1,147 @@
+/*
+tst_checkheaders.cpp - tests for Conf::checkHeaders of conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+class TestCheckHeaders : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir scratch, include;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(scratch.isValid());
+        QVERIFY(include.isValid());
+        qputenv("QC_TMPDIR", QFile::encodeName(scratch.path()));
+        qputenv("QC_SERVICE", "");
+    }
+
+    // found is given as "10" for the first header there and the second
+    // not, with - for one without an answer
+    void markers_data()
+    {
+        QTest::addColumn<QByteArray>("out");
+        QTest::addColumn<int>("count");
+        QTest::addColumn<QString>("found");
+        QTest::addColumn<int>("answered");
+
+        QTest::newRow("gcc") << QByteArray("# 1 \"headers.cpp\"\n"
+                                           "# 1 \"<built-in>\"\n"
+                                           "\n"
+                                           "\"qconf-header 0 1\"\n"
+                                           "\n"
+                                           "\"qconf-header 1 0\"\n")
+                             << 2 << "10" << 2;
+        QTest::newRow("msvc") << QByteArray("#line 1 \"C:\\\\tmp\\\\headers.cpp\"\r\n"
+                                            "\"qconf-header 0 0\"\r\n"
+                                            "  \"qconf-header 1 1\"\r\n")
+                              << 2 << "01" << 2;
+        QTest::newRow("quotes dropped") << QByteArray("qconf-header 0 1\n") << 1 << "1" << 1;
+        QTest::newRow("no __has_include") << QByteArray("# 1 \"headers.cpp\"\n\n") << 2 << "--" << 0;
+        QTest::newRow("out of range") << QByteArray("\"qconf-header 2 1\"\n\"qconf-header -1 1\"\n") << 2 << "--"
+                                      << 0;
+        QTest::newRow("not a marker") << QByteArray("\"qconf-header x 1\"\n\"qconf-header 0\"\n\"other 0 1\"\n") << 1
+                                      << "-" << 0;
+        QTest::newRow("some") << QByteArray("\"qconf-header 1 1\"\n") << 3 << "-1-" << 1;
+    }
+
+    void markers()
+    {
+        QFETCH(QByteArray, out);
+        QFETCH(int, count);
+        QFETCH(QString, found);
+        QFETCH(int, answered);
+
+        // a header without an answer keeps what it had
+        QList<bool> list;
+        for (int n = 0; n < count; ++n)
+            list += true;
+        QCOMPARE(qc_parse_header_markers(out, &list), answered);
+
+        QString got;
+        foreach (bool b, list)
+            got += b ? '1' : '0';
+        QCOMPARE(got, QString(found).replace('-', '1'));
+    }
+
+    // flags are joined with |
+    void makefileFlags_data()
+    {
+        QTest::addColumn<QByteArray>("makefile");
+        QTest::addColumn<QString>("flags");
+
+        QTest::newRow("gcc") << QByteArray(
+            "CC            = gcc\n"
+            "CXX           = g++\n"
+            "DEFINES       = -DQT_NO_DEBUG -DQT_CORE_LIB\n"
+            "CXXFLAGS      = -pipe -O2 -std=gnu++11 $(EXPORT_ARCH_ARGS) -fPIC $(DEFINES)\n"
+            "INCPATH       = -I. -I../include -isystem /usr/include/qt5 -I/usr/lib/qt5/mkspecs/linux-g++\n"
+            "EXPORT_ARCH_ARGS = $(foreach arch, $(if $(EXPORT_ACTIVE_ARCHS), $(EXPORT_ACTIVE_ARCHS), "
+            "$(EXPORT_VALID_ARCHS)), -arch $(arch))\n"
+            "\n"
+            "atest.o: atest.cpp\n"
+            "\t$(CXX) -c $(CXXFLAGS) $(INCPATH) -o atest.o atest.cpp\n")
+                             << "-pipe|-O2|-std=gnu++11|-fPIC|-DQT_NO_DEBUG|-DQT_CORE_LIB|-I/build/include|"
+                                "-isystem|/usr/include/qt5|-I/usr/lib/qt5/mkspecs/linux-g++";
+        QTest::newRow("defines not in cxxflags") << QByteArray("DEFINES = -DA\nCXXFLAGS = -O2\nINCPATH = -Iinc\n")
+                                                 << "-DA|-O2|-I/build/atest/inc";
+        QTest::newRow("continued") << QByteArray("CXXFLAGS = -O2 \\\n  -g $(DEFINES)\n") << "-O2|-g";
+        QTest::newRow("nested") << QByteArray("A = $(B) -x\nB = -DB\nCXXFLAGS = $(A) $(UNKNOWN) $(DEFINES)\n")
+                                << "-DB|-x";
+        QTest::newRow("separate -I") << QByteArray("INCPATH = -I ../inc -I .\n") << "-I|/build/inc";
+        QTest::newRow("quoted") << QByteArray("INCPATH = -I\"/opt/my qt/include\"\n") << "-I/opt/my qt/include";
+        QTest::newRow("recipes and others") << QByteArray("CXXFLAGS = -O2 $(DEFINES)\n"
+                                                          "CXXFLAGS += -O0\n"
+                                                          "all:\n"
+                                                          "\tCXXFLAGS=-O1 make\n"
+                                                          "# CXXFLAGS = -O3\n")
+                                            << "-O2";
+    }
+
+    void makefileFlags()
+    {
+#ifndef Q_OS_UNIX
+        QSKIP("the paths are unix ones");
+#endif
+        QFETCH(QByteArray, makefile);
+        QFETCH(QString, flags);
+
+        QMap<QString, QString> vars = qc_makefile_vars(makefile);
+        QCOMPARE(qc_makefile_cxxflags(vars, "/build/atest").join("|"), flags);
+    }
+
+    // without a compiler that runs, the headers are looked for in the
+    // include dirs
+    void fallback()
+    {
+        QVERIFY(QDir(include.path()).mkpath("sub"));
+        QFile a(include.path() + "/a.h"), b(include.path() + "/sub/b.h");
+        QVERIFY(a.open(QFile::WriteOnly));
+        QVERIFY(b.open(QFile::WriteOnly));
+        a.close();
+        b.close();
+
+        qputenv("QC_CXX", QFile::encodeName(scratch.path() + "/no-such-compiler"));
+        qc_compiler_known = false;
+        Conf        conf;
+        QList<bool> found = conf.checkHeaders(QStringList() << "a.h"
+                                                            << "sub/b.h"
+                                                            << "missing.h",
+                                              QStringList() << include.path());
+        QCOMPARE(found, QList<bool>() << true << true << false);
+        QVERIFY(qc_compiler_flags(&conf).isEmpty());
+        qputenv("QC_CXX", "");
+    }
+};
+
+QTEST_GUILESS_MAIN(TestCheckHeaders)
+#include "tst_checkheaders.moc"
@@ -0,0 +1,14 @@
+QT      -= gui
+QT      += testlib
+CONFIG  += console testcase
+CONFIG  -= app_bundle
+TARGET   = tst_confhelpers
+
+greaterThan(QT_MAJOR_VERSION, 4):CONFIG += c++11
+
+# the test includes conf4.cpp, which then leaves out its main()
+DEFINES     += QC_NO_MAIN
+INCLUDEPATH += $$PWD/../../conf
+
+HEADERS += ../../conf/conf4.h
+SOURCES += tst_confhelpers.cpp
@@ -0,0 +1,242 @@
+/*
+tst_confhelpers.cpp - tests for the flag and path helpers of conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+// a linear helper gets 8 times slower on an 8 times longer input, a
+// quadratic one 64 times.  the limit leaves room for noise and caches.
+// wall-clock ratios are no good on a loaded machine, so these are only
+// checked with QC_BENCH=Y, as "make bench" does.
+#define QC_MAX_SCALE 24
+
+static bool benchEnabled() { return qgetenv("QC_BENCH") == "Y"; }
+
+// a cflags line of about kbytes KB with every kind of quoting
+static QString longFlags(int kbytes)
+{
+    QString str;
+    for (int n = 0; str.length() < kbytes * 1024; ++n)
+        str += QString("-I/usr/include/pkg%1 '-DNAME%1=\"a b\"' \"-I/opt/dir %1\" -Wl,-rpath,/opt/lib%1 ").arg(n);
+    return str;
+}
+
+// a libs list of about kbytes KB, with repeated -L paths
+static QStringList longLibs(int kbytes)
+{
+    QStringList list;
+    int         len = 0;
+    for (int n = 0; len < kbytes * 1024; ++n) {
+        list += QString("-L/opt/lib%1").arg(n % 64);
+        list += QString("-lpkg%1").arg(n);
+        list += QString("/opt/my libs/libpkg%1.a").arg(n);
+        len += list[list.count() - 3].length() + list[list.count() - 2].length() + list.last().length();
+    }
+    return list;
+}
+
+// the best of a few runs, in nanoseconds
+static qint64 timeSplit(const QString &flags)
+{
+    qint64 best = -1;
+    for (int i = 0; i < 5; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        QStringList incs, other;
+        qc_splitcflags(flags, &incs, &other);
+        qint64 t = timer.nsecsElapsed();
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+static qint64 timeLibs(const QStringList &libs)
+{
+    qint64 best = -1;
+    for (int i = 0; i < 5; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        qc_prepare_libs(libs);
+        qint64 t = timer.nsecsElapsed();
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+class TestConfHelpers : public QObject {
+    Q_OBJECT
+
+private slots:
+    void splitflags_data()
+    {
+        QTest::addColumn<QString>("flags");
+        QTest::addColumn<QStringList>("args");
+
+        QTest::newRow("empty") << QString() << QStringList();
+        QTest::newRow("blank") << QString(" \t\n") << QStringList();
+        QTest::newRow("whitespace") << QString("  -I/a  -DX\t-lz\n") << (QStringList() << "-I/a"
+                                                                                    << "-DX"
+                                                                                    << "-lz");
+        QTest::newRow("quotes") << QString("\"-I/a b\" '-DY=\"1 2\"'") << (QStringList() << "-I/a b"
+                                                                                         << "-DY=\"1 2\"");
+        // before the fix a double quote was never closed, so this was one
+        // argument that still had the quotes in it
+        QTest::newRow("double quote closes") << QString("\"-I/a b\" -DX") << (QStringList() << "-I/a b"
+                                                                                            << "-DX");
+        QTest::newRow("escapes in double quotes") << QString("\"a\\\"b\\\\c\\d\"") << (QStringList() << "a\"b\\c\\d");
+        QTest::newRow("no escapes in single quotes") << QString("'a\\b'") << (QStringList() << "a\\b");
+        QTest::newRow("quotes inside a word") << QString("-DX=\"a b\"c") << (QStringList() << "-DX=a bc");
+        QTest::newRow("empty quotes") << QString("-a \"\" -b") << (QStringList() << "-a"
+                                                                                 << ""
+                                                                                 << "-b");
+        QTest::newRow("unterminated") << QString("-a \"b c") << (QStringList() << "-a"
+                                                                               << "b c");
+#ifdef Q_OS_WIN
+        QTest::newRow("backslash") << QString("C:\\a\\ b") << (QStringList() << "C:\\a\\"
+                                                                             << "b");
+#else
+        QTest::newRow("backslash") << QString("a\\ b \\\"c") << (QStringList() << "a b"
+                                                                               << "\"c");
+#endif
+    }
+
+    void splitflags()
+    {
+        QFETCH(QString, flags);
+        QFETCH(QStringList, args);
+
+        QCOMPARE(qc_splitflags(flags), args);
+    }
+
+    void splitcflags()
+    {
+        QStringList incs, other;
+        qc_splitcflags("-I/usr/include/foo -DFOO -I'/opt/x y' -pthread -isystem /s", &incs, &other);
+        QCOMPARE(incs, QStringList() << "/usr/include/foo"
+                                     << "/opt/x y");
+        QCOMPARE(other, QStringList() << "-DFOO"
+                                      << "-pthread"
+                                      << "-isystem"
+                                      << "/s");
+
+        // a separate -I argument is not understood
+        qc_splitcflags("-I /x", &incs, &other);
+        QCOMPARE(incs, QStringList() << "");
+        QCOMPARE(other, QStringList() << "/x");
+
+        // the lists are cleared first
+        qc_splitcflags("", &incs, &other);
+        QVERIFY(incs.isEmpty());
+        QVERIFY(other.isEmpty());
+    }
+
+    void escapeArg()
+    {
+        QCOMPARE(qc_escapeArg("with-foo-bar"), QString("with_foo_bar"));
+        QCOMPARE(qc_escapeArg("plain"), QString("plain"));
+        QCOMPARE(qc_escapeArg(""), QString(""));
+    }
+
+    void normalizePath_data()
+    {
+        QTest::addColumn<QString>("path");
+        QTest::addColumn<QString>("normalized");
+
+        QTest::newRow("plain") << QString("/usr/lib") << QString("/usr/lib");
+        QTest::newRow("whitespace") << QString("  /usr/lib/ \n") << QString("/usr/lib");
+        QTest::newRow("trailing slashes") << QString("a//") << QString("a");
+        QTest::newRow("root") << QString("/") << QString("");
+        QTest::newRow("double quotes") << QString("\"/opt/my dir/\"") << QString("/opt/my dir");
+        QTest::newRow("single quotes") << QString("'/x'") << QString("/x");
+        QTest::newRow("quoted whitespace") << QString("\" /a \"") << QString(" /a ");
+        QTest::newRow("unbalanced quote") << QString("\"/a") << QString("\"/a");
+#ifdef Q_OS_WIN
+        QTest::newRow("backslashes") << QString("C:\\x\\") << QString("C:/x");
+#endif
+    }
+
+    void normalizePath()
+    {
+        QFETCH(QString, path);
+        QFETCH(QString, normalized);
+
+        QCOMPARE(qc_normalize_path(path), normalized);
+    }
+
+    void escapeStringVar()
+    {
+        QCOMPARE(qc_escape_string_var("/a"), QString("/a"));
+        QCOMPARE(qc_escape_string_var("/a b"), QString("\"/a b\""));
+        QCOMPARE(qc_escape_string_var("C:\\x"), QString("C:\\\\x"));
+        QCOMPARE(qc_escape_string_var("a\"b c"), QString("\"a\\\"b c\""));
+    }
+
+    void prepareIncludepath()
+    {
+        QCOMPARE(qc_prepare_includepath(QStringList()), QString());
+        QCOMPARE(qc_prepare_includepath(QStringList() << "/a"
+                                                      << "/b c"),
+                 QString("/a \"/b c\""));
+    }
+
+    void prepareLibs()
+    {
+        QCOMPARE(qc_prepare_libs(QStringList()), QString());
+        QCOMPARE(qc_prepare_libs(QStringList() << "-lfoo"), QString("-lfoo"));
+        QCOMPARE(qc_prepare_libs(QStringList() << "-L/a"), QString(" -L/a "));
+        QCOMPARE(qc_prepare_libs(QStringList() << "-lfoo"
+                                               << "-L/a"
+                                               << "-lbar"
+                                               << "-L/b c"
+                                               << "-L/a"
+                                               << "/x y/libz.a"),
+                 QString(" -L/a -L\"/b c\" -lfoo -lbar \"/x y/libz.a\""));
+    }
+
+    void benchSplitcflags()
+    {
+        QString     flags = longFlags(8);
+        QStringList incs, other;
+        QBENCHMARK { qc_splitcflags(flags, &incs, &other); }
+        QVERIFY(!incs.isEmpty());
+    }
+
+    void benchPrepareLibs()
+    {
+        QStringList libs = longLibs(8);
+        QString     out;
+        QBENCHMARK { out = qc_prepare_libs(libs); }
+        QVERIFY(out.startsWith(" -L/opt/lib0 -L/opt/lib1 "));
+    }
+
+    void splitcflagsScales()
+    {
+        if (!benchEnabled())
+            QSKIP("set QC_BENCH=Y to check how this scales");
+        qint64 small = timeSplit(longFlags(64));
+        qint64 large = timeSplit(longFlags(512));
+        QVERIFY2(large < small * QC_MAX_SCALE,
+                 qPrintable(QString("64 KB took %1 us, 512 KB %2 us").arg(small / 1000).arg(large / 1000)));
+    }
+
+    void prepareLibsScales()
+    {
+        if (!benchEnabled())
+            QSKIP("set QC_BENCH=Y to check how this scales");
+        qint64 small = timeLibs(longLibs(64));
+        qint64 large = timeLibs(longLibs(512));
+        QVERIFY2(large < small * QC_MAX_SCALE,
+                 qPrintable(QString("64 KB took %1 us, 512 KB %2 us").arg(small / 1000).arg(large / 1000)));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestConfHelpers)
+#include "tst_confhelpers.moc"
@@ -0,0 +1,12 @@
+QT      -= gui
+QT      += xml testlib
+CONFIG  += console testcase
+CONFIG  -= app_bundle
+TARGET   = tst_escape
+
+# the test includes qconf.cpp, which then leaves out its main()
+DEFINES     += QC_NO_MAIN
+INCLUDEPATH += $$PWD/../../src
+
+HEADERS += ../../src/stringhelp.h
+SOURCES += tst_escape.cpp ../../src/stringhelp.cpp
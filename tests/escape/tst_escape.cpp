@@ -0,0 +1,154 @@
+/*
+ * tst_escape.cpp - tests and benchmarks for the escaping of embedded files
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <QtTest>
+
+#include "qconf.cpp"
+
+// escapeFile() and c_escape() as they were before they took a QStringView
+//   and reserved their output.  the new ones must give the same output for
+//   any input.
+static QString oldEscapeFile(const QString &str)
+{
+    QString out;
+    for (int n = 0; n < (int)str.length(); ++n) {
+        if (str[n] == '$' || str[n] == '`' || str[n] == '\\')
+            out += '\\';
+        out += str[n];
+    }
+    return out;
+}
+
+static QString oldCEscape(const QString &in)
+{
+    QString out;
+    for (int n = 0; n < in.length(); ++n) {
+        if (in[n] == '\"')
+            out += "\\\"";
+        else if (in[n] == '\n')
+            out += "\\n";
+        else
+            out += in[n];
+    }
+    return out;
+}
+
+// about mbytes MB of something like the conf sources that configure
+//   embeds, with every character either function escapes
+static QString payload(int mbytes)
+{
+    QString str;
+    str.reserve(mbytes * 1024 * 1024 + 128);
+    for (int n = 0; str.length() < mbytes * 1024 * 1024; ++n)
+        str += QString("    printf(\"%1: $HOME `pwd` \\\\ done\\n\");\n").arg(n);
+    return str;
+}
+
+class TestEscape : public QObject {
+    Q_OBJECT
+
+private slots:
+    void escapeFile_data()
+    {
+        QTest::addColumn<QString>("in");
+        QTest::addColumn<QString>("out");
+
+        QTest::newRow("empty") << QString() << QString();
+        QTest::newRow("plain") << QString("echo hi\n") << QString("echo hi\n");
+        QTest::newRow("dollar") << QString("$QC_FOO") << QString("\\$QC_FOO");
+        QTest::newRow("backtick") << QString("`pwd`") << QString("\\`pwd\\`");
+        QTest::newRow("backslash") << QString("a\\nb") << QString("a\\\\nb");
+        QTest::newRow("quotes kept") << QString("\"'") << QString("\"'");
+        QTest::newRow("all escaped") << QString("$`\\") << QString("\\$\\`\\\\");
+    }
+
+    void escapeFile()
+    {
+        QFETCH(QString, in);
+        QFETCH(QString, out);
+
+        QCOMPARE(::escapeFile(in), out);
+        QCOMPARE(oldEscapeFile(in), out);
+    }
+
+    void cEscape_data()
+    {
+        QTest::addColumn<QString>("in");
+        QTest::addColumn<QString>("out");
+
+        QTest::newRow("empty") << QString() << QString();
+        QTest::newRow("plain") << QString("Checking for Qt") << QString("Checking for Qt");
+        QTest::newRow("quote") << QString("say \"hi\"") << QString("say \\\"hi\\\"");
+        QTest::newRow("newline") << QString("a\nb\n") << QString("a\\nb\\n");
+        // backslashes are left alone
+        QTest::newRow("backslash") << QString("C:\\qt") << QString("C:\\qt");
+    }
+
+    void cEscape()
+    {
+        QFETCH(QString, in);
+        QFETCH(QString, out);
+
+        QCOMPARE(c_escape(in), out);
+        QCOMPARE(oldCEscape(in), out);
+    }
+
+    // a fixed LCG, so a failure can be reproduced
+    void sameAsOld()
+    {
+        const char   chars[] = "ab $`\\\"\n\t";
+        unsigned int seed    = 1;
+        for (int i = 0; i < 5000; ++i) {
+            seed    = seed * 1103515245 + 12345;
+            int len = (seed >> 16) % 80;
+            QString str;
+            for (int n = 0; n < len; ++n) {
+                seed = seed * 1103515245 + 12345;
+                str += QLatin1Char(chars[(seed >> 16) % (sizeof(chars) - 1)]);
+            }
+            QVERIFY2(::escapeFile(str) == oldEscapeFile(str), qPrintable(str));
+            QVERIFY2(c_escape(str) == oldCEscape(str), qPrintable(str));
+        }
+    }
+
+    void largeSameAsOld()
+    {
+        QString str = payload(4);
+        QCOMPARE(::escapeFile(str), oldEscapeFile(str));
+        QCOMPARE(c_escape(str), oldCEscape(str));
+    }
+
+    void benchEscapeFile()
+    {
+        QString str = payload(4);
+        QString out;
+        QBENCHMARK { out = ::escapeFile(str); }
+        QVERIFY(out.length() > str.length());
+    }
+
+    void benchCEscape()
+    {
+        QString str = payload(4);
+        QString out;
+        QBENCHMARK { out = c_escape(str); }
+        QVERIFY(out.length() > str.length());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestEscape)
+#include "tst_escape.moc"
@@ -0,0 +1,17 @@
+QT      -= gui
+QT      += testlib
+CONFIG  += console testcase
+CONFIG  -= app_bundle
+TARGET   = tst_probecache
+
+greaterThan(QT_MAJOR_VERSION, 4):CONFIG += c++11
+
+# the probes are built with the qmake that builds the test
+DEFINES += QC_TEST_QMAKE=\\\"$$QMAKE_QMAKE\\\"
+
+# the test includes conf4.cpp, which then leaves out its main()
+DEFINES     += QC_NO_MAIN
+INCLUDEPATH += $$PWD/../../conf
+
+HEADERS += ../../conf/conf4.h
+SOURCES += tst_probecache.cpp
@@ -0,0 +1,106 @@
+/*
+tst_probecache.cpp - tests for the shared probe cache of conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+class TestProbeCache : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir cacheHome, scratch;
+
+    static void setup(Conf *conf)
+    {
+        conf->qmake_path = QC_TEST_QMAKE;
+        conf->maketool   = "make";
+    }
+
+private slots:
+    void initTestCase()
+    {
+#ifndef QC_SHARED_CACHE
+        QSKIP("the shared probe cache needs Qt 5.1");
+#endif
+#ifndef Q_OS_UNIX
+        QSKIP("the probes are built with make, and the cache is found through XDG_CACHE_HOME");
+#endif
+        QVERIFY(cacheHome.isValid());
+        QVERIFY(scratch.isValid());
+
+        // a cache and a scratch dir of our own
+        qputenv("XDG_CACHE_HOME", QFile::encodeName(cacheHome.path()));
+        qputenv("QC_TMPDIR", QFile::encodeName(scratch.path()));
+    }
+
+    // a probe that failed because a header was missing has to pass as soon
+    // as the header is there, even though only the mtime of its own dir
+    // changed, and that dir isn't part of the key
+    void failureNotCached()
+    {
+        QTemporaryDir prefix;
+        QVERIFY(QDir(prefix.path()).mkpath("include/qcprobe"));
+        QStringList incs = QStringList() << prefix.path() + "/include";
+        QString     src  = "#include <qcprobe/probe.h>\nint main() { return QC_PROBE_RET; }\n";
+
+        Conf conf;
+        setup(&conf);
+        int ret = -1;
+        QVERIFY(!conf.doCompileAndLink(src, incs, QString(), QString(), &ret));
+
+        // like installing into /usr/include/foo
+        QFile f(prefix.path() + "/include/qcprobe/probe.h");
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.write("#define QC_PROBE_RET 3\n");
+        f.close();
+        QVERIFY(conf.doCompileAndLink(src, incs, QString(), QString(), &ret));
+        QCOMPARE(ret, 3);
+
+        // the probe that built is cached, but not past the header going
+        // away again
+        QVERIFY(QFile::remove(f.fileName()));
+        QVERIFY(!conf.doCompileAndLink(src, incs, QString(), QString(), &ret));
+    }
+
+    // a probe that built is only served from the cache while the headers
+    // it included are the same, wherever they are
+    void headerChanges()
+    {
+        QTemporaryDir prefix;
+        QVERIFY(QDir(prefix.path()).mkpath("include/qcprobe"));
+        QStringList incs = QStringList() << prefix.path() + "/include";
+        QString     src  = "#include <qcprobe/changes.h>\nint main() { return QC_PROBE_RET; }\n";
+        QFile       f(prefix.path() + "/include/qcprobe/changes.h");
+
+        Conf conf;
+        setup(&conf);
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.write("#define QC_PROBE_RET 3\n");
+        f.close();
+        int ret = -1;
+        QVERIFY(conf.doCompileAndLink(src, incs, QString(), QString(), &ret));
+        QCOMPARE(ret, 3);
+        QVERIFY(!QDir(cacheHome.path() + "/qconf/probes").entryList(QDir::Files).isEmpty());
+
+        // a different size, so this doesn't depend on the mtime resolution
+        QVERIFY(f.open(QFile::WriteOnly | QFile::Truncate));
+        f.write("#define QC_PROBE_RET 42\n");
+        f.close();
+        ret = -1;
+        QVERIFY(conf.doCompileAndLink(src, incs, QString(), QString(), &ret));
+        QCOMPARE(ret, 42);
+
+        // and it fails once the header is gone
+        QVERIFY(QFile::remove(f.fileName()));
+        QVERIFY(!conf.doCompileAndLink(src, incs, QString(), QString(), &ret));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestProbeCache)
+#include "tst_probecache.moc"
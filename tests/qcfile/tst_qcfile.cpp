@@ -0,0 +1,258 @@
+/*
+ * tst_qcfile.cpp - .qc file parser tests
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <QtTest>
+
+#include "qconf.cpp"
+
+// the expected results are what the QDomDocument based parser gave before
+//   xmlToConf() became a single stream pass
+
+static ConfLoadResult load(const QByteArray &data, Conf *conf)
+{
+    QBuffer buf;
+    buf.setData(data);
+    buf.open(QIODevice::ReadOnly);
+    return xmlToConf(&buf, conf);
+}
+
+static QStringList depNames(const Conf &conf)
+{
+    QStringList list;
+    foreach (const Dep &dep, conf.deps)
+        list += dep.name;
+    return list;
+}
+
+class TestQcFile : public QObject {
+    Q_OBJECT
+
+private slots:
+    void loaded()
+    {
+        Conf conf;
+        QCOMPARE(load("<qconf>\n"
+                      "  <name>Sample Application</name>\n"
+                      "  <profile>sample.pro</profile>\n"
+                      "  <lib/>\n"
+                      "  <noprefix/>\n"
+                      "  <nobindir/>\n"
+                      "  <incdir/>\n"
+                      "  <libdir/>\n"
+                      "  <datadir/>\n"
+                      "  <moddir>mods</moddir>\n"
+                      "  <moddir>more/mods</moddir>\n"
+                      "  <dep type='qt41'><required/></dep>\n"
+                      "  <arg name='debug'>Build with debugging</arg>\n"
+                      "  <arg name='with-foo' arg='path'>Path to foo</arg>\n"
+                      "</qconf>\n",
+                      &conf),
+                 ConfLoaded);
+        QCOMPARE(conf.name, QString("Sample Application"));
+        QCOMPARE(conf.profile, QString("sample.pro"));
+        QVERIFY(conf.libmode);
+        QVERIFY(conf.noprefix);
+        QVERIFY(conf.nobindir);
+        QVERIFY(conf.useincdir);
+        QVERIFY(conf.uselibdir);
+        QVERIFY(conf.usedatadir);
+        QVERIFY(conf.qt4);
+        QVERIFY(!conf.byoq);
+        QCOMPARE(conf.moddirs, QStringList() << "mods"
+                                             << "more/mods");
+        QCOMPARE(depNames(conf), QStringList() << "qt41");
+        QVERIFY(conf.deps[0].required);
+        QVERIFY(!conf.deps[0].disabled);
+        QVERIFY(!conf.deps[0].pkgconfig);
+        QCOMPARE(conf.args.count(), 2);
+        QCOMPARE(conf.args[0].name, QString("debug"));
+        QCOMPARE(conf.args[0].arg, QString());
+        QCOMPARE(conf.args[0].desc, QString("Build with debugging"));
+        QCOMPARE(conf.args[1].name, QString("with-foo"));
+        QCOMPARE(conf.args[1].arg, QString("path"));
+        QCOMPARE(conf.args[1].desc, QString("Path to foo"));
+    }
+
+    void minimal()
+    {
+        Conf conf;
+        QCOMPARE(load("<qconf/>", &conf), ConfLoaded);
+        QCOMPARE(conf.name, QString());
+        QCOMPARE(conf.profile, QString());
+        QVERIFY(conf.deps.isEmpty());
+        QVERIFY(conf.args.isEmpty());
+        QVERIFY(!conf.libmode);
+        QVERIFY(conf.qt4);
+    }
+
+    void parseError_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+
+        QTest::newRow("empty") << QByteArray();
+        QTest::newRow("whitespace") << QByteArray("  \n");
+        QTest::newRow("text") << QByteArray("qconf");
+        QTest::newRow("unterminated") << QByteArray("<qconf><name>x</name>");
+        QTest::newRow("mismatched") << QByteArray("<qconf><name>x</qconf>");
+        QTest::newRow("two roots") << QByteArray("<qconf/><qconf/>");
+        QTest::newRow("bad attribute") << QByteArray("<qconf><dep type=qt41/></qconf>");
+        // the root is only checked once the whole document parsed
+        QTest::newRow("unterminated other root") << QByteArray("<project><name>x</name>");
+    }
+
+    void parseError()
+    {
+        QFETCH(QByteArray, data);
+
+        Conf conf;
+        conf.name = "untouched";
+        QCOMPARE(load(data, &conf), ConfParseError);
+        QCOMPARE(conf.name, QString("untouched"));
+    }
+
+    void badFormat_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+
+        QTest::newRow("other root") << QByteArray("<project><name>x</name></project>");
+        QTest::newRow("empty other root") << QByteArray("<QConf/>");
+        QTest::newRow("nested qconf") << QByteArray("<project><qconf><name>x</name></qconf></project>");
+    }
+
+    void badFormat()
+    {
+        QFETCH(QByteArray, data);
+
+        Conf conf;
+        conf.name = "untouched";
+        QCOMPARE(load(data, &conf), ConfBadFormat);
+        QCOMPARE(conf.name, QString("untouched"));
+    }
+
+    // a dep is required or disabled if the element appears anywhere inside
+    //   it, so a flag inside a nested dep also applies to the outer one
+    void requiredDisabledNesting()
+    {
+        Conf conf;
+        QCOMPARE(load("<qconf>\n"
+                      "  <dep type='a'><required/></dep>\n"
+                      "  <dep type='b'><dep type='c'><disabled/></dep></dep>\n"
+                      "  <dep type='d'><dep type='e'/><required/></dep>\n"
+                      "  <dep type='f'><section><required/><disabled/></section></dep>\n"
+                      "  <dep type='g'/>\n"
+                      "  <required/>\n"
+                      "</qconf>\n",
+                      &conf),
+                 ConfLoaded);
+        QCOMPARE(depNames(conf), QStringList() << "a"
+                                               << "b"
+                                               << "c"
+                                               << "d"
+                                               << "e"
+                                               << "f"
+                                               << "g");
+
+        const bool required[] = { true, false, false, true, false, true, false };
+        const bool disabled[] = { false, true, true, false, false, true, false };
+        for (int n = 0; n < conf.deps.count(); ++n) {
+            QVERIFY2(conf.deps[n].required == required[n], qPrintable(conf.deps[n].name));
+            QVERIFY2(conf.deps[n].disabled == disabled[n], qPrintable(conf.deps[n].name));
+        }
+    }
+
+    void pkgVersions()
+    {
+        Conf conf;
+        QCOMPARE(load("<qconf>\n"
+                      "  <dep type='pkg' name='Foo' pkgname='foo'/>\n"
+                      "  <dep type='pkg' name='Bar' pkgname='bar' version='&gt;=1.2'/>\n"
+                      "  <dep type='pkg' name='Baz' pkgname='baz' version='&lt;=3'/>\n"
+                      "  <dep type='pkg' name='Qux' pkgname='qux' version='2.0.1'/>\n"
+                      "</qconf>\n",
+                      &conf),
+                 ConfLoaded);
+        QCOMPARE(depNames(conf), QStringList() << "Foo"
+                                               << "Bar"
+                                               << "Baz"
+                                               << "Qux");
+
+        const Dep &foo = conf.deps[0];
+        QVERIFY(foo.pkgconfig);
+        QCOMPARE(foo.longname, QString("Foo"));
+        QCOMPARE(foo.pkgname, QString("foo"));
+        QCOMPARE(foo.pkgvermode, VersionAny);
+        QCOMPARE(foo.pkgver, QString());
+
+        QCOMPARE(conf.deps[1].pkgvermode, VersionMin);
+        QCOMPARE(conf.deps[1].pkgver, QString("1.2"));
+        QCOMPARE(conf.deps[2].pkgvermode, VersionMax);
+        QCOMPARE(conf.deps[2].pkgver, QString("3"));
+        QCOMPARE(conf.deps[3].pkgvermode, VersionExact);
+        QCOMPARE(conf.deps[3].pkgver, QString("2.0.1"));
+    }
+
+    // only the first <name> and <profile> count, wherever they are, and
+    //   their text includes the text of child elements
+    void firstNameWins()
+    {
+        Conf conf;
+        QCOMPARE(load("<qconf>\n"
+                      "  <dep type='a'><name>inner</name></dep>\n"
+                      "  <name>outer</name>\n"
+                      "  <profile>a<b>b</b>c.pro</profile>\n"
+                      "  <profile>other.pro</profile>\n"
+                      "</qconf>\n",
+                      &conf),
+                 ConfLoaded);
+        QCOMPARE(conf.name, QString("inner"));
+        QCOMPARE(conf.profile, QString("abc.pro"));
+    }
+
+    void qt3AndByoq()
+    {
+        Conf conf;
+        QCOMPARE(load("<qconf><byoq/></qconf>", &conf), ConfLoaded);
+        QVERIFY(conf.qt4);
+        QVERIFY(conf.byoq);
+
+        // byoq only applies to qt4 projects
+        QCOMPARE(load("<qconf><qt3/><byoq/></qconf>", &conf), ConfLoaded);
+        QVERIFY(!conf.qt4);
+        QVERIFY(!conf.byoq);
+    }
+
+    void qtmodule()
+    {
+        Conf conf;
+        QCOMPARE(load("<qconf><dep type='qtmodule' name='svg' version='&gt;=5.9'><required/></dep></qconf>", &conf),
+                 ConfLoaded);
+        QCOMPARE(conf.deps.count(), 1);
+        const Dep &dep = conf.deps[0];
+        QVERIFY(dep.qtmodule);
+        QVERIFY(!dep.pkgconfig);
+        QVERIFY(dep.required);
+        QCOMPARE(dep.name, QString("svg"));
+        QCOMPARE(dep.longname, QString("Qt svg"));
+        QCOMPARE(dep.pkgname, QString("svg"));
+        QCOMPARE(dep.pkgvermode, VersionMin);
+        QCOMPARE(dep.pkgver, QString("5.9"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestQcFile)
+#include "tst_qcfile.moc"
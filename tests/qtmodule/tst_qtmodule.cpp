@@ -0,0 +1,152 @@
+/*
+tst_qtmodule.cpp - tests for the Qt module checks of conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+Q_DECLARE_METATYPE(VersionMode)
+
+class TestQtModule : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir tmp;
+
+    // what qmake -query would have said
+    static void setProperties(const QMap<QString, QString> &props)
+    {
+        QMutexLocker locker(&qc_qt_properties_mutex);
+        qc_qt_properties_known = true;
+        qc_qt_properties       = props;
+    }
+
+    bool writeFile(const QString &path, const QByteArray &data)
+    {
+        if (!QDir(tmp.path()).mkpath(QFileInfo(path).path()))
+            return false;
+        QFile f(path);
+        return f.open(QFile::WriteOnly) && f.write(data) == data.size();
+    }
+
+    // Qt 5 with the x module in QT_INSTALL_DATA but not QT_INSTALL_ARCHDATA
+    void setQt5()
+    {
+        QMap<QString, QString> props;
+        props.insert("QT_VERSION", "5.10.1");
+        props.insert("QT_INSTALL_ARCHDATA", tmp.path() + "/arch");
+        props.insert("QT_INSTALL_DATA", tmp.path() + "/data");
+        setProperties(props);
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(tmp.isValid());
+        QVERIFY(QDir(tmp.path()).mkpath("arch/mkspecs/modules"));
+        QVERIFY(writeFile(tmp.path() + "/data/mkspecs/modules/qt_lib_x.pri",
+                          "QT.x.name = QtX\n"
+                          "QT.x.VERSION = 5.10.1\n"
+                          "QT.x.depends = core\n"));
+        QVERIFY(QDir(tmp.path()).mkpath("qt4/include/QtDBus"));
+    }
+
+    void compareVersions_data()
+    {
+        QTest::addColumn<QString>("a");
+        QTest::addColumn<QString>("b");
+        QTest::addColumn<int>("result");
+
+        QTest::newRow("5.9 < 5.10") << "5.9" << "5.10" << -1;
+        QTest::newRow("5.10 > 5.9") << "5.10" << "5.9" << 1;
+        QTest::newRow("equal") << "5.15.2" << "5.15.2" << 0;
+        QTest::newRow("missing parts are 0") << "5.15" << "5.15.0" << 0;
+        QTest::newRow("shorter is less") << "5" << "5.0.1" << -1;
+        QTest::newRow("patch level") << "5.15.2" << "5.15.10" << -1;
+        QTest::newRow("major wins") << "6.0" << "5.99.99" << 1;
+        QTest::newRow("empty") << "" << "0" << 0;
+    }
+
+    void compareVersions()
+    {
+        QFETCH(QString, a);
+        QFETCH(QString, b);
+        QFETCH(int, result);
+
+        QCOMPARE(qc_compare_versions(a, b), result);
+        QCOMPARE(qc_compare_versions(b, a), -result);
+    }
+
+    void findQtModule()
+    {
+        setQt5();
+        Conf    conf;
+        QString version;
+        QVERIFY(conf.findQtModule("x", &version));
+        QCOMPARE(version, QString("5.10.1"));
+        QVERIFY(!conf.findQtModule("y", &version));
+    }
+
+    // Qt 4 has a dir of headers instead
+    void findQt4Module()
+    {
+        QMap<QString, QString> props;
+        props.insert("QT_VERSION", "4.8.7");
+        props.insert("QT_INSTALL_HEADERS", tmp.path() + "/qt4/include");
+        setProperties(props);
+
+        Conf    conf;
+        QString version;
+        QVERIFY(conf.findQtModule("dbus", &version));
+        QCOMPARE(version, QString("4.8.7"));
+        QVERIFY(!conf.findQtModule("network", &version));
+    }
+
+    // against x at 5.10.1
+    void modes_data()
+    {
+        QTest::addColumn<VersionMode>("mode");
+        QTest::addColumn<QString>("required");
+        QTest::addColumn<bool>("success");
+
+        QTest::newRow("min, older") << VersionMin << "5.9" << true;
+        QTest::newRow("min, same") << VersionMin << "5.10.1" << true;
+        QTest::newRow("min, newer") << VersionMin << "5.11" << false;
+        QTest::newRow("max, older") << VersionMax << "5.9" << false;
+        QTest::newRow("max, newer") << VersionMax << "5.10.2" << true;
+        QTest::newRow("exact") << VersionExact << "5.10.1" << true;
+        QTest::newRow("exact, shorter") << VersionExact << "5.10" << false;
+        QTest::newRow("any") << VersionAny << "" << true;
+    }
+
+    void modes()
+    {
+        QFETCH(VersionMode, mode);
+        QFETCH(QString, required);
+        QFETCH(bool, success);
+
+        setQt5();
+        Conf                  conf;
+        qc_internal_qtmodule *check = new qc_internal_qtmodule(&conf, "x", "QtX", mode, required);
+        QCOMPARE(check->exec(), success);
+        QCOMPARE(conf.extra, success ? QString("QT += x\n") : QString());
+        QCOMPARE(conf.DEFINES, success ? QString("HAVE_QT_X") : QString());
+    }
+
+    void missingModule()
+    {
+        setQt5();
+        Conf                  conf;
+        qc_internal_qtmodule *check = new qc_internal_qtmodule(&conf, "y", "QtY", VersionAny, QString());
+        QVERIFY(!check->exec());
+        QVERIFY(conf.extra.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestQtModule)
+#include "tst_qtmodule.moc"
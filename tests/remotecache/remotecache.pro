@@ -0,0 +1,17 @@
+QT      -= gui
+QT      += network testlib
+CONFIG  += console testcase
+CONFIG  -= app_bundle
+TARGET   = tst_remotecache
+
+CONFIG += c++11
+
+# the keys are found with the qmake that builds the test
+DEFINES += QC_TEST_QMAKE=\\\"$$QMAKE_QMAKE\\\"
+
+# the test includes conf4.cpp, which then leaves out its main()
+DEFINES     += QC_NO_MAIN QC_HAVE_NETWORK
+INCLUDEPATH += $$PWD/../../conf
+
+HEADERS += ../../conf/conf4.h
+SOURCES += tst_remotecache.cpp
@@ -0,0 +1,278 @@
+/*
+tst_remotecache.cpp - tests for the remote probe cache of conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+#ifndef QC_HAVE_NETWORK
+#error the remote probe cache needs Qt 5.1 and QtNetwork
+#endif
+
+// just enough of an HTTP server for QcHttpCache: GET and PUT of
+// <url>/<key>, one request per connection.  with hang set, requests are
+// read but never answered.
+class StubServer : public QObject {
+    Q_OBJECT
+
+public:
+    QTcpServer                server;
+    QMap<QString, QByteArray> entries;  // by key
+    QStringList               requests; // "GET key", "PUT key"
+    bool                      hang;
+
+    StubServer() : hang(false)
+    {
+        connect(&server, SIGNAL(newConnection()), SLOT(accept()));
+        server.listen(QHostAddress::LocalHost);
+    }
+
+    QString url() const { return QString("http://127.0.0.1:%1/qconf").arg(server.serverPort()); }
+
+private slots:
+    void accept()
+    {
+        while (QTcpSocket *sock = server.nextPendingConnection()) {
+            connect(sock, SIGNAL(readyRead()), SLOT(read()));
+            connect(sock, SIGNAL(disconnected()), sock, SLOT(deleteLater()));
+        }
+    }
+
+    void read()
+    {
+        QTcpSocket *sock = qobject_cast<QTcpSocket *>(sender());
+        QByteArray  buf  = sock->property("buf").toByteArray() + sock->readAll();
+        sock->setProperty("buf", buf);
+        int end = buf.indexOf("\r\n\r\n");
+        if (end == -1)
+            return;
+        QList<QByteArray> lines  = buf.left(end).split('\n');
+        int               length = 0;
+        foreach (const QByteArray &line, lines) {
+            if (line.toLower().startsWith("content-length:"))
+                length = line.mid(15).trimmed().toInt();
+        }
+        if (buf.size() < end + 4 + length)
+            return;
+
+        QList<QByteArray> request = lines[0].trimmed().split(' ');
+        QString           method  = QString::fromLatin1(request[0]);
+        QString           path    = QString::fromLatin1(request.value(1));
+        QString           key     = path.mid(path.lastIndexOf('/') + 1);
+        requests += method + ' ' + key;
+        if (hang)
+            return;
+        if (method == "GET") {
+            if (entries.contains(key))
+                reply(sock, "200 OK", entries.value(key));
+            else
+                reply(sock, "404 Not Found", QByteArray());
+        } else if (method == "PUT") {
+            entries.insert(key, buf.mid(end + 4, length));
+            reply(sock, "201 Created", QByteArray());
+        } else {
+            reply(sock, "405 Method Not Allowed", QByteArray());
+        }
+    }
+
+private:
+    static void reply(QTcpSocket *sock, const char *status, const QByteArray &body)
+    {
+        sock->write("HTTP/1.1 " + QByteArray(status) + "\r\nContent-Length: " + QByteArray::number(body.size())
+                    + "\r\nConnection: close\r\n\r\n" + body);
+        sock->disconnectFromHost();
+    }
+};
+
+class TestRemoteCache : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir cacheHome, scratch;
+    StubServer *  stub;
+    Conf          conf;
+
+    static bool acceptAll(const QByteArray &, bool) { return true; }
+
+    QcProbeKey key(const QString &filedata, const QStringList &incs = QStringList())
+    {
+        return qc_probe_key(&conf, filedata, incs, QString(), QString());
+    }
+
+    static QString localEntry(const QcProbeKey &k) { return qc_cache_dir() + '/' + k.local; }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(cacheHome.isValid());
+        QVERIFY(scratch.isValid());
+
+        // a local cache and a scratch dir of our own, and the stub as the
+        // remote cache
+        qputenv("XDG_CACHE_HOME", QFile::encodeName(cacheHome.path()));
+        qputenv("QC_TMPDIR", QFile::encodeName(scratch.path()));
+        QNetworkProxy::setApplicationProxy(QNetworkProxy::NoProxy);
+        stub = new StubServer;
+        QVERIFY(stub->server.isListening());
+        qputenv("QC_REMOTE_CACHE", stub->url().toLatin1());
+        qputenv("QC_REMOTE_CACHE_ID", "tst-remotecache");
+
+        conf.qmake_path = QC_TEST_QMAKE;
+        conf.maketool   = "make";
+        QList<QcCacheBackend *> backends = qc_cache_backends(&conf);
+        QCOMPARE(backends.count(), 2);
+        QVERIFY(!backends[0]->remote());
+        QVERIFY(backends[1]->remote());
+    }
+
+    void cleanupTestCase() { delete stub; }
+
+    // the local key changes with the mtimes of the dirs involved, the
+    // remote one must not, but it does change with the namespace
+    void remoteKey()
+    {
+        QTemporaryDir tmp;
+        QString       dir  = tmp.path() + "/include";
+        QStringList   incs = QStringList() << dir;
+        QVERIFY(QDir().mkpath(dir));
+        QcProbeKey a = key("int main() { return 0; }\n", incs);
+        QVERIFY(QDir().rmdir(dir));
+        QcProbeKey b = key("int main() { return 0; }\n", incs);
+
+        QVERIFY(!a.remote.isEmpty());
+        QVERIFY(a.remote != a.local);
+        QVERIFY(a.local != b.local);
+        QCOMPARE(a.remote, b.remote);
+
+        // but it still depends on the probe
+        QVERIFY(key("int main() { return 1; }\n", incs).remote != a.remote);
+
+        qputenv("QC_REMOTE_CACHE_ID", "tst-remotecache-other");
+        qc_remote_id.clear();
+        QcProbeKey c = key("int main() { return 0; }\n", incs);
+        qputenv("QC_REMOTE_CACHE_ID", "tst-remotecache");
+        qc_remote_id.clear();
+        QVERIFY(c.remote != a.remote);
+        QCOMPARE(key("int main() { return 0; }\n", incs).remote, a.remote);
+    }
+
+    // a remote probe is only used if the files it used exist here, and is
+    // stored locally with the stamps of this host
+    void remoteDeps()
+    {
+        QTemporaryDir tmp;
+        QString       header = tmp.path() + "/dep.h";
+        QFile         f(header);
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.write("#define DEP 1\n");
+        f.close();
+
+        QcProbeKey missing = key("missing dep");
+        QByteArray gone    = QFile::encodeName(tmp.path() + "/gone.h");
+        stub->entries.insert(missing.remote, qc_cache_wrap("ok 0\n" + gone + "\t1 2\n"));
+        int ret = -1;
+        QVERIFY(!qc_cache_lookup(&conf, missing, true, &ret));
+        QVERIFY(!QFile::exists(localEntry(missing)));
+
+        QcProbeKey present = key("present dep");
+        stub->entries.insert(present.remote, qc_cache_wrap("ok 5\n" + QFile::encodeName(header) + "\t1 2\n"));
+        QVERIFY(qc_cache_lookup(&conf, present, true, &ret));
+        QCOMPARE(ret, 5);
+
+        // the local copy is checked against this host's stamps
+        QVERIFY(QFile::exists(localEntry(present)));
+        stub->requests.clear();
+        ret = -1;
+        QVERIFY(qc_cache_lookup(&conf, present, true, &ret));
+        QCOMPARE(ret, 5);
+        QVERIFY(stub->requests.isEmpty());
+    }
+
+    void miss()
+    {
+        QcProbeKey k = key("miss");
+        QByteArray payload;
+        stub->requests.clear();
+        QVERIFY(!qc_cache_get(&conf, k, acceptAll, 0, &payload));
+        QCOMPARE(stub->requests, QStringList() << "GET " + k.remote);
+        QVERIFY(!QFile::exists(localEntry(k)));
+    }
+
+    void put()
+    {
+        QcProbeKey k = key("put");
+        stub->requests.clear();
+        qc_cache_put(&conf, k, "ok 0");
+        QCOMPARE(stub->requests, QStringList() << "PUT " + k.remote);
+        QCOMPARE(stub->entries.value(k.remote), qc_cache_wrap("ok 0"));
+        QVERIFY(QFile::exists(localEntry(k)));
+    }
+
+    void hit()
+    {
+        QcProbeKey k = key("hit");
+        QByteArray payload;
+        stub->entries.insert(k.remote, qc_cache_wrap("ok"));
+        QVERIFY(qc_cache_get(&conf, k, acceptAll, 0, &payload));
+        QCOMPARE(payload, QByteArray("ok"));
+
+        // it is copied to the local cache, which answers the next time
+        QVERIFY(QFile::exists(localEntry(k)));
+        stub->requests.clear();
+        payload.clear();
+        QVERIFY(qc_cache_get(&conf, k, acceptAll, 0, &payload));
+        QCOMPARE(payload, QByteArray("ok"));
+        QVERIFY(stub->requests.isEmpty());
+    }
+
+    void corrupt()
+    {
+        QcProbeKey k = key("corrupt");
+        QByteArray payload;
+
+        // the hash doesn't match
+        QByteArray value = qc_cache_wrap("ok");
+        value[value.size() - 1] = 'X';
+        stub->entries.insert(k.remote, value);
+        QVERIFY(!qc_cache_get(&conf, k, acceptAll, 0, &payload));
+
+        // no hash at all
+        stub->entries.insert(k.remote, "ok");
+        QVERIFY(!qc_cache_get(&conf, k, acceptAll, 0, &payload));
+
+        // and neither is copied to the local cache
+        QVERIFY(!QFile::exists(localEntry(k)));
+    }
+
+    // last, since a timeout turns the remote cache off for the rest of
+    // the run
+    void timeout()
+    {
+        QcProbeKey    k = key("timeout");
+        QByteArray    payload;
+        QElapsedTimer timer;
+        stub->hang = true;
+        stub->entries.insert(k.remote, qc_cache_wrap("ok"));
+        stub->requests.clear();
+        timer.start();
+        QVERIFY(!qc_cache_get(&conf, k, acceptAll, 0, &payload));
+        QVERIFY(timer.elapsed() >= QC_REMOTE_CACHE_TIMEOUT - 100);
+        QCOMPARE(stub->requests, QStringList() << "GET " + k.remote);
+
+        // the server isn't asked again
+        stub->requests.clear();
+        timer.restart();
+        QVERIFY(!qc_cache_get(&conf, k, acceptAll, 0, &payload));
+        qc_cache_put(&conf, key("after timeout"), "ok");
+        QVERIFY(timer.elapsed() < QC_REMOTE_CACHE_TIMEOUT / 2);
+        QVERIFY(stub->requests.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestRemoteCache)
+#include "tst_remotecache.moc"
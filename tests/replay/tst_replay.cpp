@@ -0,0 +1,185 @@
+/*
+tst_replay.cpp - tests for the record and replay of commands in conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+class TestReplay : public QObject {
+    Q_OBJECT
+
+private:
+    // back to neither recording nor replaying
+    static void reset()
+    {
+        if (qc_record_file) {
+            qc_record_file->close();
+            delete qc_record_file;
+            qc_record_file = 0;
+        }
+        qc_replay_on = false;
+        qc_replay_dirs.clear();
+        qc_replay_runs.clear();
+        qc_replay_misses = 0;
+        qputenv("QC_RECORD", "");
+        qputenv("QC_REPLAY", "");
+    }
+
+    static QString dirName(const QByteArray &contents)
+    {
+        QByteArray hash = QCryptographicHash::hash(contents, QCryptographicHash::Sha1).toHex();
+        return "atest-" + QString::fromLatin1(hash.left(16));
+    }
+
+private slots:
+    void init() { reset(); }
+
+    void cleanup() { reset(); }
+
+    void escape_data()
+    {
+        QTest::addColumn<QByteArray>("in");
+        QTest::addColumn<QByteArray>("out");
+
+        QTest::newRow("empty") << QByteArray() << QByteArray();
+        QTest::newRow("kept") << QByteArray("g++ -I/usr/include a=b:c,d+e@f $x")
+                              << QByteArray("g++ -I/usr/include a=b:c,d+e@f $x");
+        QTest::newRow("tab and newline") << QByteArray("a\tb\nc\r") << QByteArray("a%09b%0Ac%0D");
+        QTest::newRow("percent") << QByteArray("100%") << QByteArray("100%25");
+        QTest::newRow("utf-8") << QByteArray("caf\xc3\xa9") << QByteArray("caf%C3%A9");
+        QTest::newRow("nul") << QByteArray("a\0b", 3) << QByteArray("a%00b");
+    }
+
+    // the fields of a record line can't have tabs or newlines, and come
+    // back as they were
+    void escape()
+    {
+        QFETCH(QByteArray, in);
+        QFETCH(QByteArray, out);
+
+        QCOMPARE(qc_replay_escape(in), out);
+        QCOMPARE(QByteArray::fromPercentEncoding(out), in);
+    }
+
+    void keyBuildDir()
+    {
+        qc_replay_builddir = "/home/me/proj";
+        QCOMPARE(qc_replay_command_key("g++ -I/home/me/proj/include x.cpp", "/home/me/proj/sub"),
+                 QString("g++ -I$BUILDDIR/include x.cpp\n$BUILDDIR/sub"));
+        QCOMPARE(qc_replay_command_key("pkg-config --libs foo", "/home/me/proj"),
+                 QString("pkg-config --libs foo\n$BUILDDIR"));
+        // other dirs are left alone
+        QCOMPARE(qc_replay_command_key("ls /usr/lib", "/tmp"), QString("ls /usr/lib\n/tmp"));
+    }
+
+    // an atest dir is named after what is in it, wherever it is
+    void keyAtestDir()
+    {
+        qc_replay_on       = true;
+        qc_replay_builddir = "/home/me/proj";
+        QString scratch    = "/home/me/proj/.qconftemp.a";
+        qc_replay_name_dir(scratch + "/atest", "int main() {}\n");
+        qc_replay_name_dir("/tmp/other/atest7", "int main() {}\n");
+        qc_replay_name_dir("/tmp/other/atest8", "int main() { return 1; }\n");
+
+        QString name = dirName("int main() {}\n");
+        QCOMPARE(qc_replay_command_key(scratch + "/atest/atest", scratch + "/atest"), name + "/atest\n" + name);
+        QCOMPARE(qc_replay_command_key("/tmp/other/atest7/atest", "/tmp/other/atest7"), name + "/atest\n" + name);
+        QVERIFY(qc_replay_command_key("make", "/tmp/other/atest8")
+                != qc_replay_command_key("make", "/tmp/other/atest7"));
+    }
+
+    // answers come in the order they were recorded, and the last one is
+    // repeated
+    void recordThenReplay()
+    {
+        QTemporaryDir tmp;
+        QString       fname = tmp.path() + "/conf.record";
+        qputenv("QC_RECORD", QFile::encodeName(fname));
+        QVERIFY(qc_init_replay());
+        QcRecordedRun run;
+        run.ret = 1;
+        run.out = "first\tline\n";
+        qc_record(qc_replay_key("cmd", "dir"), run);
+        run.ret = 2;
+        run.err = "second\n";
+        qc_record(qc_replay_key("cmd", "dir"), run);
+        reset();
+
+        qputenv("QC_REPLAY", QFile::encodeName(fname));
+        QVERIFY(qc_init_replay());
+        QVERIFY(qc_replay(qc_replay_key("cmd", "dir"), &run));
+        QCOMPARE(run.ret, 1);
+        QCOMPARE(run.out, QByteArray("first\tline\n"));
+        QVERIFY(qc_replay(qc_replay_key("cmd", "dir"), &run));
+        QCOMPARE(run.ret, 2);
+        QCOMPARE(run.err, QByteArray("second\n"));
+        QVERIFY(qc_replay(qc_replay_key("cmd", "dir"), &run));
+        QCOMPARE(run.ret, 2);
+        QCOMPARE(qc_replay_misses, 0);
+
+        QVERIFY(!qc_replay(qc_replay_key("other", "dir"), &run));
+        QCOMPARE(qc_replay_misses, 1);
+    }
+
+    // a probe recorded with a real toolchain is answered without one, in
+    // another build dir with another scratch dir
+    void probeRoundTrip()
+    {
+#ifndef Q_OS_UNIX
+        QSKIP("the probe is built with make, and qmake is found through a symlink");
+#endif
+        QTemporaryDir tmp;
+        QString       fname   = tmp.path() + "/conf.record";
+        QString       src     = "int main() { return 7; }\n";
+        QString       oldCwd  = QDir::currentPath();
+        QByteArray    oldPath = qgetenv("PATH");
+        QVERIFY(QDir(tmp.path()).mkpath("bin"));
+        QVERIFY(QDir(tmp.path()).mkpath("build1/scratch"));
+        QVERIFY(QDir(tmp.path()).mkpath("build2/scratch"));
+        QVERIFY(QFile::link(QC_TEST_QMAKE, tmp.path() + "/bin/qmake"));
+
+        QVERIFY(QDir::setCurrent(tmp.path() + "/build1"));
+        qputenv("QC_TMPDIR", QFile::encodeName(tmp.path() + "/build1/scratch"));
+        qputenv("QC_RECORD", QFile::encodeName(fname));
+        QVERIFY(qc_init_replay());
+        {
+            Conf conf;
+            conf.qmake_path = tmp.path() + "/bin/qmake";
+            conf.maketool   = "make";
+            int ret         = -1;
+            QVERIFY(conf.doCompileAndLink(src, QStringList(), QString(), QString(), &ret));
+            QCOMPARE(ret, 7);
+        }
+        reset();
+
+        // no qmake, and nothing on PATH
+        QVERIFY(QFile::remove(tmp.path() + "/bin/qmake"));
+        qputenv("PATH", "");
+        QVERIFY(QDir::setCurrent(tmp.path() + "/build2"));
+        qputenv("QC_TMPDIR", QFile::encodeName(tmp.path() + "/build2/scratch"));
+        qputenv("QC_REPLAY", QFile::encodeName(fname));
+        QVERIFY(qc_init_replay());
+        bool ok;
+        int  ret = -1;
+        {
+            Conf conf;
+            conf.qmake_path = tmp.path() + "/bin/qmake";
+            conf.maketool   = "make";
+            ok              = conf.doCompileAndLink(src, QStringList(), QString(), QString(), &ret);
+        }
+        qputenv("PATH", oldPath);
+        QDir::setCurrent(oldCwd);
+        QVERIFY(ok);
+        QCOMPARE(ret, 7);
+        QCOMPARE(qc_replay_misses, 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestReplay)
+#include "tst_replay.moc"
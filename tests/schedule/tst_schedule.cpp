@@ -0,0 +1,194 @@
+/*
+tst_schedule.cpp - tests for the order the checks of conf4.cpp run in
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+// a check that adds a define, and notes what Conf had when it ran
+class TestCheck : public ConfObj {
+public:
+    QString     id;
+    bool        result;
+    QString     define;
+    QStringList command; // to run, if not empty
+    int         msecs;   // to wait before returning
+    int         ran;     // when it ran, counting from 1, or 0
+    QString     seenDefines;
+
+    static QAtomicInt runs;
+
+    TestCheck(Conf *c, const QString &_id, bool _required = false, bool _result = true) :
+        ConfObj(c), id(_id), result(_result), msecs(0), ran(0)
+    {
+        required = _required;
+    }
+
+    QString name() const { return id; }
+    QString shortname() const { return id; }
+    QString checkString() const { return QString(); }
+
+    bool exec()
+    {
+        ran         = runs.fetchAndAddRelaxed(1) + 1;
+        seenDefines = conf->DEFINES;
+        if (msecs)
+            QTest::qSleep(msecs);
+        if (!command.isEmpty())
+            conf->doCommand(command[0], command.mid(1));
+        if (!define.isEmpty())
+            conf->addDefine(define);
+        return result;
+    }
+};
+
+QAtomicInt TestCheck::runs;
+
+class TestSchedule : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir cacheHome, scratch;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(cacheHome.isValid());
+        QVERIFY(scratch.isValid());
+
+        // durations of our own, and no jobserver of the make running the
+        // tests
+        qputenv("XDG_CACHE_HOME", QFile::encodeName(cacheHome.path()));
+        qputenv("QC_TMPDIR", QFile::encodeName(scratch.path()));
+        qputenv("MAKEFLAGS", "");
+        qputenv("QC_SITE", "");
+        qputenv("QC_SERVICE", "");
+    }
+
+    void init()
+    {
+        qputenv("QC_JOBS", "1");
+        qc_shared_outputs.clear();
+    }
+
+    // checks are given as "a b! c", with ! marking the required ones, and
+    // durations as "a=5 b=10"
+    void scheduleChecks_data()
+    {
+        QTest::addColumn<QString>("checks");
+        QTest::addColumn<QString>("durations");
+        QTest::addColumn<QString>("order");
+
+        QTest::newRow("declaration order for ties") << "a b c" << "" << "a b c";
+        QTest::newRow("required first") << "a b! c" << "" << "b a c";
+        QTest::newRow("required cheapest first") << "a! b! c!" << "a=30 b=10 c=20" << "b c a";
+        QTest::newRow("unknown required last") << "a! b!" << "a=10" << "a b";
+        QTest::newRow("optional most expensive first") << "a b c" << "a=10 b=30" << "c b a";
+        QTest::newRow("mixed") << "a b! c! d" << "a=5 b=100 c=1" << "c b d a";
+    }
+
+    void scheduleChecks()
+    {
+        QFETCH(QString, checks);
+        QFETCH(QString, durations);
+        QFETCH(QString, order);
+
+        Conf             conf;
+        QList<ConfObj *> list;
+        foreach (const QString &c, checks.split(' ')) {
+            bool required = c.endsWith('!');
+            list += new TestCheck(&conf, required ? c.left(c.length() - 1) : c, required);
+        }
+        QMap<QString, qint64> known;
+        foreach (const QString &d, durations.split(' ')) {
+            if (!d.isEmpty())
+                known.insert(d.section('=', 0, 0), d.section('=', 1).toLongLong());
+        }
+
+        QStringList names;
+        foreach (ConfObj *o, qc_schedule_checks(list, known))
+            names += o->shortname();
+        QCOMPARE(names.join(" "), order);
+    }
+
+    // one at a time, the checks run in declaration order, required or
+    // not, and each sees what those before it added
+    void serialOrder()
+    {
+        Conf       conf;
+        TestCheck *a = new TestCheck(&conf, "a");
+        TestCheck *b = new TestCheck(&conf, "b", true);
+        TestCheck *c = new TestCheck(&conf, "c");
+        a->define    = "A";
+        b->define    = "B";
+        QVERIFY(conf.exec());
+
+        QVERIFY(a->ran && a->ran < b->ran && b->ran < c->ran);
+        QCOMPARE(b->seenDefines, QString("A"));
+        QCOMPARE(c->seenDefines, QString("A B"));
+        // and nothing is added twice
+        QCOMPARE(conf.DEFINES, QString("A B"));
+    }
+
+    // a result that is already known is added where its check would have
+    // run
+    void serialPreset()
+    {
+        Conf       conf;
+        TestCheck *a = new TestCheck(&conf, "a");
+        TestCheck *b = new TestCheck(&conf, "b");
+        b->define    = "B";
+
+        QcCheckOutput known;
+        known.DEFINES = "A";
+        qc_shared_outputs.insert(a, known);
+        QVERIFY(conf.exec());
+
+        QVERIFY(!a->ran);
+        QCOMPARE(b->seenDefines, QString("A"));
+        QCOMPARE(conf.DEFINES, QString("A B"));
+    }
+
+    void serialFailFast()
+    {
+        Conf       conf;
+        TestCheck *a = new TestCheck(&conf, "a", false, false);
+        TestCheck *b = new TestCheck(&conf, "b", true, false);
+        TestCheck *c = new TestCheck(&conf, "c");
+        QVERIFY(!conf.exec());
+
+        QVERIFY(a->ran);
+        QVERIFY(b->ran);
+        QVERIFY(!c->ran);
+    }
+
+    // last, since the failure cancels the commands for the rest of the
+    // run.  the failed required check stops the command of the other one.
+    void parallelFailFast()
+    {
+        qputenv("QC_JOBS", "2");
+        Conf       conf;
+        TestCheck *a = new TestCheck(&conf, "a", true, false);
+        TestCheck *b = new TestCheck(&conf, "b");
+        a->msecs     = 500;
+        b->command   = QStringList() << "sleep" << "30";
+        b->define    = "B";
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(!conf.exec());
+        QVERIFY(timer.elapsed() < 10000);
+        QVERIFY(a->ran);
+
+        // nothing is merged after a failure
+        QVERIFY(conf.DEFINES.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSchedule)
+#include "tst_schedule.moc"
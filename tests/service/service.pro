@@ -0,0 +1,14 @@
+QT      -= gui
+QT      += network testlib
+CONFIG  += console testcase
+CONFIG  -= app_bundle
+TARGET   = tst_service
+
+CONFIG += c++11
+
+# the test includes conf4.cpp, which then leaves out its main()
+DEFINES     += QC_NO_MAIN QC_HAVE_NETWORK
+INCLUDEPATH += $$PWD/../../conf
+
+HEADERS += ../../conf/conf4.h
+SOURCES += tst_service.cpp
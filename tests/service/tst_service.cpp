@@ -0,0 +1,160 @@
+/*
+tst_service.cpp - tests for the conf service of conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+#ifndef QC_HAVE_NETWORK
+#error the conf service needs Qt 5.1 and QtNetwork
+#endif
+
+// the service, on a thread of its own instead of in conf --serve
+class ServiceThread : public QThread {
+public:
+    QString    name;
+    bool       listening;
+    QSemaphore ready;
+
+    ServiceThread(const QString &_name) : name(_name), listening(false) { }
+
+protected:
+    void run()
+    {
+        QcService service;
+        listening = service.listen(name);
+        ready.release();
+        if (listening)
+            exec();
+    }
+};
+
+// a check for the header h in dir.  with untracked, its result also
+// depends on something that isn't an input, as after a failed compile
+// probe.
+class HeaderCheck : public ConfObj {
+public:
+    QString id, dir, h;
+    bool    untracked;
+    int     runs;
+
+    HeaderCheck(Conf *c, const QString &_id, const QString &_dir, const QString &_h) :
+        ConfObj(c), id(_id), dir(_dir), h(_h), untracked(false), runs(0)
+    {
+    }
+
+    QString name() const { return id; }
+    QString shortname() const { return id; }
+    QString checkString() const { return QString(); }
+
+    bool exec()
+    {
+        ++runs;
+        if (untracked)
+            qc_add_untracked_input();
+        if (!conf->checkHeader(dir, h))
+            return false;
+        conf->addDefine("HAVE_" + id.toUpper());
+        return true;
+    }
+};
+
+class TestService : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir  cacheHome, scratch, include;
+    ServiceThread *service;
+
+    // whether the service has a result for o, asked as configure does
+    static bool known(Conf *conf, ConfObj *o)
+    {
+        QMap<ConfObj *, QcCheckOutput> outputs;
+        return qc_service_lookup(conf, QList<ConfObj *>() << o, &outputs).isEmpty();
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(cacheHome.isValid());
+        QVERIFY(scratch.isValid());
+        QVERIFY(include.isValid());
+
+        // a service of our own, and the checks one at a time
+        QString name = QString("qconf-tst-service-%1").arg(QCoreApplication::applicationPid());
+        qputenv("XDG_CACHE_HOME", QFile::encodeName(cacheHome.path()));
+        qputenv("QC_TMPDIR", QFile::encodeName(scratch.path()));
+        qputenv("QC_SERVICE", "Y");
+        qputenv("QC_SERVICE_NAME", name.toLatin1());
+        qputenv("QC_JOBS", "1");
+        qputenv("MAKEFLAGS", "");
+        qputenv("QC_SITE", "");
+
+        service = new ServiceThread(name);
+        service->start();
+        service->ready.acquire();
+        QVERIFY(service->listening);
+    }
+
+    void cleanupTestCase()
+    {
+        service->quit();
+        service->wait();
+        delete service;
+    }
+
+    // a result is served until one of its inputs changes, even one that
+    // failed
+    void droppedOnChange()
+    {
+        Conf         first;
+        HeaderCheck *a = new HeaderCheck(&first, "svc", include.path(), "svc.h");
+        QVERIFY(first.exec());
+        QCOMPARE(a->runs, 1);
+        QVERIFY(!a->success);
+
+        // configure hands the results over without waiting for an answer
+        Conf         second;
+        HeaderCheck *b = new HeaderCheck(&second, "svc", include.path(), "svc.h");
+        QTRY_VERIFY(known(&second, b));
+        QVERIFY(second.exec());
+        QCOMPARE(b->runs, 0);
+        QVERIFY(!b->success);
+
+        // the header appearing changes the result
+        QFile header(include.path() + "/svc.h");
+        QVERIFY(header.open(QFile::WriteOnly));
+        header.close();
+        Conf         third;
+        HeaderCheck *c = new HeaderCheck(&third, "svc", include.path(), "svc.h");
+        QVERIFY(!known(&third, c));
+        QVERIFY(third.exec());
+        QCOMPARE(c->runs, 1);
+        QVERIFY(c->success);
+        QCOMPARE(third.DEFINES, QString("HAVE_SVC"));
+    }
+
+    void untrackedNotKept()
+    {
+        Conf         first;
+        HeaderCheck *a = new HeaderCheck(&first, "tracked", include.path(), "tracked.h");
+        HeaderCheck *b = new HeaderCheck(&first, "untracked", include.path(), "untracked.h");
+        b->untracked   = true;
+        QVERIFY(first.exec());
+
+        // both results went to the service in the same request
+        Conf         second;
+        HeaderCheck *c = new HeaderCheck(&second, "tracked", include.path(), "tracked.h");
+        HeaderCheck *d = new HeaderCheck(&second, "untracked", include.path(), "untracked.h");
+        QTRY_VERIFY(known(&second, c));
+        QVERIFY(!known(&second, d));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestService)
+#include "tst_service.moc"
@@ -0,0 +1,151 @@
+/*
+tst_site.cpp - tests for the site file of conf4.cpp
+
+This file is free software; unlimited permission is given to copy and/or
+distribute it, with or without modifications, as long as this notice is
+preserved.
+*/
+
+#include <QtTest>
+
+#include "conf4.cpp"
+
+// a check that only notes that it ran
+class SiteCheck : public ConfObj {
+public:
+    QString id;
+    bool    ran;
+
+    SiteCheck(Conf *c, const QString &_id, bool _required) : ConfObj(c), id(_id), ran(false) { required = _required; }
+
+    QString name() const { return id; }
+    QString shortname() const { return id; }
+
+    bool exec()
+    {
+        ran = true;
+        return true;
+    }
+};
+
+class TestSite : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir tmp;
+
+    // writes lines to a site file and points QC_SITE at it
+    QMap<QString, QcSiteCheck> load(const QByteArray &lines)
+    {
+        QFile f(tmp.path() + "/qconf.site");
+        if (!f.open(QFile::WriteOnly | QFile::Truncate))
+            return QMap<QString, QcSiteCheck>();
+        f.write(lines);
+        f.close();
+        qputenv("QC_SITE", QFile::encodeName(f.fileName()));
+        return qc_load_site();
+    }
+
+private slots:
+    void initTestCase() { QVERIFY(tmp.isValid()); }
+
+    void noFile()
+    {
+        qputenv("QC_SITE", QFile::encodeName(tmp.path() + "/missing.site"));
+        QVERIFY(qc_load_site().isEmpty());
+        qputenv("QC_SITE", "");
+        QVERIFY(qc_load_site().isEmpty());
+    }
+
+    // the last dot only starts a field if a field follows it
+    void dottedShortname()
+    {
+        QMap<QString, QcSiteCheck> site = load("check.gstreamer-1.0 = yes\n"
+                                               "check.gstreamer-1.0.libs = -lgstreamer-1.0\n"
+                                               "check.qt5.15 = no\n");
+        QCOMPARE(QStringList(site.keys()), QStringList() << "gstreamer-1.0" << "qt5.15");
+        QVERIFY(site["gstreamer-1.0"].answered);
+        QVERIFY(site["gstreamer-1.0"].success);
+        QCOMPARE(site["gstreamer-1.0"].fields, QStringList() << "libs");
+        QCOMPARE(site["gstreamer-1.0"].values, QStringList() << "-lgstreamer-1.0");
+        QVERIFY(site["qt5.15"].answered);
+        QVERIFY(!site["qt5.15"].success);
+    }
+
+    // the flags keep the order of the file, and may come before the answer
+    void fieldOrder()
+    {
+        QMap<QString, QcSiteCheck> site = load("# a comment = ignored\n"
+                                               "check.foo.result = 2.1 (site)\n"
+                                               "check.foo.defines = HAVE_FOO\n"
+                                               "check.foo.libs = -lfoo\n"
+                                               "check.foo.defines = FOO_VERSION=2\n"
+                                               "check.foo = yes\n"
+                                               "check.foo.includepath = /opt/foo/include\n"
+                                               "qmake = /usr/bin/qmake\n");
+        QCOMPARE(QStringList(site.keys()), QStringList() << "foo");
+        const QcSiteCheck &c = site["foo"];
+        QVERIFY(c.answered);
+        QVERIFY(c.success);
+        QCOMPARE(c.result, QString("2.1 (site)"));
+        QCOMPARE(c.fields, QStringList() << "defines"
+                                         << "libs"
+                                         << "defines"
+                                         << "includepath");
+        QCOMPARE(c.values, QStringList() << "HAVE_FOO"
+                                         << "-lfoo"
+                                         << "FOO_VERSION=2"
+                                         << "/opt/foo/include");
+    }
+
+    void invalidAnswer_data()
+    {
+        QTest::addColumn<QByteArray>("value");
+
+        QTest::newRow("maybe") << QByteArray("maybe");
+        QTest::newRow("upper case") << QByteArray("YES");
+        QTest::newRow("number") << QByteArray("1");
+        QTest::newRow("empty") << QByteArray("");
+    }
+
+    // is ignored, with a warning, and leaves the check to run
+    void invalidAnswer()
+    {
+        QFETCH(QByteArray, value);
+
+        QMap<QString, QcSiteCheck> site = load("check.foo = " + value + "\ncheck.foo.defines = HAVE_FOO\n");
+        QVERIFY(!site.value("foo").answered);
+        QCOMPARE(site.value("foo").fields, QStringList() << "defines");
+    }
+
+    // last, since qc_site_lookup only reads the file once.  a required
+    // check the site file says is missing runs anyway, so that it fails
+    // for a real reason.
+    void lookup()
+    {
+        load("check.req = no\n"
+             "check.opt = no\n"
+             "check.yes = yes\n"
+             "check.yes.defines = HAVE_YES\n");
+
+        Conf      conf;
+        SiteCheck req(&conf, "req", true), opt(&conf, "opt", false), yes(&conf, "yes", false);
+        SiteCheck other(&conf, "other", false);
+        conf.list.clear(); // they are on the stack
+
+        QList<ConfObj *> checks;
+        checks << &req << &opt << &yes << &other;
+        QMap<ConfObj *, QcCheckOutput> outputs;
+        QList<ConfObj *>               rest = qc_site_lookup(&conf, checks, &outputs);
+
+        QCOMPARE(rest, QList<ConfObj *>() << &req << &other);
+        QVERIFY(!opt.success);
+        QVERIFY(yes.success);
+        QVERIFY(!outputs.contains(&req));
+        QCOMPARE(outputs.value(&yes).DEFINES, QString("HAVE_YES"));
+        QVERIFY(!req.ran && !opt.ran && !yes.ran);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSite)
+#include "tst_site.moc"
@@ -0,0 +1,10 @@
+QT      -= gui
+QT      += testlib
+CONFIG  += console testcase
+CONFIG  -= app_bundle
+TARGET   = tst_stringhelp
+
+INCLUDEPATH += $$PWD/../../src
+
+HEADERS += ../../src/stringhelp.h
+SOURCES += tst_stringhelp.cpp ../../src/stringhelp.cpp
@@ -0,0 +1,155 @@
+/*
+ * tst_stringhelp.cpp - string wrapping tests
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <QtTest>
+
+#include "stringhelp.h"
+
+// the wrapString() that re-sliced the rest of the string for every word.
+//   the view based one must give the same lines for any input.
+static QString oldGetNext(QString *str)
+{
+    if (str->isEmpty())
+        return QString();
+
+    // are we in space?
+    int n = 0;
+    if (str->at(n).isSpace()) {
+        // get out of it
+        while (n < (int)str->length() && str->at(n).isSpace())
+            ++n;
+        if (n == (int)str->length())
+            return QString();
+    }
+    // find end or next space
+    while (n < (int)str->length() && !str->at(n).isSpace())
+        ++n;
+    QString result = str->mid(0, n);
+    *str           = str->mid(n);
+    return result;
+}
+
+static QStringList oldWrapString(const QString &str, int wid)
+{
+    QStringList lines;
+    QString     cur;
+    QString     tmp       = str;
+    bool        firstword = true;
+    while (1) {
+        QString word = oldGetNext(&tmp);
+        if (word.isNull()) {
+            lines += cur;
+            break;
+        }
+        if (!cur.isEmpty()) {
+            if ((int)cur.length() + (int)word.length() > wid) {
+                lines += cur;
+                cur = "";
+            }
+        }
+        if (cur.isEmpty() && !firstword) {
+            // trim the whitespace in front
+            for (int n = 0; n < (int)word.length(); ++n) {
+                if (!word.at(n).isSpace()) {
+                    if (n > 0)
+                        word = word.mid(n);
+                    break;
+                }
+            }
+        }
+        cur += word;
+        firstword = false;
+    }
+    return lines;
+}
+
+class TestStringHelp : public QObject {
+    Q_OBJECT
+
+private slots:
+    void wrap_data()
+    {
+        QTest::addColumn<QString>("str");
+        QTest::addColumn<int>("wid");
+        QTest::addColumn<QStringList>("lines");
+
+        QTest::newRow("empty") << QString() << 10 << (QStringList() << QString());
+        QTest::newRow("only spaces") << QString("   ") << 10 << (QStringList() << QString());
+        QTest::newRow("fits") << QString("hello world") << 78 << (QStringList() << "hello world");
+        QTest::newRow("exact width") << QString("aaa bbb ccc") << 7 << (QStringList() << "aaa bbb"
+                                                                                      << "ccc");
+        // the first word keeps its leading whitespace
+        QTest::newRow("leading") << QString("  lead on") << 6 << (QStringList() << "  lead"
+                                                                                << "on");
+        QTest::newRow("trailing") << QString("a b  ") << 10 << (QStringList() << "a b");
+        // a word longer than the width gets a line of its own
+        QTest::newRow("long word") << QString("abcdefghij x") << 4 << (QStringList() << "abcdefghij"
+                                                                                     << "x");
+        // whitespace between words on one line is kept as it is
+        QTest::newRow("newline kept") << QString("a\nb") << 10 << (QStringList() << "a\nb");
+        QTest::newRow("newline wrapped") << QString("a\n\tb") << 1 << (QStringList() << "a"
+                                                                                     << "b");
+        QTest::newRow("zero width") << QString("a b c") << 0 << (QStringList() << "a"
+                                                                               << "b"
+                                                                               << "c");
+    }
+
+    void wrap()
+    {
+        QFETCH(QString, str);
+        QFETCH(int, wid);
+        QFETCH(QStringList, lines);
+
+        QCOMPARE(wrapString(str, wid), lines);
+        QCOMPARE(oldWrapString(str, wid), lines);
+    }
+
+    void sameAsOld()
+    {
+        // a fixed LCG, so a failure can be reproduced
+        const char   chars[] = "ab  \n\t";
+        unsigned int seed    = 1;
+        for (int i = 0; i < 5000; ++i) {
+            seed    = seed * 1103515245 + 12345;
+            int len = (seed >> 16) % 60;
+            QString str;
+            for (int n = 0; n < len; ++n) {
+                seed = seed * 1103515245 + 12345;
+                str += QLatin1Char(chars[(seed >> 16) % (sizeof(chars) - 1)]);
+            }
+            seed    = seed * 1103515245 + 12345;
+            int wid = (seed >> 16) % 20;
+            QVERIFY2(wrapString(str, wid) == oldWrapString(str, wid),
+                     qPrintable(QString("wid %1: \"%2\"").arg(wid).arg(str)));
+        }
+    }
+
+    void longParagraph()
+    {
+        QString str;
+        for (int n = 0; n < 20000; ++n)
+            str += QString("word%1 ").arg(n);
+
+        QStringList lines;
+        QBENCHMARK { lines = wrapString(str, 78); }
+        QCOMPARE(lines.join(" "), str.trimmed());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestStringHelp)
+#include "tst_stringhelp.moc"
@@ -0,0 +1,15 @@
+TEMPLATE = subdirs
+
+# run with "qmake && make check"
+SUBDIRS += qcfile stringhelp escape confhelpers probecache schedule replay site checkheaders qtmodule
+
+# like conf4.pro, the remote probe cache and the conf service need QtNetwork
+greaterThan(QT_MAJOR_VERSION, 4):qtHaveModule(network):SUBDIRS += remotecache service
+
+# "make bench" times the qconf built in the top directory on synthetic
+#   projects.  "make bench QCONF_REF=/path/to/qconf" also checks that it
+#   generates exactly what the reference qconf does.  it then checks that
+#   the conf4 flag helpers scale linearly, which "make check" leaves out.
+bench.commands = sh $$PWD/bench/bench.sh $$PWD/../qconf $(QCONF_REF) && \
+	QC_BENCH=Y ./confhelpers/tst_confhelpers splitcflagsScales prepareLibsScales
+QMAKE_EXTRA_TARGETS += bench